@@ -15,22 +15,29 @@
 #include <QDebug>
 #include <QDialog>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QItemSelectionModel>
+#include <QLineEdit>
 #include <QMessageBox>
 #include <QObject>
+#include <QProgressBar>
+#include <QPromise>
 #include <QPushButton>
 #include <QWidget>
 #include <Qt>
+#include <QtConcurrent>
 #include <fcitx-utils/fs.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/standardpaths.h>
 #include <fcitxqtconfiguiwidget.h>
+#include <initializer_list>
 #include <memory>
+#include <string>
 
 namespace fcitx::unikey {
 
 MacroEditor::MacroEditor(QWidget *parent)
-    : FcitxQtConfigUIWidget(parent), table_(std::make_unique<CMacroTable>()),
+    : FcitxQtConfigUIWidget(parent), table_(std::make_shared<CMacroTable>()),
       model_(new MacroModel(this)) {
     setupUi(this);
 
@@ -43,6 +50,9 @@ MacroEditor::MacroEditor(QWidget *parent)
             &MacroEditor::importMacro);
     connect(exportButton, &QPushButton::clicked, this,
             &MacroEditor::exportMacro);
+    connect(filterEdit, &QLineEdit::textChanged, model_,
+            &MacroModel::setFilter);
+    progressBar->hide();
     table_->init();
     macroTableView->horizontalHeader()->setStretchLastSection(true);
     macroTableView->verticalHeader()->setVisible(false);
@@ -55,7 +65,7 @@ MacroEditor::MacroEditor(QWidget *parent)
     itemFocusChanged();
 }
 
-MacroEditor::~MacroEditor() {}
+MacroEditor::~MacroEditor() { future_.waitForFinished(); }
 
 QString MacroEditor::icon() { return "fcitx-unikey"; }
 
@@ -82,39 +92,24 @@ void MacroEditor::addWord() {
     connect(dialog, &QDialog::accepted, this, &MacroEditor::addWordAccepted);
 }
 
-QString MacroEditor::getData(CMacroTable *table, int i, bool iskey) {
-
-    char key[MAX_MACRO_KEY_LEN * 3];
-    char value[MAX_MACRO_TEXT_LEN * 3];
-    do {
-        if (i < table->getCount()) {
-            const StdVnChar *p = nullptr;
-            int maxOutLen = 0;
-            const char *result = nullptr;
-            if (iskey) {
-                p = table->getKey(i);
-                maxOutLen = sizeof(key);
-                result = key;
-            } else {
-                p = table->getText(i);
-                maxOutLen = sizeof(value);
-                result = value;
-            }
+QString MacroEditor::getData(const CMacroTable *table, int i, bool iskey) {
 
-            if (!p) {
-                break;
-            }
-            int inLen = -1;
-            int ret =
-                VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_XUTF8,
-                          (UKBYTE *)p, (UKBYTE *)result, &inLen, &maxOutLen);
-            if (ret != 0) {
-                break;
-            }
-            return QString::fromUtf8(result);
-        }
-    } while (0);
-    return QString();
+    StdVnChar chars[MAX_MACRO_TEXT_LEN + 1];
+    char result[MAX_MACRO_TEXT_LEN * 3];
+    int len = iskey ? table->getKey(i, chars, MAX_MACRO_TEXT_LEN + 1)
+                    : table->getText(i, chars, MAX_MACRO_TEXT_LEN + 1);
+    if (len < 0) {
+        return QString();
+    }
+
+    int inLen = len * sizeof(StdVnChar);
+    int maxOutLen = sizeof(result);
+    int ret = VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_XUTF8,
+                        (UKBYTE *)chars, (UKBYTE *)result, &inLen, &maxOutLen);
+    if (ret != 0) {
+        return QString();
+    }
+    return QString::fromUtf8(result, maxOutLen);
 }
 
 void MacroEditor::addWordAccepted() {
@@ -131,13 +126,76 @@ void MacroEditor::load() {
 }
 
 void MacroEditor::save() {
-    model_->save(table_.get());
-    StandardPaths::global().safeSave(StandardPathsType::PkgConfig,
-                                     "unikey/macro", [this](int fd) -> bool {
-                                         UnixFD unixFD(fd);
-                                         auto f = fs::openFD(unixFD, "wb");
-                                         return table_->writeToFp(f.release());
-                                     });
+    watch(buildTable([](CMacroTable &table) {
+              return StandardPaths::global().safeSave(
+                  StandardPathsType::PkgConfig, "unikey/macro",
+                  [&table](int fd) -> bool {
+                      UnixFD unixFD(fd);
+                      auto f = fs::openFD(unixFD, "wb");
+                      return table.writeToFp(f.release());
+                  });
+          }),
+          [this](TablePtr table) {
+              if (table) {
+                  table_ = table;
+                  model_->load(table_.get());
+              }
+              Q_EMIT saveFinished();
+          });
+}
+
+QFuture<MacroEditor::TablePtr>
+MacroEditor::buildTable(std::function<bool(CMacroTable &)> write) {
+    return QtConcurrent::run(
+        [source = table_, rows = model_->rows(),
+         write = std::move(write)](QPromise<TablePtr> &promise) {
+            promise.setProgressRange(0, static_cast<int>(rows.size()));
+            auto table = std::make_shared<CMacroTable>();
+            table->init();
+            MacroModel::fillTable(
+                *source, rows, *table,
+                [&promise](int done) { promise.setProgressValue(done); });
+            if (write(*table)) {
+                promise.addResult(table);
+            }
+        });
+}
+
+void MacroEditor::watch(QFuture<TablePtr> future,
+                        std::function<void(TablePtr)> done) {
+    setBusy(true);
+    auto *watcher = new QFutureWatcher<TablePtr>(this);
+    connect(watcher, &QFutureWatcherBase::progressRangeChanged, progressBar,
+            &QProgressBar::setRange);
+    connect(watcher, &QFutureWatcherBase::progressValueChanged, progressBar,
+            &QProgressBar::setValue);
+    connect(watcher, &QFutureWatcherBase::finished, this,
+            [this, watcher, done = std::move(done)]() {
+                TablePtr table;
+                if (watcher->future().resultCount() > 0) {
+                    table = watcher->result();
+                }
+                watcher->deleteLater();
+                setBusy(false);
+                done(table);
+            });
+    future_ = future;
+    watcher->setFuture(future);
+}
+
+void MacroEditor::setBusy(bool busy) {
+    progressBar->setVisible(busy);
+    progressBar->setRange(0, 0);
+    for (QWidget *widget : std::initializer_list<QWidget *>{
+             macroTableView, filterEdit, addButton, clearButton, importButton,
+             exportButton}) {
+        widget->setEnabled(!busy);
+    }
+    if (busy) {
+        deleteButton->setEnabled(false);
+    } else {
+        itemFocusChanged();
+    }
 }
 
 void MacroEditor::importMacro() {
@@ -155,8 +213,21 @@ void MacroEditor::importFileSelected() {
     if (dialog->selectedFiles().length() <= 0) {
         return;
     }
-    QString file = dialog->selectedFiles()[0];
-    table_->loadFromFile(file.toUtf8().constData());
+    std::string file = dialog->selectedFiles()[0].toUtf8().toStdString();
+    watch(QtConcurrent::run([file](QPromise<TablePtr> &promise) {
+              auto table = std::make_shared<CMacroTable>();
+              table->init();
+              if (table->loadFromFile(file.c_str())) {
+                  promise.addResult(table);
+              }
+          }),
+          [this](TablePtr table) {
+              if (table) {
+                  table_ = table;
+                  model_->load(table_.get());
+                  model_->setNeedSave(true);
+              }
+          });
 }
 
 void MacroEditor::exportMacro() {
@@ -174,8 +245,11 @@ void MacroEditor::exportFileSelected() {
     if (dialog->selectedFiles().length() <= 0) {
         return;
     }
-    QString file = dialog->selectedFiles()[0];
-    table_->writeToFile(file.toUtf8().constData());
+    std::string file = dialog->selectedFiles()[0].toUtf8().toStdString();
+    watch(buildTable([file](CMacroTable &table) {
+              return table.writeToFile(file.c_str()) != 0;
+          }),
+          [](TablePtr) {});
 }
 
 } // namespace fcitx::unikey
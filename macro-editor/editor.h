@@ -8,9 +8,11 @@
 #define _MACRO_EDITOR_EDITOR_H_
 
 #include "ui_editor.h"
+#include <QFuture>
 #include <QString>
 #include <QWidget>
 #include <fcitxqtconfiguiwidget.h>
+#include <functional>
 #include <memory>
 
 class CMacroTable;
@@ -27,8 +29,9 @@ public:
     void save() override;
     QString title() override;
     QString icon() override;
+    bool asyncSave() override { return true; }
 
-    static QString getData(CMacroTable *table, int i, bool iskey);
+    static QString getData(const CMacroTable *table, int i, bool iskey);
 private Q_SLOTS:
     void addWord();
     void deleteWord();
@@ -41,8 +44,16 @@ private Q_SLOTS:
     void exportFileSelected();
 
 private:
-    std::unique_ptr<CMacroTable> table_;
+    using TablePtr = std::shared_ptr<CMacroTable>;
+    // The rows in a new table, which write saves, on a worker thread
+    QFuture<TablePtr> buildTable(std::function<bool(CMacroTable &)> write);
+    // Show the progress of the work, then hand its table to done
+    void watch(QFuture<TablePtr> future, std::function<void(TablePtr)> done);
+    void setBusy(bool busy);
+
+    TablePtr table_;
     MacroModel *model_;
+    QFuture<TablePtr> future_;
 };
 } // namespace fcitx::unikey
 
@@ -10,17 +10,16 @@
 #include "model.h"
 #include "vnconv.h"
 #include <QAbstractTableModel>
+#include <QByteArray>
 #include <QObject>
 #include <QString>
 #include <QVariant>
 #include <Qt>
+#include <algorithm>
 #include <fcitx-utils/i18n.h>
-#include <utility>
 
 namespace fcitx::unikey {
 
-using ItemType = std::pair<QString, QString>;
-
 MacroModel::MacroModel(QObject *parent)
     : QAbstractTableModel(parent), needSave_(false) {}
 
@@ -40,56 +39,169 @@ QVariant MacroModel::headerData(int section, Qt::Orientation orientation,
 }
 
 int MacroModel::rowCount(const QModelIndex & /*parent*/) const {
-    return list_.count();
+    return static_cast<int>(filter_.isEmpty() ? rows_.size() : visible_.size());
 }
 
 int MacroModel::columnCount(const QModelIndex & /*parent*/) const { return 2; }
 
+const MacroRow &MacroModel::rowAt(int row) const {
+    return filter_.isEmpty() ? rows_[row] : rows_[visible_[row]];
+}
+
+void MacroModel::convert(const MacroRow &row) const {
+    if (row.converted) {
+        return;
+    }
+    row.key = MacroEditor::getData(table_, row.source, true);
+    row.word = MacroEditor::getData(table_, row.source, false);
+    row.converted = true;
+}
+
 QVariant MacroModel::data(const QModelIndex &index, int role) const {
     do {
-        if (role == Qt::DisplayRole && index.row() < list_.count()) {
+        if (role == Qt::DisplayRole && index.row() < rowCount()) {
+            const MacroRow &row = rowAt(index.row());
+            convert(row);
             if (index.column() == 0) {
-                return list_[index.row()].first;
+                return row.key;
             }
             if (index.column() == 1) {
-                return list_[index.row()].second;
+                return row.word;
             }
         }
     } while (0);
     return QVariant();
 }
 
+// The text as the table holds it, false if it does not fit
+static bool toStdVnChars(const QString &text, StdVnChar *chars, int size) {
+    QByteArray utf8 = text.toUtf8();
+    int inLen = -1;
+    int maxOutLen = size * sizeof(StdVnChar);
+    return VnConvert(CONV_CHARSET_XUTF8, CONV_CHARSET_VNSTANDARD,
+                     (UKBYTE *)utf8.data(), (UKBYTE *)chars, &inLen,
+                     &maxOutLen) == 0;
+}
+
+// The first of the rows from the table that are past the item
+static std::vector<MacroRow>::const_iterator
+rowOfItem(const std::vector<MacroRow> &rows, int item) {
+    return std::lower_bound(rows.begin(), rows.end(), item,
+                            [](const MacroRow &row, int item) {
+                                return row.source >= 0 && row.source < item;
+                            });
+}
+
+// Keys the engine can't tell apart are the same
+bool MacroModel::hasKey(const QString &macro) const {
+    if (addedKeys_.contains(macro.toLower())) {
+        return true;
+    }
+    StdVnChar key[MAX_MACRO_KEY_LEN];
+    StdVnChar other[MAX_MACRO_KEY_LEN];
+    if (!table_ || !toStdVnChars(macro, key, MAX_MACRO_KEY_LEN)) {
+        return false;
+    }
+    int len = 0, first, last;
+    while (key[len] != 0) {
+        len++;
+    }
+    table_->keyPrefixRange(key, first, last);
+    for (auto it = rowOfItem(rows_, first);
+         it != rows_.end() && it->source >= 0 && it->source < last; ++it) {
+        if (table_->getKey(it->source, other, MAX_MACRO_KEY_LEN) == len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The rows of the table come from the index of its keys, the added ones
+// are looked through
+void MacroModel::updateVisible() {
+    visible_.clear();
+    if (filter_.isEmpty()) {
+        return;
+    }
+    StdVnChar prefix[MAX_MACRO_KEY_LEN];
+    int first = 0, last = 0;
+    if (table_ && toStdVnChars(filter_, prefix, MAX_MACRO_KEY_LEN)) {
+        table_->keyPrefixRange(prefix, first, last);
+    }
+    for (auto it = rowOfItem(rows_, first);
+         it != rows_.end() && it->source >= 0 && it->source < last; ++it) {
+        visible_.push_back(it - rows_.begin());
+    }
+    auto it = std::partition_point(
+        rows_.begin(), rows_.end(),
+        [](const MacroRow &row) { return row.source >= 0; });
+    for (; it != rows_.end(); ++it) {
+        if (it->key.startsWith(filter_, Qt::CaseInsensitive)) {
+            visible_.push_back(it - rows_.begin());
+        }
+    }
+}
+
+void MacroModel::setFilter(const QString &text) {
+    beginResetModel();
+    filter_ = text;
+    updateVisible();
+    endResetModel();
+}
+
 void MacroModel::addItem(const QString &macro, const QString &word) {
-    if (keyset_.contains(macro)) {
+    if (hasKey(macro)) {
         return;
     }
-    beginInsertRows(QModelIndex(), list_.size(), list_.size());
-    list_.append(std::pair<QString, QString>(macro, word));
-    keyset_.insert(macro);
-    endInsertRows();
+    MacroRow row;
+    row.converted = true;
+    row.key = macro;
+    row.word = word;
+    if (filter_.isEmpty()) {
+        beginInsertRows(QModelIndex(), rows_.size(), rows_.size());
+        rows_.push_back(row);
+        addedKeys_.insert(macro.toLower());
+        endInsertRows();
+    } else {
+        beginResetModel();
+        rows_.push_back(row);
+        addedKeys_.insert(macro.toLower());
+        updateVisible();
+        endResetModel();
+    }
     setNeedSave(true);
 }
 
 void MacroModel::deleteItem(int row) {
-    if (row >= list_.count()) {
+    if (row < 0 || row >= rowCount()) {
         return;
     }
-    std::pair<QString, QString> item = list_.at(row);
-    QString key = item.first;
+    int index = filter_.isEmpty() ? row : visible_[row];
     beginRemoveRows(QModelIndex(), row, row);
-    list_.removeAt(row);
-    keyset_.remove(key);
+    if (rows_[index].source < 0) {
+        addedKeys_.remove(rows_[index].key.toLower());
+    }
+    rows_.erase(rows_.begin() + index);
+    if (!filter_.isEmpty()) {
+        visible_.erase(visible_.begin() + row);
+        for (int &visible : visible_) {
+            if (visible > index) {
+                visible--;
+            }
+        }
+    }
     endRemoveRows();
     setNeedSave(true);
 }
 
 void MacroModel::deleteAllItem() {
-    if (list_.count()) {
+    if (!rows_.empty()) {
         setNeedSave(true);
     }
     beginResetModel();
-    list_.clear();
-    keyset_.clear();
+    rows_.clear();
+    addedKeys_.clear();
+    visible_.clear();
     endResetModel();
 }
 
@@ -102,26 +214,39 @@ void MacroModel::setNeedSave(bool needSave) {
 
 bool MacroModel::needSave() const { return needSave_; }
 
-void MacroModel::load(CMacroTable *table) {
+void MacroModel::load(const CMacroTable *table) {
     beginResetModel();
-    list_.clear();
-    keyset_.clear();
+    table_ = table;
+    rows_.clear();
+    addedKeys_.clear();
+    rows_.resize(table->getCount());
     for (int i = 0; i < table->getCount(); i++) {
-        QString key = MacroEditor::getData(table, i, true);
-        QString value = MacroEditor::getData(table, i, false);
-        list_.append(std::pair<QString, QString>(key, value));
-        keyset_.insert(key);
+        rows_[i].source = i;
     }
+    updateVisible();
     endResetModel();
+    setNeedSave(false);
 }
 
-void MacroModel::save(CMacroTable *table) {
-    table->resetContent();
-    for (const ItemType &item : list_) {
-        table->addItem(item.first.toUtf8().data(), item.second.toUtf8().data(),
-                       CONV_CHARSET_XUTF8);
+void MacroModel::fillTable(const CMacroTable &source,
+                           const std::vector<MacroRow> &rows,
+                           CMacroTable &table,
+                           const std::function<void(int)> &progress) {
+    StdVnChar key[MAX_MACRO_KEY_LEN];
+    StdVnChar text[MAX_MACRO_TEXT_LEN + 1];
+    for (size_t i = 0; i < rows.size(); i++) {
+        const MacroRow &row = rows[i];
+        if (row.source < 0) {
+            table.addItem(row.key.toUtf8().constData(),
+                          row.word.toUtf8().constData(), CONV_CHARSET_XUTF8);
+        } else if (source.getKey(row.source, key, MAX_MACRO_KEY_LEN) >= 0 &&
+                   source.getText(row.source, text, MAX_MACRO_TEXT_LEN + 1) >=
+                       0) {
+            table.addItem(key, text, CONV_CHARSET_VNSTANDARD);
+        }
+        progress(i + 1);
     }
-    setNeedSave(false);
+    table.sort();
 }
 
 } // namespace fcitx::unikey
@@ -14,9 +14,20 @@
 #include <QString>
 #include <QVariant>
 #include <Qt>
-#include <utility>
+#include <functional>
+#include <vector>
 
 namespace fcitx::unikey {
+
+// A row: an item of the table the model was loaded from, converted when it
+// is first shown, or one added since
+struct MacroRow {
+    int source = -1; // item of the table, -1 if added
+    mutable bool converted = false;
+    mutable QString key;
+    mutable QString word;
+};
+
 class MacroModel : public QAbstractTableModel {
     Q_OBJECT
 public:
@@ -29,21 +40,41 @@ public:
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index,
                   int role = Qt::DisplayRole) const override;
-    void load(CMacroTable *table);
+    // The rows read the table, which must outlive them
+    void load(const CMacroTable *table);
     void addItem(const QString &macro, const QString &word);
     void deleteItem(int row);
     void deleteAllItem();
-    void save(CMacroTable *table);
+    // Show only the rows whose macro starts with the text, in any case
+    void setFilter(const QString &text);
+    const std::vector<MacroRow> &rows() const { return rows_; }
     bool needSave() const;
+    void setNeedSave(bool needSave);
+
+    // Add the rows to the empty table and sort it, the items of the source
+    // copied as they are. Safe off the main thread, progress tells how many
+    // rows are done
+    static void fillTable(const CMacroTable &source,
+                          const std::vector<MacroRow> &rows,
+                          CMacroTable &table,
+                          const std::function<void(int)> &progress);
 
 Q_SIGNALS:
     void needSaveChanged(bool);
 
 private:
-    void setNeedSave(bool needSave);
+    const MacroRow &rowAt(int row) const;
+    void convert(const MacroRow &row) const;
+    bool hasKey(const QString &macro) const;
+    void updateVisible();
+
+    const CMacroTable *table_ = nullptr;
     bool needSave_;
-    QSet<QString> keyset_;
-    QList<std::pair<QString, QString>> list_;
+    // the items of the table in its order, then the added ones
+    std::vector<MacroRow> rows_;
+    QSet<QString> addedKeys_; // in lower case
+    QString filter_;
+    std::vector<int> visible_; // rows shown if filtered
 };
 
 } // namespace fcitx::unikey
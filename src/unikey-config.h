@@ -43,12 +43,21 @@ FCITX_CONFIGURATION(
     OptionWithAnnotation<UkConv, UkConvI18NAnnotation> oc{
         this, "OutputCharset", _("Output Charset"), UkConv::XUTF8};
     Option<bool> spellCheck{this, "SpellCheck", _("Enable spell check"), true};
+    Option<bool> spellingRules{
+        this, "SpellingRules",
+        _("Check Vietnamese spelling rules, such as k before i and e"),
+        false};
     Option<bool> macro{this, "Macro", _("Enable Macro"), true};
+    Option<bool> phraseMacro{this, "PhraseMacro",
+                             _("Expand macros whose keys span several words"),
+                             false};
     Option<bool> process_w_at_begin{this, "ProcessWAtBegin",
                                     _("Process W at word begin"), true};
     Option<bool> autoNonVnRestore{this, "AutoNonVnRestore",
                                   _("Auto restore keys with invalid words"),
                                   true};
+    Option<bool> autoComplete{this, "AutoComplete",
+                              _("Add the roofs and hooks a word lacks"), false};
     Option<bool> modernStyle{this, "ModernStyle",
                              _("Use oà, _uý (instead of òa, úy)"), false};
     Option<bool> freeMarking{this, "FreeMarking",
@@ -59,6 +68,9 @@ FCITX_CONFIGURATION(
     Option<bool> modifySurroundingText{
         this, "ModifySurroundingText",
         _("Allow to modify surrounding text (experimental)"), false};
+    Option<bool> directCommit{
+        this, "DirectCommit",
+        _("Commit characters directly instead of using preedit"), false};
     Option<bool> displayUnderline{this, "DisplayUnderline",
                                   _("Underline the preedit text"), true};
 #ifdef ENABLE_QT
@@ -21,6 +21,7 @@
 #include <fcitx-config/iniparser.h>
 #include <fcitx-utils/capabilityflags.h>
 #include <fcitx-utils/charutils.h>
+#include <fcitx-utils/event.h>
 #include <fcitx-utils/fs.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/key.h>
@@ -61,7 +62,6 @@ namespace {
 
 FCITX_DEFINE_LOG_CATEGORY(unikey, "unikey");
 
-constexpr auto CONVERT_BUF_SIZE = 1024;
 constexpr auto MAX_LENGTH_VNWORD = 7;
 const unsigned int Unikey_OC[] = {CONV_CHARSET_XUTF8,  CONV_CHARSET_TCVN3,
                                   CONV_CHARSET_VNIWIN, CONV_CHARSET_VIQR,
@@ -166,7 +166,28 @@ public:
     void handleIgnoredKey();
     void commit();
     void syncState(KeySym sym = FcitxKey_None);
+    void appendOutput();
     void updatePreedit();
+    void commitDelta();
+    void commitFixedPrefix();
+    void updateAfterInput(KeySym sym, bool commitFixed);
+    void queueKey(KeySym sym, bool shift, bool capsLock);
+    // The consonants a burst fixes are committed only when nothing follows it,
+    // a key that does handles the word itself
+    void flushPendingKeys(bool commitFixed = false);
+
+    // The keys waiting to be fed to the engine are never at the start of a
+    // word
+    bool isAtWordBeginning() const {
+        return pendingKeys_.empty() && uic_.isAtWordBeginning();
+    }
+
+    // Characters go to the client as they are typed, those that change are
+    // replaced through the surrounding text
+    bool isDirectCommit() const {
+        return *engine_->config().directCommit &&
+               ic_->capabilityFlags().test(CapabilityFlag::SurroundingText);
+    }
 
     void eraseChars(int num_chars) {
         int i;
@@ -187,8 +208,11 @@ public:
     }
 
     void reset() {
+        flushPendingKeys();
         uic_.resetBuf();
         preeditStr_.clear();
+        committedStr_.clear();
+        fixedCommitted_ = 0;
         updatePreedit();
         lastShiftPressed_ = FcitxKey_None;
     }
@@ -209,7 +233,7 @@ public:
             return;
         }
 
-        if (!uic_.isAtWordBeginning()) {
+        if (!isAtWordBeginning()) {
             return;
         }
 
@@ -285,7 +309,8 @@ public:
             return;
         }
 
-        if (!uic_.isAtWordBeginning()) {
+        // the words held for a phrase macro are not in the surrounding text
+        if (!isAtWordBeginning() || !preeditStr_.empty()) {
             return;
         }
 
@@ -308,19 +333,23 @@ public:
         // get the last word before the cursor
         std::vector<VnLexiName> chars;
         chars.reserve(MAX_LENGTH_VNWORD + 1);
-        // We will check at most MAX_LENGTH_VNWORD + 1 character before curosr.
-        // This ensures that the word is not longer than MAX_LENGTH_VNWORD.
+        // We will check at most MAX_LENGTH_VNWORD + 1 letter before curosr,
+        // each of them may be decomposed into a base and two marks. This
+        // ensures that the word is not longer than MAX_LENGTH_VNWORD.
+        constexpr size_t windowSize = (MAX_LENGTH_VNWORD + 1) * 3;
         size_t startCharacter = 0;
-        if (cursor >= MAX_LENGTH_VNWORD + 1) {
-            startCharacter = cursor - MAX_LENGTH_VNWORD - 1;
+        if (static_cast<size_t>(cursor) >= windowSize) {
+            startCharacter = cursor - windowSize;
         }
         auto start = utf8::nextNChar(text.begin(), startCharacter);
         // Get the string end at cursor.
         auto end = utf8::nextNChar(start, cursor - startCharacter);
+        std::string_view window(&*start, end - start);
+        // Letters may be typed decomposed, compose them before the lookup.
+        auto composed = VnNormalizeUtf8String(window, VN_NORM_NFC);
         // Scan from start to cursor, if hit a non Vn char, clear the buffer,
         // otherwise append to it.
-        for (uint32_t unicode :
-             utf8::MakeUTF8CharRange(std::string_view(&*start, end - start))) {
+        for (uint32_t unicode : utf8::MakeUTF8CharRange(composed)) {
             auto ch = charToVnLexi(unicode);
             if (ch == vnl_nonVnChar) {
                 chars.clear();
@@ -329,17 +358,39 @@ public:
             }
         }
 
-        length = chars.size();
-        if (length <= 0 || length > MAX_LENGTH_VNWORD) {
+        if (chars.empty() || chars.size() > MAX_LENGTH_VNWORD) {
             return;
         }
 
+        // Count the characters of the word as the text has them, with the
+        // marks that follow each letter.
+        std::vector<uint32_t> original;
+        for (uint32_t unicode : utf8::MakeUTF8CharRange(window)) {
+            original.push_back(unicode);
+        }
+        length = 0;
+        size_t letters = chars.size();
+        for (auto iter = original.rbegin(); iter != original.rend() && letters;
+             ++iter) {
+            length++;
+            if (*iter < 0x300 || *iter > 0x36F) {
+                letters--;
+            }
+        }
+
         for (auto ch : chars) {
             uic_.rebuildChar(ch);
             syncState();
         }
 
-        ic_->deleteSurroundingText(-length, length);
+        if (isDirectCommit()) {
+            // The word stays, only what the rebuild changes is replaced.
+            auto word =
+                utf8::nextNChar(window.begin(), original.size() - length);
+            committedStr_.assign(word, window.end());
+        } else {
+            ic_->deleteSurroundingText(-length, length);
+        }
         updatePreedit();
     }
 
@@ -351,6 +402,16 @@ private:
     InputContext *ic_;
     bool lastKeyWithShift_ = false;
     std::string preeditStr_;
+    // In direct commit mode, the part of preeditStr_ the client has
+    std::string committedStr_;
+    // Characters at the start of the word the client has outside the preedit
+    int fixedCommitted_ = 0;
+    // Printable keys of a burst, fed to the engine together once the event
+    // loop is done with the events at hand
+    std::vector<unsigned int> pendingKeys_;
+    bool pendingShift_ = false;
+    bool pendingCapsLock_ = false;
+    std::unique_ptr<EventSource> flushEvent_;
     bool autoCommit_ = false;
     KeySym lastShiftPressed_ = FcitxKey_None;
 };
@@ -490,6 +551,12 @@ void UnikeyState::preedit(KeyEvent &keyEvent) {
     auto sym = keyEvent.rawKey().sym();
     auto state = keyEvent.rawKey().states();
 
+    // Only printable keys join a burst, the others see it fed to the engine
+    if (sym < FcitxKey_space || sym > FcitxKey_asciitilde ||
+        state.testAny(KeyState::Ctrl_Alt) || state.test(KeyState::Super)) {
+        flushPendingKeys();
+    }
+
     // We try to detect Press and release of two different shift.
     // The sequence we want to detect is:
     if (keyEvent.rawKey().check(FcitxKey_Shift_L) ||
@@ -543,18 +610,7 @@ void UnikeyState::preedit(KeyEvent &keyEvent) {
 
         // change tone position after press backspace
         if (uic_.bufChars() > 0) {
-            if (engine_->config().oc.value() == UkConv::XUTF8) {
-                preeditStr_.append(reinterpret_cast<const char *>(uic_.buf()),
-                                   uic_.bufChars());
-            } else {
-                unsigned char buf[CONVERT_BUF_SIZE];
-                int bufSize = CONVERT_BUF_SIZE;
-
-                latinToUtf(buf, uic_.buf(), uic_.bufChars(), &bufSize);
-                preeditStr_.append((const char *)buf,
-                                   CONVERT_BUF_SIZE - bufSize);
-            }
-
+            appendOutput();
             autoCommit_ = false;
         }
         updatePreedit();
@@ -577,10 +633,12 @@ void UnikeyState::preedit(KeyEvent &keyEvent) {
         // (like consonant - phu am) if macro enabled, then not auto commit.
         // Because macro may change any word
         if (!*engine_->config().macro &&
-            (uic_.isAtWordBeginning() || autoCommit_) &&
+            (isAtWordBeginning() || autoCommit_) &&
             // conflict with the rebuildPreedit feature
             !*engine_->config().modifySurroundingText) {
             if (isWordAutoCommit(sym)) {
+                fixedCommitted_ =
+                    isAtWordBeginning() ? 1 : fixedCommitted_ + 1;
                 uic_.putChar(sym);
                 autoCommit_ = true;
                 return;
@@ -589,8 +647,7 @@ void UnikeyState::preedit(KeyEvent &keyEvent) {
 
         if ((*engine_->config().im == UkTelex ||
              *engine_->config().im == UkSimpleTelex2) &&
-            !*engine_->config().process_w_at_begin &&
-            uic_.isAtWordBeginning() &&
+            !*engine_->config().process_w_at_begin && isAtWordBeginning() &&
             (sym == FcitxKey_w || sym == FcitxKey_W)) {
             uic_.putChar(sym);
             if (!*engine_->config().macro) {
@@ -606,27 +663,18 @@ void UnikeyState::preedit(KeyEvent &keyEvent) {
 
         // shift + space, shift + shift event
         if (!lastKeyWithShift_ && state.test(KeyState::Shift) &&
-            sym == FcitxKey_space && !uic_.isAtWordBeginning()) {
+            sym == FcitxKey_space && !isAtWordBeginning()) {
+            flushPendingKeys();
             uic_.restoreKeyStrokes();
+            syncState(sym);
+            updateAfterInput(sym, true);
         } else {
-            uic_.filter(sym);
+            queueKey(sym, state.test(KeyState::Shift),
+                     state.test(KeyState::CapsLock));
         }
         // end shift + space
         // end process sym
 
-        syncState(sym);
-
-        // commit string: if need
-        if (!preeditStr_.empty()) {
-            if (preeditStr_.back() == sym && isWordBreakSym(sym)) {
-                commit();
-                keyEvent.filterAndAccept();
-                return;
-            }
-        }
-        // end commit string
-
-        updatePreedit();
         keyEvent.filterAndAccept();
         return;
     } // end capture printable char
@@ -648,11 +696,20 @@ void UnikeyEngine::reset(const InputMethodEntry & /*entry*/,
 }
 
 void UnikeyEngine::populateConfig() {
+    // the keys typed so far are fed with the options they were typed with
+    instance_->inputContextManager().foreach([this](InputContext *ic) {
+        ic->propertyFor(&factory_)->flushPendingKeys();
+        return true;
+    });
+
     UnikeyOptions ukopt;
     memset(&ukopt, 0, sizeof(ukopt));
     ukopt.macroEnabled = *config_.macro;
+    ukopt.phraseMacro = *config_.phraseMacro;
     ukopt.spellCheckEnabled = *config_.spellCheck;
+    ukopt.strictSpellCheck = *config_.spellingRules;
     ukopt.autoNonVnRestore = *config_.autoNonVnRestore;
+    ukopt.autoComplete = *config_.autoComplete;
     ukopt.modernStyle = *config_.modernStyle;
     ukopt.freeMarking = *config_.freeMarking;
     im_.setInputMethod(*config_.im);
@@ -734,7 +791,10 @@ void UnikeyState::handleIgnoredKey() {
 }
 
 void UnikeyState::commit() {
-    if (!preeditStr_.empty()) {
+    flushPendingKeys();
+    if (isDirectCommit()) {
+        commitDelta();
+    } else if (!preeditStr_.empty()) {
         ic_->commitString(preeditStr_);
     }
     reset();
@@ -751,16 +811,7 @@ void UnikeyState::syncState(KeySym sym) {
     }
 
     if (uic_.bufChars() > 0) {
-        if (*engine_->config().oc == UkConv::XUTF8) {
-            preeditStr_.append(reinterpret_cast<const char *>(uic_.buf()),
-                               uic_.bufChars());
-        } else {
-            unsigned char buf[CONVERT_BUF_SIZE + 1];
-            int bufSize = CONVERT_BUF_SIZE;
-
-            latinToUtf(buf, uic_.buf(), uic_.bufChars(), &bufSize);
-            preeditStr_.append((const char *)buf, CONVERT_BUF_SIZE - bufSize);
-        }
+        appendOutput();
     } else if (sym != FcitxKey_Shift_L && sym != FcitxKey_Shift_R &&
                sym != FcitxKey_None) // if ukengine not process
     {
@@ -769,7 +820,135 @@ void UnikeyState::syncState(KeySym sym) {
     // end process result of ukengine
 }
 
+void UnikeyState::appendOutput() {
+    if (*engine_->config().oc == UkConv::XUTF8) {
+        preeditStr_.append(reinterpret_cast<const char *>(uic_.buf()),
+                           uic_.bufChars());
+        return;
+    }
+    // a byte of the charset takes at most two in UTF-8, a long macro text
+    // as well
+    auto size = preeditStr_.size();
+    int left = uic_.bufChars() * 2;
+    preeditStr_.resize(size + left);
+    latinToUtf(reinterpret_cast<unsigned char *>(&preeditStr_[size]),
+               uic_.buf(), uic_.bufChars(), &left);
+    preeditStr_.resize(preeditStr_.size() - left);
+}
+
+void UnikeyState::commitDelta() {
+    size_t prefix = 0;
+    while (prefix < committedStr_.size() && prefix < preeditStr_.size() &&
+           committedStr_[prefix] == preeditStr_[prefix]) {
+        prefix++;
+    }
+    // Back to the first byte of the character that differs.
+    const auto isContinuation = [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    };
+    while (prefix > 0 && (isContinuation(committedStr_[prefix]) ||
+                          isContinuation(preeditStr_[prefix]))) {
+        prefix--;
+    }
+
+    auto removed = utf8::length(committedStr_.begin() + prefix,
+                                committedStr_.end());
+    if (removed > 0) {
+        ic_->deleteSurroundingText(-static_cast<int>(removed), removed);
+    }
+    if (prefix < preeditStr_.size()) {
+        ic_->commitString(preeditStr_.substr(prefix));
+    }
+    committedStr_ = preeditStr_;
+}
+
+void UnikeyState::updateAfterInput(KeySym sym, bool commitFixed) {
+    // commit string: if need
+    if (!preeditStr_.empty()) {
+        // the words are held while they may start a phrase macro
+        if (preeditStr_.back() == sym && isWordBreakSym(sym) &&
+            !uic_.startsPhraseMacro()) {
+            commit();
+            return;
+        }
+    }
+    // end commit string
+
+    if (commitFixed) {
+        commitFixedPrefix();
+    }
+    updatePreedit();
+}
+
+void UnikeyState::queueKey(KeySym sym, bool shift, bool capsLock) {
+    // keys with another case state are fed apart
+    if (!pendingKeys_.empty() &&
+        (shift != pendingShift_ || capsLock != pendingCapsLock_)) {
+        flushPendingKeys();
+    }
+    pendingKeys_.push_back(sym);
+    pendingShift_ = shift;
+    pendingCapsLock_ = capsLock;
+
+    // a word break commits the word, which the keys after it must not join
+    if (isWordBreakSym(sym)) {
+        flushPendingKeys();
+        return;
+    }
+    if (!flushEvent_) {
+        flushEvent_ = engine_->instance()->eventLoop().addDeferEvent(
+            [this](EventSource * /*source*/) {
+                flushPendingKeys(true);
+                return true;
+            });
+    }
+    flushEvent_->setOneShot();
+}
+
+void UnikeyState::flushPendingKeys(bool commitFixed) {
+    if (flushEvent_) {
+        flushEvent_->setEnabled(false);
+    }
+    if (pendingKeys_.empty()) {
+        return;
+    }
+
+    std::vector<unsigned int> keys;
+    keys.swap(pendingKeys_);
+    uic_.setCapsState(pendingShift_, pendingCapsLock_);
+    uic_.filter(keys);
+    syncState();
+    updateAfterInput(keys.back(), commitFixed);
+}
+
+void UnikeyState::commitFixedPrefix() {
+    // conflict with the rebuildPreedit feature
+    if (isDirectCommit() || *engine_->config().modifySurroundingText) {
+        return;
+    }
+    if (uic_.isAtWordBeginning()) {
+        fixedCommitted_ = 0;
+        return;
+    }
+
+    // The characters that will not change are plain consonants, one byte
+    // each in any output charset.
+    auto fixed = uic_.fixedChars();
+    auto count = static_cast<size_t>(fixed - fixedCommitted_);
+    if (fixed <= fixedCommitted_ || count > preeditStr_.size()) {
+        return;
+    }
+    ic_->commitString(preeditStr_.substr(0, count));
+    preeditStr_.erase(0, count);
+    fixedCommitted_ = fixed;
+}
+
 void UnikeyState::updatePreedit() {
+    if (isDirectCommit()) {
+        commitDelta();
+        return;
+    }
+
     auto &inputPanel = ic_->inputPanel();
 
     inputPanel.reset();
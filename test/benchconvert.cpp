@@ -0,0 +1,165 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+// Charset conversion, detection, normalization and key stroke writing
+// throughput.
+// Usage: benchconvert [corpus.txt]
+// The corpus must be UTF-8. Without one, a built-in news-style sample is used.
+#include "inputproc.h"
+#include "vnconv.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char sampleText[] =
+    "Hà Nội - Sáng nay, Thủ tướng Chính phủ đã chủ trì cuộc họp trực tuyến "
+    "với các bộ, ngành và địa phương về tình hình phát triển kinh tế - xã hội "
+    "trong quý III. Theo báo cáo của Tổng cục Thống kê, tổng sản phẩm trong "
+    "nước (GDP) tăng 6,8% so với cùng kỳ năm trước, cao hơn mức dự báo của "
+    "nhiều tổ chức quốc tế.\n"
+    "Tại TP.HCM, giá xăng dầu trong nước được điều chỉnh giảm từ 15h chiều "
+    "nay. Cụ thể, xăng E5 RON92 giảm 350 đồng/lít, còn 19.820 đồng/lít; xăng "
+    "RON95 giảm 410 đồng/lít. Liên Bộ Công Thương - Tài chính cho biết quỹ "
+    "bình ổn giá không được trích lập trong kỳ điều hành này.\n"
+    "Đội tuyển Việt Nam sẽ bước vào trận đấu quyết định với đối thủ Thái Lan "
+    "tại sân vận động Mỹ Đình vào tối thứ Bảy. Huấn luyện viên trưởng khẳng "
+    "định các cầu thủ đã sẵn sàng và quyết tâm giành chiến thắng trước sự cổ "
+    "vũ của hàng chục nghìn khán giả.\n";
+
+struct Target {
+    const char *name;
+    int charset;
+};
+
+const Target targets[] = {
+    {"TCVN3", CONV_CHARSET_TCVN3},   {"VISCII", CONV_CHARSET_VISCII},
+    {"VPS", CONV_CHARSET_VPS},       {"VNI-Win", CONV_CHARSET_VNIWIN},
+    {"BKHCM2", CONV_CHARSET_BKHCM2}, {"NCR", CONV_CHARSET_UNIREF},
+    {"UTF-8", CONV_CHARSET_UNIUTF8},
+};
+
+double convert(int from, int to, std::vector<UKBYTE> &input,
+               std::vector<UKBYTE> &output, int rounds) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        int inLen = input.size();
+        int outLen = output.size();
+        if (VnConvert(from, to, input.data(), output.data(), &inLen,
+                      &outLen) != 0) {
+            fprintf(stderr, "conversion %d -> %d failed\n", from, to);
+            return 0;
+        }
+        output.resize(outLen);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return (double)input.size() * rounds / elapsed.count() / 1e9;
+}
+
+double normalize(int form, const std::vector<UKBYTE> &input,
+                 std::vector<UKBYTE> &output, int rounds) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        int outLen = output.size();
+        if (VnNormalizeUtf8(form, input.data(), input.size(), output.data(),
+                            &outLen) != 0) {
+            fprintf(stderr, "normalization to %d failed\n", form);
+            return 0;
+        }
+        output.resize(outLen);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return (double)input.size() * rounds / elapsed.count() / 1e9;
+}
+
+// Microseconds per detection, -1 if the charset isn't the best guess
+double detect(int charset, const std::vector<UKBYTE> &input, int rounds) {
+    VnCharsetGuess guess;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        if (VnDetectCharset(input.data(), input.size(), &guess, 1) != 1 ||
+            guess.charset != charset)
+            return -1;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds * 1e6;
+}
+
+// Text written as key strokes of an input method
+double writeKeyStrokes(UkInputMethod im, const std::string &text,
+                       size_t &keys, int rounds) {
+    UkInputProcessor input;
+    input.init();
+    input.setIM(im);
+    UkKeyStrokeWriter writer(input);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        keys = writer.writeText(text).size();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return (double)text.size() * rounds / elapsed.count() / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string corpus;
+    if (argc > 1) {
+        std::ifstream in(argv[1], std::ios::binary);
+        corpus.assign(std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>());
+    }
+    if (corpus.empty()) {
+        while (corpus.size() < (16 << 20)) {
+            corpus += sampleText;
+        }
+    }
+
+    std::vector<UKBYTE> utf8(corpus.begin(), corpus.end());
+    const int rounds = 5;
+    printf("corpus: %zu bytes\n", utf8.size());
+    std::vector<UKBYTE> tcvn3(utf8.size());
+    convert(CONV_CHARSET_UNIUTF8, CONV_CHARSET_TCVN3, utf8, tcvn3, 1);
+
+    printf("%-10s %14s %14s %14s %10s\n", "charset", "UTF-8 -> cs",
+           "cs -> UTF-8", "TCVN3 -> cs", "detect");
+    for (const auto &target : targets) {
+        std::vector<UKBYTE> encoded(utf8.size() * 8);
+        double to = convert(CONV_CHARSET_UNIUTF8, target.charset, utf8,
+                            encoded, rounds);
+        std::vector<UKBYTE> decoded(encoded.size() * 3);
+        double from = convert(target.charset, CONV_CHARSET_UNIUTF8, encoded,
+                              decoded, rounds);
+        std::vector<UKBYTE> transcoded(tcvn3.size() * 8);
+        double fromTcvn3 = convert(CONV_CHARSET_TCVN3, target.charset, tcvn3,
+                                   transcoded, rounds);
+        double detectTime = detect(target.charset, encoded, 100);
+        printf("%-10s %9.3f GB/s %9.3f GB/s %9.3f GB/s %7.0f us\n",
+               target.name, to, from, fromTcvn3, detectTime);
+    }
+
+    std::vector<UKBYTE> nfd(utf8.size() * 3);
+    double toNfd = normalize(VN_NORM_NFD, utf8, nfd, rounds);
+    std::vector<UKBYTE> nfc(nfd.size());
+    double toNfc = normalize(VN_NORM_NFC, nfd, nfc, rounds);
+    printf("NFC -> NFD %9.3f GB/s, NFD -> NFC %9.3f GB/s\n", toNfd, toNfc);
+
+    size_t telexKeys = 0, vniKeys = 0;
+    double telex = writeKeyStrokes(UkTelex, corpus, telexKeys, rounds);
+    double vni = writeKeyStrokes(UkVni, corpus, vniKeys, rounds);
+    printf("key strokes: Telex %9.3f GB/s (%zu keys), VNI %9.3f GB/s (%zu "
+           "keys)\n",
+           telex, telexKeys, vni, vniKeys);
+    return 0;
+}
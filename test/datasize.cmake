@@ -0,0 +1,66 @@
+# Report the writable data of each object of unikey-lib, and fail if one of
+# the objects that only hold constant tables has any that is initialized, or
+# more than MAX_BSS bytes zeroed, as tables filled at startup would take.
+#
+# cmake -DSIZE=<size program> -DOBJECTS=<objects separated by |>
+#       -DCONST_OBJECTS=<names separated by |> -DMAX_BSS=<bytes>
+#       -P datasize.cmake
+
+string(REPLACE "|" ";" OBJECTS "${OBJECTS}")
+string(REPLACE "|" ";" CONST_OBJECTS "${CONST_OBJECTS}")
+
+set(total_data 0)
+set(total_bss 0)
+set(failed FALSE)
+foreach(object IN LISTS OBJECTS)
+    execute_process(COMMAND "${SIZE}" -A "${object}"
+                    OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${SIZE} failed on ${object}")
+    endif()
+    string(REPLACE "\n" ";" lines "${output}")
+
+    # .data.rel.ro is read only once relocated, the personality reference
+    # is in every object that can throw
+    set(data 0)
+    set(bss 0)
+    foreach(line IN LISTS lines)
+        if (line MATCHES "^(\\.[^ ]+) +([0-9]+)")
+            set(section "${CMAKE_MATCH_1}")
+            set(bytes "${CMAKE_MATCH_2}")
+            if (section MATCHES "^\\.data\\.rel\\.ro" OR
+                section MATCHES "^\\.data\\.rel\\.local\\.DW\\.ref\\.")
+                continue()
+            elseif (section MATCHES "^\\.data")
+                math(EXPR data "${data} + ${bytes}")
+            elseif (section MATCHES "^\\.bss")
+                math(EXPR bss "${bss} + ${bytes}")
+            endif()
+        endif()
+    endforeach()
+
+    get_filename_component(name "${object}" NAME)
+    message(STATUS "${name}: data ${data}, bss ${bss}")
+    math(EXPR total_data "${total_data} + ${data}")
+    math(EXPR total_bss "${total_bss} + ${bss}")
+
+    foreach(const IN LISTS CONST_OBJECTS)
+        if (NOT name MATCHES "^${const}\\.")
+            continue()
+        endif()
+        if (data GREATER 0)
+            message(SEND_ERROR "${name} has ${data} bytes of writable data")
+            set(failed TRUE)
+        endif()
+        if (bss GREATER MAX_BSS)
+            message(SEND_ERROR "${name} has ${bss} bytes of zeroed data, "
+                               "more than ${MAX_BSS}")
+            set(failed TRUE)
+        endif()
+    endforeach()
+endforeach()
+
+message(STATUS "unikey-lib: data ${total_data}, bss ${total_bss}")
+if (failed)
+    message(FATAL_ERROR "constant tables are in writable memory")
+endif()
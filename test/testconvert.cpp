@@ -0,0 +1,287 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "charset.h"
+#include <fcitx-utils/log.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Bytes that matter to the VIQR decoder: letters, marks, escapes, white
+// space and the escape patterns
+const char viqrBytes[] = "aAeEiIoOuUyYdDnhg'`?~.^(+*\\ \t\r\n:/@mltw";
+
+// VIQR to VNSTANDARD with decodeChar(), one character at a time
+std::string decodeByChar(const std::string &viqr, int len) {
+    std::vector<UKBYTE> output(viqr.size() * 4 + 8);
+    StringBIStream is((UKBYTE *)viqr.data(), len);
+    StringBOStream os(output.data(), output.size());
+    genConvert(*VnCharsetLibObj.getVnCharset(CONV_CHARSET_VIQR),
+               *VnCharsetLibObj.getVnCharset(CONV_CHARSET_VNSTANDARD), is, os);
+    return std::string((char *)output.data(), os.getOutBytes());
+}
+
+// Same with the decoding automaton
+std::string decodeBySpan(const std::string &viqr, int len) {
+    std::vector<UKBYTE> output(viqr.size() * 4 + 8);
+    int inLen = len;
+    int outLen = output.size();
+    int ret = VnConvert(CONV_CHARSET_VIQR, CONV_CHARSET_VNSTANDARD,
+                        (UKBYTE *)viqr.data(), output.data(), &inLen, &outLen);
+    FCITX_ASSERT(ret == 0);
+    return std::string((char *)output.data(), outLen);
+}
+
+void testViqrDecoder() {
+    std::mt19937 rng(2026);
+    VnConvOptions options;
+    VnConvResetOptions(&options);
+
+    for (int i = 0; i < 20000; i++) {
+        options.smartViqr = i & 1;
+        options.viqrEsc = (i >> 1) & 1;
+        VnConvSetOptions(&options);
+
+        // long enough now and then to span several chunks
+        std::string viqr;
+        int size = (i % 50 == 0) ? rng() % 2000 : rng() % 40;
+        for (int j = 0; j < size; j++) {
+            if (rng() % 50 == 0)
+                viqr += (char)(rng() % 256);
+            else
+                viqr += viqrBytes[rng() % (sizeof(viqrBytes) - 1)];
+        }
+
+        FCITX_ASSERT(decodeByChar(viqr, viqr.size()) ==
+                     decodeBySpan(viqr, viqr.size()))
+            << viqr;
+        // null terminated, the terminator is converted too
+        if (viqr.find('\0') == std::string::npos) {
+            FCITX_ASSERT(decodeByChar(viqr, -1) == decodeBySpan(viqr, -1))
+                << viqr;
+        }
+    }
+
+    VnConvResetOptions(&options);
+    VnConvSetOptions(&options);
+}
+
+// Bytes of hex and decimal references and of a UTF-8 sequence
+const char ncrBytes[] = "&#x1ec3;&#7875;\xe1\xbb\x83";
+
+// Charsets whose decoders accept any bytes
+const int streamCharsets[] = {
+    CONV_CHARSET_UNICODE,   CONV_CHARSET_UNIUTF8,   CONV_CHARSET_UNIREF,
+    CONV_CHARSET_UNIREF_HEX, CONV_CHARSET_UNIDECOMPOSED, CONV_CHARSET_VIQR,
+    CONV_CHARSET_UTF8VIQR,  CONV_CHARSET_TCVN3,     CONV_CHARSET_VNIWIN,
+    CONV_CHARSET_VISCII,    CONV_CHARSET_XUTF8,
+};
+
+// A stream fed in pieces gives what VnConvert gives for the whole input
+void testStreamConverter() {
+    std::mt19937 rng(33);
+    const int n = sizeof(streamCharsets) / sizeof(streamCharsets[0]);
+
+    for (int i = 0; i < 4000; i++) {
+        int inCharset = streamCharsets[rng() % n];
+        int outCharset = streamCharsets[rng() % n];
+
+        // mostly bytes that form characters, long now and then
+        std::string input;
+        int size = (i % 100 == 0) ? rng() % 200000 : rng() % 200;
+        for (int j = 0; j < size; j++) {
+            switch (rng() % 4) {
+            case 0:
+                input += (char)(rng() % 256);
+                break;
+            case 1:
+                input += ncrBytes[rng() % (sizeof(ncrBytes) - 1)];
+                break;
+            default:
+                input += viqrBytes[rng() % (sizeof(viqrBytes) - 1)];
+                break;
+            }
+        }
+
+        // VnConvert reads past a truncated UTF-16 character
+        if ((inCharset == CONV_CHARSET_UNICODE ||
+             inCharset == CONV_CHARSET_UNIDECOMPOSED) &&
+            input.size() % 2) {
+            input.pop_back();
+        }
+
+        std::vector<UKBYTE> whole(input.size() * 8 + 16);
+        int inLen = input.size();
+        int outLen = whole.size();
+        int ret = VnConvert(inCharset, outCharset, (UKBYTE *)input.data(),
+                            whole.data(), &inLen, &outLen);
+        FCITX_ASSERT(ret == 0);
+
+        VnStreamConverter stream(inCharset, outCharset);
+        FCITX_ASSERT(stream.isOK());
+        std::string output;
+        size_t pos = 0;
+        while (pos < input.size()) {
+            size_t piece = rng() % ((i % 3 == 0) ? 5 : 100000);
+            if (piece > input.size() - pos)
+                piece = input.size() - pos;
+            ret = stream.feed((const UKBYTE *)input.data() + pos, piece,
+                              output);
+            FCITX_ASSERT(ret == 0);
+            pos += piece;
+        }
+        ret = stream.finish(output);
+        FCITX_ASSERT(ret == 0);
+        FCITX_ASSERT(output == std::string((char *)whole.data(), outLen))
+            << inCharset << " " << outCharset << " " << input;
+    }
+}
+
+std::string readFile(const std::string &name) {
+    std::string data;
+    char buf[65536];
+    FILE *f = fopen(name.c_str(), "rb");
+    FCITX_ASSERT(f);
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.append(buf, n);
+    fclose(f);
+    return data;
+}
+
+// A file larger than one chunk, with a stretch too long to convert in
+// memory, gives what VnConvert gives for the whole of it
+void testFileConvert() {
+    std::mt19937 rng(30);
+    std::string input;
+    while (input.size() < 12000000) {
+        // lines, then one long line
+        size_t line = (input.size() > 3000000 && input.size() < 4000000)
+                          ? 9000000
+                          : rng() % 400;
+        for (size_t j = 0; j < line; j++) {
+            char c = (rng() % 4 == 0) ? ncrBytes[rng() % (sizeof(ncrBytes) - 1)]
+                                      : viqrBytes[rng() % 12];
+            input += c;
+        }
+        input += '\n';
+    }
+
+    char inName[] = "/tmp/testconvertXXXXXX";
+    int fd = mkstemp(inName);
+    FCITX_ASSERT(fd != -1);
+    FCITX_ASSERT(write(fd, input.data(), input.size()) ==
+                 (ssize_t)input.size());
+    close(fd);
+    std::string outName = std::string(inName) + ".out";
+
+    for (int outCharset : {CONV_CHARSET_VIQR, CONV_CHARSET_UNICODE}) {
+        std::vector<UKBYTE> whole(input.size() * 4 + 16);
+        int inLen = input.size();
+        int outLen = whole.size();
+        int ret = VnConvert(CONV_CHARSET_UTF8VIQR, outCharset,
+                            (UKBYTE *)input.data(), whole.data(), &inLen,
+                            &outLen);
+        FCITX_ASSERT(ret == 0);
+        std::string expected((char *)whole.data(), outLen);
+        if (outCharset == CONV_CHARSET_UNICODE)
+            expected.insert(0, "\xff\xfe", 2);
+
+        for (int threads : {1, 4}) {
+            ret = VnFileConvertParallel(CONV_CHARSET_UTF8VIQR, outCharset,
+                                        inName, outName.c_str(), threads);
+            FCITX_ASSERT(ret == 0) << ret;
+            FCITX_ASSERT(readFile(outName) == expected) << threads;
+        }
+    }
+    unlink(outName.c_str());
+    unlink(inName);
+}
+
+const char detectText[] =
+    "Tại TP.HCM, giá xăng dầu trong nước được điều chỉnh giảm từ 15h chiều "
+    "nay. Liên Bộ Công Thương - Tài chính cho biết quỹ bình ổn giá không "
+    "được trích lập trong kỳ điều hành này. Đội tuyển Việt Nam sẽ bước vào "
+    "trận đấu quyết định với đối thủ Thái Lan.\n";
+
+// Charsets the detector must tell apart on a paragraph
+const int detectCharsets[] = {
+    CONV_CHARSET_UNIUTF8, CONV_CHARSET_TCVN3,     CONV_CHARSET_VNIWIN,
+    CONV_CHARSET_VISCII,  CONV_CHARSET_VPS,       CONV_CHARSET_WINCP1258,
+    CONV_CHARSET_VIQR,    CONV_CHARSET_UNIREF,
+};
+
+void testDetectCharset() {
+    VnCharsetGuess guesses[16];
+    for (int charset : detectCharsets) {
+        std::vector<UKBYTE> encoded(sizeof(detectText) * 8);
+        int inLen = sizeof(detectText) - 1;
+        int outLen = encoded.size();
+        int ret = VnConvert(CONV_CHARSET_UNIUTF8, charset,
+                            (UKBYTE *)detectText, encoded.data(), &inLen,
+                            &outLen);
+        FCITX_ASSERT(ret == 0);
+        int n = VnDetectCharset(encoded.data(), outLen, guesses, 16);
+        FCITX_ASSERT(n > 0 && guesses[0].charset == charset) << charset;
+        FCITX_ASSERT(guesses[0].confidence >= 50) << charset;
+    }
+
+    // nothing but ASCII reads as UTF-8
+    const char ascii[] = "Nothing to see here, it's plain ASCII.";
+    int n = VnDetectCharset((const UKBYTE *)ascii, -1, guesses, 16);
+    FCITX_ASSERT(n > 0 && guesses[0].charset == CONV_CHARSET_UNIUTF8);
+    FCITX_ASSERT(VnDetectCharset((const UKBYTE *)"", -1, guesses, 16) == 0);
+}
+
+void testNormalize() {
+    // every letter, precomposed, then decomposed in canonical order
+    const std::string nfc = "ấ ầ ẩ ẫ ậ Ự ữ ỳ Ỹ ơ ă đ Đ";
+    const std::string nfd =
+        "a\u0302\u0301 a\u0302\u0300 a\u0302\u0309 a\u0302\u0303 "
+        "a\u0323\u0302 U\u031B\u0323 u\u031B\u0303 y\u0300 Y\u0303 "
+        "o\u031B a\u0306 đ Đ";
+    FCITX_ASSERT(VnNormalizeUtf8String(nfc, VN_NORM_NFD) == nfd);
+    FCITX_ASSERT(VnNormalizeUtf8String(nfd, VN_NORM_NFC) == nfc);
+    FCITX_ASSERT(VnNormalizeUtf8String(nfc, VN_NORM_NFC) == nfc);
+
+    // marks compose in any order, onto letters that have some already
+    for (const char *text : {"a\u0301\u0302", "â\u0301", "á\u0302",
+                             "a\u0341\u0302"}) {
+        FCITX_ASSERT(VnNormalizeUtf8String(text, VN_NORM_NFC) == "ấ") << text;
+        FCITX_ASSERT(VnNormalizeUtf8String(text, VN_NORM_NFD) ==
+                     "a\u0302\u0301")
+            << text;
+    }
+
+    // what isn't Vietnamese is left alone, broken UTF-8 too
+    const std::string other = "\u0301x\u0301 ü 中文 \xE1\x80 z";
+    FCITX_ASSERT(VnNormalizeUtf8String(other, VN_NORM_NFC) == other);
+    FCITX_ASSERT(VnNormalizeUtf8String(other, VN_NORM_NFD) == other);
+    // and so is a second tone mark
+    FCITX_ASSERT(VnNormalizeUtf8String("é\u0301", VN_NORM_NFC) ==
+                 "é\u0301");
+
+    UKBYTE output[8];
+    int outLen = sizeof(output);
+    int ret = VnNormalizeUtf8(VN_NORM_NFD, (const UKBYTE *)nfc.data(),
+                              nfc.size(), output, &outLen);
+    FCITX_ASSERT(ret == VNCONV_OUT_OF_MEMORY);
+    FCITX_ASSERT(outLen == (int)nfd.size());
+}
+
+} // namespace
+
+int main() {
+    testViqrDecoder();
+    testStreamConverter();
+    testFileConvert();
+    testDetectCharset();
+    testNormalize();
+    return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "unikeyinputcontext.h"
+#include <fcitx-utils/log.h>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// An input method with one context, writing UTF-8, and the text the client
+// shows once it applied the output of each key
+class InputFixture {
+public:
+    explicit InputFixture(UkInputMethod method = UkTelex) {
+        im.setInputMethod(method);
+        im.setOutputCharset(CONV_CHARSET_XUTF8);
+        options = im.sharedMem()->options;
+    }
+
+    // Takes the changes made to options
+    void updateOptions() { im.setOptions(&options); }
+
+    void setMacros(
+        std::initializer_list<std::pair<const char *, const char *>> items) {
+        auto table = std::make_unique<CMacroTable>();
+        table->init();
+        for (const auto &[key, text] : items) {
+            table->addItem(key, text, CONV_CHARSET_UNIUTF8);
+        }
+        im.setMacroTable(*table);
+    }
+
+    void type(const std::string &keys) {
+        for (unsigned char key : keys) {
+            uic.filter(key);
+            apply(key);
+        }
+    }
+
+    // The keys fed together, as the addon does for a burst
+    void typeBatch(const std::vector<unsigned int> &keys) {
+        uic.filter(keys);
+        apply(keys.back());
+    }
+
+    // What the last key wrote, after backspaces() characters were erased
+    std::string output() const {
+        return std::string((const char *)uic.buf(), uic.bufChars());
+    }
+    int backspaces() const { return uic.backspaces(); }
+
+    void reset() {
+        uic.resetBuf();
+        text.clear();
+    }
+
+    UnikeyInputMethod im;
+    UnikeyOptions options;
+    UnikeyInputContext uic{&im};
+    std::string text;
+
+private:
+    void apply(unsigned int key) {
+        for (int i = 0; i < uic.backspaces() && !text.empty(); i++) {
+            while (text.size() > 1 && (text.back() & 0xC0) == 0x80) {
+                text.pop_back();
+            }
+            text.pop_back();
+        }
+        if (uic.bufChars() > 0) {
+            text += output();
+        } else {
+            text.push_back(key);
+        }
+    }
+};
+
+void testKeyStrokes() {
+    const std::string text = "Người Việt, giường; thuở (quyển) đường ĐI ươn "
+                             "khuya. Ừ? Mượn rượu, hương!";
+    for (UkInputMethod method : {UkTelex, UkSimpleTelex, UkSimpleTelex2,
+                                 UkVni, UkViqr, UkMsVi}) {
+        UkInputProcessor input;
+        input.init();
+        input.setIM(method);
+        UkKeyStrokeWriter writer(input);
+        InputFixture fixture(method);
+        fixture.type(writer.writeText(text));
+        FCITX_ASSERT(fixture.text == text) << method;
+    }
+
+    UkInputProcessor input;
+    input.init();
+    UkKeyStrokeWriter telex(input);
+    FCITX_ASSERT(telex.writeText("người Việt, hươu") ==
+                 "nguowif Vieetj, huwowu");
+    // decomposed letters are typed the same
+    FCITX_ASSERT(telex.writeText("Vie\u0323\u0302t") == "Vieetj");
+    input.setIM(UkViqr);
+    UkKeyStrokeWriter viqr(input);
+    FCITX_ASSERT(viqr.writeText("Ca. Cá.") == "Ca\\. Ca'\\.");
+}
+
+// The consonants before the vowel are fixed, unless a macro key starts with
+// them, and restoring the key strokes leaves them alone
+void testFixedPrefix() {
+    InputFixture fixture;
+    fixture.options.spellCheckEnabled = 0;
+    fixture.options.freeMarking = 0;
+    fixture.options.macroEnabled = 1;
+    fixture.updateOptions();
+    fixture.setMacros({{"nhe", "nhẹ nhàng"}});
+
+    const int fixed[] = {0, 2, 3, 3, 3, 3, 3, 3};
+    const std::string keys = "nghieeng";
+    for (size_t i = 0; i < keys.size(); i++) {
+        fixture.type(keys.substr(i, 1));
+        FCITX_ASSERT(fixture.uic.fixedChars() == fixed[i]) << i;
+    }
+    fixture.uic.restoreKeyStrokes();
+    FCITX_ASSERT(fixture.backspaces() == 3);
+    FCITX_ASSERT(fixture.output() == "eeng");
+
+    fixture.reset();
+    fixture.type("nh");
+    FCITX_ASSERT(fixture.uic.fixedChars() == 0);
+    // đ may still be typed
+    fixture.reset();
+    fixture.type("d");
+    FCITX_ASSERT(fixture.uic.fixedChars() == 0);
+}
+
+void testPhraseMacro() {
+    InputFixture fixture;
+    fixture.options.spellCheckEnabled = 0;
+    fixture.options.freeMarking = 0;
+    fixture.options.macroEnabled = 1;
+    fixture.options.phraseMacro = 1;
+    fixture.updateOptions();
+    fixture.setMacros({{"n", "nào"}, {"t n", "thế nào"}});
+
+    fixture.type("t ");
+    FCITX_ASSERT(fixture.uic.startsPhraseMacro());
+    // the phrase wins over the word it ends with
+    fixture.type("n ");
+    FCITX_ASSERT(fixture.backspaces() == 3) << fixture.backspaces();
+    FCITX_ASSERT(fixture.output() == "thế nào ");
+
+    fixture.reset();
+    fixture.type("T N ");
+    FCITX_ASSERT(fixture.output() == "THẾ NÀO ");
+
+    fixture.reset();
+    fixture.type("x ");
+    FCITX_ASSERT(!fixture.uic.startsPhraseMacro());
+    fixture.type("n ");
+    FCITX_ASSERT(fixture.backspaces() == 1) << fixture.backspaces();
+    FCITX_ASSERT(fixture.output() == "nào ");
+
+    fixture.options.phraseMacro = 0;
+    fixture.updateOptions();
+    fixture.reset();
+    fixture.type("t ");
+    FCITX_ASSERT(!fixture.uic.startsPhraseMacro());
+}
+
+void testLongMacro() {
+    InputFixture fixture;
+    fixture.options = UnikeyOptions{};
+    fixture.options.macroEnabled = 1;
+    fixture.updateOptions();
+
+    // longer than the output buffer of the engine once in UTF-8
+    std::string text;
+    for (int i = 0; i < 80; i++) {
+        text += "nghiêng ngả ";
+    }
+    text += "đổ";
+    fixture.setMacros({{"ng", text.c_str()}});
+
+    fixture.type("ng ");
+    FCITX_ASSERT(fixture.backspaces() == 2);
+    FCITX_ASSERT(fixture.output() == text + " ");
+
+    // the same in upper case, converted as it is expanded
+    fixture.type("NG ");
+    FCITX_ASSERT(fixture.uic.bufChars() == static_cast<int>(text.size()) + 1);
+    FCITX_ASSERT(fixture.output().substr(0, 14) == "NGHIÊNG NGẢ");
+
+    // a key in lower case writes the text in lower case
+    fixture.setMacros({{"ng", text.c_str()}, {"vn", "Việt Nam"}});
+    fixture.type("vn.");
+    FCITX_ASSERT(fixture.output() == "việt nam.");
+}
+
+// Keys and texts are packed in 16 bits, they come back as they were added
+// and the keys match in any case
+void testMacroStorage() {
+    static CMacroTable table;
+    table.init();
+    const std::string expanded = "Điện thoại ☎ 100€";
+    FCITX_ASSERT(table.addItem("Đt", expanded.c_str(),
+                               CONV_CHARSET_UNIUTF8) == 0);
+
+    StdVnChar key[MAX_MACRO_KEY_LEN];
+    StdVnChar text[MAX_MACRO_TEXT_LEN + 1];
+    FCITX_ASSERT(table.getKey(0, key, MAX_MACRO_KEY_LEN) == 2);
+    int len = table.getText(0, text, MAX_MACRO_TEXT_LEN + 1);
+    FCITX_ASSERT(len == 17);
+
+    char utf8[64];
+    int inLen = len * sizeof(StdVnChar);
+    int outLen = sizeof(utf8);
+    FCITX_ASSERT(VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_XUTF8,
+                           (UKBYTE *)text, (UKBYTE *)utf8, &inLen,
+                           &outLen) == 0);
+    FCITX_ASSERT(std::string(utf8, outLen) == expanded);
+    FCITX_ASSERT(table.getText(0, text, 4) == -1);
+    FCITX_ASSERT(table.getText(1, text, MAX_MACRO_TEXT_LEN + 1) == -1);
+
+    key[0] = StdVnToLower(key[0]);
+    key[1] = StdVnToUpper(key[1]);
+    FCITX_ASSERT(table.hasKeyPrefix(key));
+    // the trie of the keys is built with the compiled copy
+    FCITX_ASSERT(table.suffixNext(0, key[1]) < 0);
+    std::vector<UKBYTE> mem;
+    const CMacroTable *compiled =
+        table.compile(CONV_CHARSET_XUTF8, [&mem](size_t size) {
+            mem.resize(size);
+            return static_cast<void *>(mem.data());
+        });
+    int node = compiled->suffixNext(compiled->suffixNext(0, key[1]), key[0]);
+    FCITX_ASSERT(node > 0 && compiled->suffixItem(node) == 0);
+
+    // copied as stored, then sorted: the keys with a prefix are together
+    table.addItem("bt", "bình thường", CONV_CHARSET_UNIUTF8);
+    table.addItem("đc", "được", CONV_CHARSET_UNIUTF8);
+    static CMacroTable copy;
+    copy.init();
+    for (int i = 0; i < table.getCount(); i++) {
+        table.getKey(i, key, MAX_MACRO_KEY_LEN);
+        table.getText(i, text, MAX_MACRO_TEXT_LEN + 1);
+        FCITX_ASSERT(copy.addItem(key, text, CONV_CHARSET_VNSTANDARD) == i);
+    }
+    copy.sort();
+    const StdVnChar prefix[] = {StdVnToLower(key[0]), 0};
+    int first, last;
+    copy.keyPrefixRange(prefix, first, last);
+    FCITX_ASSERT(first == 1 && last == 3);
+    // the last key copied, đc
+    copy.keyPrefixRange(key, first, last);
+    FCITX_ASSERT(first == 1 && last == 2);
+    FCITX_ASSERT(copy.getText(first, text, MAX_MACRO_TEXT_LEN + 1) == 4);
+}
+
+// The input method reads its macros from a sealed segment
+void testSharedMacroTable() {
+    InputFixture fixture;
+    fixture.setMacros({{"vn", "Việt Nam"}});
+    const CMacroTable *table = fixture.im.sharedMem()->macStore;
+    FCITX_ASSERT(table && table->getCount() == 1);
+    int len;
+    FCITX_ASSERT(table->encodedText(0, VnCaseNoChange, CONV_CHARSET_XUTF8,
+                                    len) != nullptr);
+    StdVnChar text[MAX_MACRO_TEXT_LEN + 1];
+    FCITX_ASSERT(table->getText(0, text, MAX_MACRO_TEXT_LEN + 1) == 8);
+
+    // the segment takes the size of the encoded texts, however many bytes
+    // the charset writes for them
+    std::string word;
+    for (int i = 0; i < 100; i++) {
+        word += "Ễ";
+    }
+    auto items = std::make_unique<CMacroTable>();
+    items->init();
+    for (int i = 0; i < 300; i++) {
+        std::string key = "k" + std::to_string(i);
+        FCITX_ASSERT(items->addItem(key.c_str(), word.c_str(),
+                                    CONV_CHARSET_UNIUTF8) == i);
+    }
+    fixture.im.setOutputCharset(CONV_CHARSET_UNIREF);
+    fixture.im.setMacroTable(*items);
+    table = fixture.im.sharedMem()->macStore;
+    for (VnCaseType form : {VnCaseNoChange, VnCaseAllSmall}) {
+        FCITX_ASSERT(table->encodedText(299, form, CONV_CHARSET_UNIREF,
+                                        len) != nullptr);
+        FCITX_ASSERT(len == 100 * 7) << len;
+    }
+
+    // the kernel can't write to it either
+    int pipeFds[2];
+    FCITX_ASSERT(pipe(pipeFds) == 0);
+    FCITX_ASSERT(write(pipeFds[1], "x", 1) == 1);
+    FCITX_ASSERT(read(pipeFds[0], (void *)table, 1) < 0);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+void testBatchFilter() {
+    InputFixture single;
+    InputFixture batch;
+    single.type("ng");
+    batch.type("ng");
+    single.type("uwowif");
+    // the tone moves back over the keys of the burst
+    batch.typeBatch({'u', 'w', 'o', 'w', 'i', 'f'});
+    FCITX_ASSERT(single.text == "người") << single.text;
+    FCITX_ASSERT(batch.text == single.text) << batch.text;
+}
+
+} // namespace
+
+int main() {
+    testKeyStrokes();
+    testFixedPrefix();
+    testBatchFilter();
+    testPhraseMacro();
+    testLongMacro();
+    testMacroStorage();
+    testSharedMacroTable();
+    return 0;
+}
@@ -1776,6 +1776,12 @@ void scheduleEvent(EventDispatcher *dispatcher, Instance *instance) {
         testfrontend->call<ITestFrontend::pushCommitExpectation>("aao");
         testfrontend->call<ITestFrontend::pushCommitExpectation>("aao");
         testfrontend->call<ITestFrontend::pushCommitExpectation>("aao");
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("aak ");
+        // The consonant that starts a word goes to the client as a key.
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("is ");
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("í ");
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("uân ");
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("is ");
         testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("Control+space"),
                                                     false);
         RawConfig config;
@@ -1847,7 +1853,52 @@ void scheduleEvent(EventDispatcher *dispatcher, Instance *instance) {
         testfrontend->call<ITestFrontend::keyEvent>(uuid, Key(FcitxKey_ssharp),
                                                     false);
 
+        // Backspace takes back the key strokes of the letter, so they are not
+        // restored with the word.
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("o"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("s"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("BackSpace"),
+                                                    false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("a"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("a"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("k"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("space"), false);
+
+        // ci is written ki.
+        config.setValueByPath("SpellingRules", "True");
+        unikey->setConfig(config);
+
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("c"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("i"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("s"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("space"), false);
+
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("k"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("i"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("s"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("space"), false);
+
+        // ua takes no coda, so luan can only be lua^n.
+        config.setValueByPath("AutoComplete", "True");
+        unikey->setConfig(config);
+
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("l"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("u"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("a"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("n"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("space"), false);
+
+        // The tone is not put on ci, even without restoring the key strokes.
+        config.setValueByPath("AutoComplete", "False");
         config.setValueByPath("AutoNonVnRestore", "False");
+        unikey->setConfig(config);
+
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("c"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("i"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("s"), false);
+        testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("space"), false);
+
+        config.setValueByPath("SpellingRules", "False");
         config.setValueByPath("SpellCheck", "False");
         config.setValueByPath("Macro", "True");
         unikey->setConfig(config);
@@ -1865,6 +1916,15 @@ void scheduleEvent(EventDispatcher *dispatcher, Instance *instance) {
                                                         false);
         }
 
+        // Keys sent together are fed to the engine as one burst, so the
+        // consonants that no macro key starts with are committed with the
+        // rest of the word.
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("nghiêng ");
+        for (const char *key : {"n", "g", "h", "i", "e", "e", "n", "g",
+                                "space"}) {
+            testfrontend->call<ITestFrontend::keyEvent>(uuid, Key(key), false);
+        }
+
         ic->reset();
         ic->surroundingText().setText("q", 1, 1);
         ic->updateSurroundingText();
@@ -1912,6 +1972,20 @@ void scheduleEvent(EventDispatcher *dispatcher, Instance *instance) {
         testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("s"), false);
         testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("Return"), false);
 
+        config.setValueByPath("ModifySurroundingText", "False");
+        config.setValueByPath("DirectCommit", "True");
+        unikey->setConfig(config);
+
+        // Characters are committed as they are fed to the engine, the keys
+        // sent together at once.
+        ic->reset();
+        ic->surroundingText().setText(" ", 1, 1);
+        ic->updateSurroundingText();
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("việt");
+        for (const char *key : {"v", "i", "e", "e", "t", "j", "Return"}) {
+            testfrontend->call<ITestFrontend::keyEvent>(uuid, Key(key), false);
+        }
+
         instance->deactivate();
         dispatcher->schedule([dispatcher, instance]() {
             dispatcher->detach();
@@ -0,0 +1,94 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "asciirun.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VN_ASCII_RUN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*AsciiRunFunc)(const UKBYTE *data, size_t len, int floor);
+
+//----------------------------------------------------------------------------
+// Scalar version, 8 bytes at a time.
+// For each byte b, (b & 0x7F) + (0x80 - floor) has its high bit set exactly
+// when (b & 0x7F) >= floor, and the per-byte sums never carry.
+//----------------------------------------------------------------------------
+static size_t asciiRunScalar(const UKBYTE *data, size_t len, int floor) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = ones * 0x80;
+    const uint64_t bias = ones * (uint64_t)(0x80 - floor);
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x;
+        memcpy(&x, data + i, 8);
+        uint64_t t = (x & ~high) + bias;
+        if ((x | ~t) & high)
+            break;
+    }
+    while (i < len && data[i] < 0x80 && data[i] >= floor)
+        i++;
+    return i;
+}
+
+#ifdef VN_ASCII_RUN_X86
+//----------------------------------------------------------------------------
+// Bytes in [floor, 0x80) are exactly those greater than (floor - 1) when
+// compared as signed chars.
+//----------------------------------------------------------------------------
+__attribute__((target("sse2"))) static size_t
+asciiRunSse2(const UKBYTE *data, size_t len, int floor) {
+    const __m128i threshold = _mm_set1_epi8((char)(floor - 1));
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned int mask =
+            (unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(v, threshold));
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + asciiRunScalar(data + i, len - i, floor);
+}
+
+//----------------------------------------------------------------------------
+__attribute__((target("avx2"))) static size_t
+asciiRunAvx2(const UKBYTE *data, size_t len, int floor) {
+    const __m256i threshold = _mm256_set1_epi8((char)(floor - 1));
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(v, threshold));
+        if (mask != 0xFFFFFFFFU)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + asciiRunSse2(data + i, len - i, floor);
+}
+#endif
+
+//----------------------------------------------------------------------------
+static AsciiRunFunc chooseAsciiRunFunc() {
+#ifdef VN_ASCII_RUN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return asciiRunAvx2;
+    if (__builtin_cpu_supports("sse2"))
+        return asciiRunSse2;
+#endif
+    return asciiRunScalar;
+}
+
+//----------------------------------------------------------------------------
+size_t VnAsciiRunLength(const UKBYTE *data, size_t len, int floor) {
+    static const AsciiRunFunc func = chooseAsciiRunFunc();
+    return func(data, len, floor);
+}
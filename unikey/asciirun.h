@@ -0,0 +1,22 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#ifndef __VN_ASCII_RUN_H
+#define __VN_ASCII_RUN_H
+
+#include <stddef.h>
+
+#include "byteio.h"
+
+//----------------------------------------------------------------------------
+// Returns the length of the longest prefix of data[0..len) whose bytes all lie
+// in [floor, 0x80). floor must be in [0, 0x80].
+// The scan uses AVX2 or SSE2 when the CPU supports them (checked once at
+// runtime) and a word-at-a-time scalar loop otherwise.
+//----------------------------------------------------------------------------
+size_t VnAsciiRunLength(const UKBYTE *data, size_t len, int floor);
+
+#endif
@@ -7,9 +7,11 @@
 #include <string.h>
 
 //------------------------------------------------
-StringBIStream::StringBIStream(UKBYTE *data, int len, int elementSize) {
+SpanBIStream::SpanBIStream(UKBYTE *data, int len, int elementSize) {
     m_data = m_current = data;
+    m_end = NULL;
     m_len = m_left = len;
+    m_hold = 0;
     if (len == -1) {
         if (elementSize == 2)
             m_eos = (*(UKWORD *)data == 0);
@@ -23,93 +25,20 @@ StringBIStream::StringBIStream(UKBYTE *data, int len, int elementSize) {
 }
 
 //------------------------------------------------
-int StringBIStream::eos() { return m_eos; }
-
-//------------------------------------------------
-int StringBIStream::getNext(UKBYTE &b) {
-    if (m_eos)
-        return 0;
-    b = *m_current++;
-    if (m_len == -1) {
-        m_eos = (b == 0);
-    } else {
-        m_left--;
-        m_eos = (m_left <= 0);
-    }
-    return 1;
-}
-
-//------------------------------------------------
-int StringBIStream::unget(UKBYTE b) {
-    if (m_current != m_data) {
-        *--m_current = b;
-        m_eos = 0;
-        if (m_len != -1)
-            m_left++;
-    }
-    return 1;
-}
-
-//------------------------------------------------
-int StringBIStream::getNextW(UKWORD &w) {
+int SpanBIStream::peekRun(const UKBYTE *&p) {
     if (m_eos)
         return 0;
-    w = *((UKWORD *)m_current);
-    m_current += 2;
-    if (m_len == -1)
-        m_eos = (w == 0);
-    else {
-        m_left -= 2;
-        m_eos = (m_left <= 0);
-    }
-    return 1;
+    p = m_current;
+    if (m_len != -1)
+        return (m_left > m_hold) ? m_left - m_hold : 0;
+    // the terminator itself is left to getNext(), which sets m_eos
+    if (m_end == NULL)
+        m_end = m_current + strlen((const char *)m_current);
+    return (int)(m_end - m_current);
 }
 
 //------------------------------------------------
-int StringBIStream::getNextDW(UKDWORD &dw) {
-    if (m_eos)
-        return 0;
-
-    dw = *((UKDWORD *)m_current);
-    m_current += 4;
-    if (m_len == -1)
-        m_eos = (dw == 0);
-    else {
-        m_left -= 4;
-        m_eos = (m_left <= 0);
-    }
-    return 1;
-}
-
-//------------------------------------------------
-int StringBIStream::peekNext(UKBYTE &b) {
-    if (m_eos)
-        return 0;
-    b = *m_current;
-    return 1;
-}
-
-//------------------------------------------------
-int StringBIStream::peekNextW(UKWORD &w) {
-    if (m_eos)
-        return 0;
-    w = *((UKWORD *)m_current);
-    return 1;
-}
-
-/*
-//------------------------------------------------
-int StringBIStream::peekNextDW(UKDWORD & dw)
-{
-    if (m_eos)
-        return 0;
-    dw = *((UKDWORD *)m_current);
-    return 1;
-}
-*/
-
-//------------------------------------------------
-void StringBIStream::reopen() {
+void SpanBIStream::reopen() {
     m_current = m_data;
     m_left = m_len;
     if (m_len == -1)
@@ -120,7 +49,7 @@ void StringBIStream::reopen() {
 }
 
 //------------------------------------------------
-int StringBIStream::bookmark() {
+int SpanBIStream::bookmark() {
     m_didBookmark = 1;
     m_bookmark.current = m_current;
     m_bookmark.data = m_data;
@@ -131,7 +60,7 @@ int StringBIStream::bookmark() {
 }
 
 //------------------------------------------------
-int StringBIStream::gotoBookmark() {
+int SpanBIStream::gotoBookmark() {
     if (!m_didBookmark)
         return 0;
     m_current = m_bookmark.current;
@@ -142,15 +71,12 @@ int StringBIStream::gotoBookmark() {
     return 1;
 }
 
-//------------------------------------------------
-int StringBIStream::close() { return 1; };
-
 //////////////////////////////////////////////////
-// Class StringBOStream
+// Class SpanBOStream
 //////////////////////////////////////////////////
 
 //------------------------------------------------
-StringBOStream::StringBOStream(UKBYTE *buf, int len) {
+SpanBOStream::SpanBOStream(UKBYTE *buf, int len) {
     m_current = m_buf = buf;
     m_len = len;
     m_out = 0;
@@ -158,46 +84,7 @@ StringBOStream::StringBOStream(UKBYTE *buf, int len) {
 }
 
 //------------------------------------------------
-int StringBOStream::putB(UKBYTE b) {
-    m_out++;
-    /*
-        if (m_out >= 2147483647) {
-            int err;
-            err = 1;
-        }
-    */
-    if (m_bad)
-        return 0;
-    /*
-        if (m_out < 0) {
-            int i;
-            i = 1;
-        }
-    */
-    if (m_out <= m_len) {
-        *m_current++ = b;
-        return 1;
-    }
-    m_bad = 1;
-    return 0;
-}
-
-//------------------------------------------------
-int StringBOStream::putW(UKWORD w) {
-    m_out += 2;
-    if (m_bad)
-        return 0;
-    if (m_out <= m_len) {
-        *((UKWORD *)m_current) = w;
-        m_current += 2;
-        return 1;
-    }
-    m_bad = 1;
-    return 0;
-}
-
-//------------------------------------------------
-int StringBOStream::puts(const char *s, int size) {
+int SpanBOStream::puts(const char *s, int size) {
     if (size == -1) {
         while (*s) {
             m_out++;
@@ -226,15 +113,12 @@ int StringBOStream::puts(const char *s, int size) {
 }
 
 //------------------------------------------------
-void StringBOStream::reopen() {
+void SpanBOStream::reopen() {
     m_current = m_buf;
     m_out = 0;
     m_bad = 0;
 }
 
-//------------------------------------------------
-int StringBOStream::isOK() { return !m_bad; }
-
 ////////////////////////////////////////////////////
 // Class FileBIStream                             //
 ////////////////////////////////////////////////////
@@ -8,6 +8,7 @@
 
 // #include "vnconv.h"
 #include <stdio.h>
+#include <string.h>
 
 typedef unsigned char UKBYTE;
 typedef unsigned short UKWORD;
@@ -38,6 +39,12 @@ public:
 
     virtual int gotoBookmark() { return 0; }
 
+    // direct access to the bytes that can be read next without going through
+    // getNext(), used to copy plain runs in bulk.
+    // Returns the number of bytes available at p, 0 if not supported
+    virtual int peekRun(const UKBYTE *& /*p*/) { return 0; }
+    virtual void skip(int /*n*/) {} // skip n bytes returned by peekRun
+
     virtual int eos() = 0; // end of stream
     virtual int close() = 0;
 };
@@ -52,11 +59,18 @@ public:
 };
 
 //----------------------------------------------------
-class StringBIStream : public ByteInStream {
+// Input over a contiguous buffer. Unlike the classes above, nothing here is
+// virtual: the codecs are templates over the stream type, and instantiating
+// them with this class lets the compiler inline the whole decode loop.
+// If len = -1, the data is null-terminated and the terminator is read too.
+//----------------------------------------------------
+class SpanBIStream {
 protected:
     int m_eos;
     UKBYTE *m_data, *m_current;
+    UKBYTE *m_end; // null terminator, located lazily when m_len = -1
     int m_len, m_left;
+    int m_hold; // bytes at the end only read to complete a character
 
     struct {
         int eos;
@@ -67,26 +81,179 @@ protected:
     int m_didBookmark;
 
 public:
-    StringBIStream(UKBYTE *data, int len, int elementSize = 1);
-    virtual int getNext(UKBYTE &b);
-    virtual int peekNext(UKBYTE &b);
-    virtual int unget(UKBYTE b);
+    SpanBIStream(UKBYTE *data, int len, int elementSize = 1);
+
+    int getNext(UKBYTE &b) {
+        if (m_eos)
+            return 0;
+        b = *m_current++;
+        if (m_len == -1) {
+            m_eos = (b == 0);
+        } else {
+            m_left--;
+            m_eos = (m_left <= 0);
+        }
+        return 1;
+    }
 
-    virtual int getNextW(UKWORD &w);
-    virtual int peekNextW(UKWORD &w);
+    int peekNext(UKBYTE &b) {
+        if (m_eos)
+            return 0;
+        b = *m_current;
+        return 1;
+    }
 
-    virtual int getNextDW(UKDWORD &dw);
+    int unget(UKBYTE b) {
+        if (m_current != m_data) {
+            *--m_current = b;
+            m_eos = 0;
+            if (m_len != -1)
+                m_left++;
+        }
+        return 1;
+    }
 
-    virtual int eos(); // end of stream
-    virtual int close();
+    int getNextW(UKWORD &w) {
+        if (m_eos)
+            return 0;
+        memcpy(&w, m_current, sizeof(w));
+        m_current += 2;
+        if (m_len == -1)
+            m_eos = (w == 0);
+        else {
+            m_left -= 2;
+            m_eos = (m_left <= 0);
+        }
+        return 1;
+    }
 
-    virtual int bookmark();
-    virtual int gotoBookmark();
+    int peekNextW(UKWORD &w) {
+        if (m_eos)
+            return 0;
+        memcpy(&w, m_current, sizeof(w));
+        return 1;
+    }
+
+    int getNextDW(UKDWORD &dw) {
+        if (m_eos)
+            return 0;
+        memcpy(&dw, m_current, sizeof(dw));
+        m_current += 4;
+        if (m_len == -1)
+            m_eos = (dw == 0);
+        else {
+            m_left -= 4;
+            m_eos = (m_left <= 0);
+        }
+        return 1;
+    }
+
+    int eos() { return m_eos; }
+    int close() { return 1; }
+
+    int bookmark();
+    int gotoBookmark();
+
+    int peekRun(const UKBYTE *&p);
+
+    // Holds back the last n bytes of a stream of known length: decoding
+    // stops before a character that starts there, see held()
+    void hold(int n) { m_hold = n; }
+    int held() { return m_hold > 0 && m_left <= m_hold; }
+    int holding() { return m_hold > 0; }
+
+    void skip(int n) {
+        m_current += n;
+        if (m_len != -1) {
+            m_left -= n;
+            m_eos = (m_left <= 0);
+        }
+    }
 
     void reopen();
     int left() { return m_left; }
 };
 
+//----------------------------------------------------
+// Output to a contiguous buffer, the static counterpart of ByteOutStream.
+// Bytes that don't fit are still counted; nothing more is written after
+// the first one that doesn't fit.
+//----------------------------------------------------
+class SpanBOStream {
+protected:
+    UKBYTE *m_buf, *m_current;
+    int m_out;
+    int m_len;
+    int m_bad;
+
+public:
+    SpanBOStream(UKBYTE *buf, int len);
+
+    int putB(UKBYTE b) {
+        m_out++;
+        if (m_bad)
+            return 0;
+        if (m_out <= m_len) {
+            *m_current++ = b;
+            return 1;
+        }
+        m_bad = 1;
+        return 0;
+    }
+
+    int putW(UKWORD w) {
+        m_out += 2;
+        if (m_bad)
+            return 0;
+        if (m_out <= m_len) {
+            memcpy(m_current, &w, sizeof(w));
+            m_current += 2;
+            return 1;
+        }
+        m_bad = 1;
+        return 0;
+    }
+
+    int puts(const char *s, int size = -1);
+    int isOK() { return !m_bad; }
+    int close() { return 1; }
+
+    void reopen();
+    int getOutBytes() { return m_out; }
+};
+
+//----------------------------------------------------
+// Virtual interface over SpanBIStream
+//----------------------------------------------------
+class StringBIStream : public ByteInStream {
+protected:
+    SpanBIStream m_span;
+
+public:
+    StringBIStream(UKBYTE *data, int len, int elementSize = 1)
+        : m_span(data, len, elementSize) {}
+    virtual int getNext(UKBYTE &b) { return m_span.getNext(b); }
+    virtual int peekNext(UKBYTE &b) { return m_span.peekNext(b); }
+    virtual int unget(UKBYTE b) { return m_span.unget(b); }
+
+    virtual int getNextW(UKWORD &w) { return m_span.getNextW(w); }
+    virtual int peekNextW(UKWORD &w) { return m_span.peekNextW(w); }
+
+    virtual int getNextDW(UKDWORD &dw) { return m_span.getNextDW(dw); }
+
+    virtual int eos() { return m_span.eos(); } // end of stream
+    virtual int close() { return m_span.close(); }
+
+    virtual int bookmark() { return m_span.bookmark(); }
+    virtual int gotoBookmark() { return m_span.gotoBookmark(); }
+
+    virtual int peekRun(const UKBYTE *&p) { return m_span.peekRun(p); }
+    virtual void skip(int n) { m_span.skip(n); }
+
+    void reopen() { m_span.reopen(); }
+    int left() { return m_span.left(); }
+};
+
 //----------------------------------------------------
 class FileBIStream : public ByteInStream {
 protected:
@@ -131,25 +298,26 @@ public:
     virtual ~FileBIStream();
 };
 
+//----------------------------------------------------
+// Virtual interface over SpanBOStream
 //----------------------------------------------------
 class StringBOStream : public ByteOutStream {
 protected:
-    UKBYTE *m_buf, *m_current;
-    int m_out;
-    int m_len;
-    int m_bad;
+    SpanBOStream m_span;
 
 public:
-    StringBOStream(UKBYTE *buf, int len);
-    virtual int putB(UKBYTE b);
-    virtual int putW(UKWORD w);
-    virtual int puts(const char *s, int size = -1);
-    virtual int isOK(); // get current stream state
+    StringBOStream(UKBYTE *buf, int len) : m_span(buf, len) {}
+    virtual int putB(UKBYTE b) { return m_span.putB(b); }
+    virtual int putW(UKWORD w) { return m_span.putW(w); }
+    virtual int puts(const char *s, int size = -1) {
+        return m_span.puts(s, size);
+    }
+    virtual int isOK() { return m_span.isOK(); } // get current stream state
 
     virtual int close() { return 1; };
 
-    void reopen();
-    int getOutBytes() { return m_out; }
+    void reopen() { m_span.reopen(); }
+    int getOutBytes() { return m_span.getOutBytes(); }
 };
 
 //----------------------------------------------------
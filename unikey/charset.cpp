@@ -4,12 +4,15 @@
  * SPDX-License-Identifier: GPL-2.0-or-later
  */
 
+#include <algorithm>
 #include <ctype.h>
+#include <map>
 #include <memory.h>
 #include <search.h>
 #include <stddef.h>
 #include <stdlib.h>
 
+#include "asciirun.h"
 #include "charset.h"
 #include "data.h"
 
@@ -30,9 +33,53 @@ DllExport CVnCharsetLib VnCharsetLibObj;
 //////////////////////////////////////////////////////
 int VnCharset::elementSize() { return 1; }
 
+//-------------------------------------------
+// Finds the lowest byte b such that every byte in [b, 0x80) is read
+// (input = 1) or written (input = 0) as a single byte standing for itself.
+// Plain ASCII letters are part of the Vietnamese table, so they stand for
+// their StdVnChar rather than their byte value.
+// Only meaningful for charsets whose handling of these bytes does not depend
+// on context. Must be called from the constructor of the final class.
+//-------------------------------------------
+int VnCharset::probeAsciiFloor(int input) {
+    int floor = 0x80;
+    while (floor > 0) {
+        UKBYTE b = (UKBYTE)(floor - 1);
+        StdVnChar self = b;
+        for (int i = 0; i < TOTAL_VNCHARS; i++)
+            if (UnicodeTable[i] == b) {
+                self = VnStdCharOffset + i;
+                break;
+            }
+
+        int len;
+        if (input) {
+            StdVnChar stdChar = 0;
+            StringBIStream is(&b, 1);
+            if (!nextInput(is, stdChar, len) || len != 1 || stdChar != self)
+                break;
+        } else {
+            UKBYTE buf[16];
+            StringBOStream os(buf, sizeof(buf));
+            if (!putChar(os, self, len) || os.getOutBytes() != 1 ||
+                buf[0] != b)
+                break;
+        }
+        floor--;
+    }
+    return (floor < 0x80) ? floor : -1;
+}
+
 //-------------------------------------------
 int VnInternalCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                  int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int VnInternalCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                  int &bytesRead) {
     if (!is.getNextDW(stdChar)) {
         bytesRead = 0;
         return 0;
@@ -44,6 +91,13 @@ int VnInternalCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //-------------------------------------------
 int VnInternalCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int VnInternalCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                  int &outLen) {
     outLen = sizeof(StdVnChar);
     os.putW((UKWORD)stdChar);
     return os.putW((UKWORD)(stdChar >> (sizeof(UKWORD) * 8)));
@@ -62,11 +116,20 @@ SingleByteCharset::SingleByteCharset(unsigned char *vnChars) {
             (i == TOTAL_VNCHARS - 1 || vnChars[i] != vnChars[i + 1]))
             m_stdMap[vnChars[i]] = i + 1;
     }
+    m_asciiInFloor = probeAsciiFloor(1);
+    m_asciiOutFloor = probeAsciiFloor(0);
 }
 
 //-------------------------------------------
 int SingleByteCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                  int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int SingleByteCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                  int &bytesRead) {
     unsigned char ch;
     if (!is.getNext(ch)) {
         bytesRead = 0;
@@ -81,6 +144,13 @@ int SingleByteCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //-------------------------------------------
 int SingleByteCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int SingleByteCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                  int &outLen) {
     int ret;
     unsigned char ch;
     if (stdChar >= VnStdCharOffset) {
@@ -127,6 +197,13 @@ UnicodeCharset::UnicodeCharset(UnicodeChar *vnChars) {
 //-------------------------------------------
 int UnicodeCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                               int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UnicodeCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                               int &bytesRead) {
     UnicodeChar uniCh;
     if (!is.getNextW(uniCh)) {
         bytesRead = 0;
@@ -145,6 +222,12 @@ int UnicodeCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 
 //-------------------------------------------
 int UnicodeCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeCharset::encodeChar(OutStream &os, StdVnChar stdChar, int &outLen) {
     outLen = sizeof(UnicodeChar);
     return os.putW((stdChar >= VnStdCharOffset)
                        ? m_toUnicode[stdChar - VnStdCharOffset]
@@ -189,6 +272,13 @@ UnicodeCompCharset::UnicodeCompCharset(UnicodeChar *uniChars,
 //---------------------------------------------
 int UnicodeCompCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                   int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UnicodeCompCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                   int &bytesRead) {
     // read first char
 
     UniCompCharInfo key;
@@ -228,6 +318,13 @@ int UnicodeCompCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //---------------------------------------------
 int UnicodeCompCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                 int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeCompCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                   int &outLen) {
     int ret;
     if (stdChar >= VnStdCharOffset) {
         UKDWORD uniCompCh = m_uniCompChars[stdChar - VnStdCharOffset];
@@ -252,8 +349,22 @@ int UnicodeCompCharset::elementSize() { return 2; }
 ////////////////////////////////
 // Unicode UTF-8              //
 ////////////////////////////////
+UnicodeUTF8Charset::UnicodeUTF8Charset(UnicodeChar *vnChars)
+    : UnicodeCharset(vnChars) {
+    m_asciiInFloor = probeAsciiFloor(1);
+    m_asciiOutFloor = probeAsciiFloor(0);
+}
+
+//-------------------------------------------
 int UnicodeUTF8Charset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                   int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UnicodeUTF8Charset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                   int &bytesRead) {
     UKWORD w1, w2, w3;
     UKBYTE first, second, third;
     UnicodeChar uniCh;
@@ -319,6 +430,13 @@ int UnicodeUTF8Charset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //-------------------------------------------
 int UnicodeUTF8Charset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                 int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeUTF8Charset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                   int &outLen) {
     UnicodeChar uChar = (stdChar < VnStdCharOffset)
                             ? (UnicodeChar)stdChar
                             : m_toUnicode[stdChar - VnStdCharOffset];
@@ -352,9 +470,23 @@ int hexDigitValue(unsigned char digit) {
     return 0;
 }
 
+//--------------------------------------
+UnicodeRefCharset::UnicodeRefCharset(UnicodeChar *vnChars)
+    : UnicodeCharset(vnChars) {
+    // '&' starts a reference, only the output side has plain runs
+    m_asciiOutFloor = probeAsciiFloor(0);
+}
+
 //--------------------------------------
 int UnicodeRefCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                  int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UnicodeRefCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                  int &bytesRead) {
     unsigned char ch;
     UnicodeChar uniCh;
     bytesRead = 0;
@@ -417,6 +549,13 @@ int UnicodeRefCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //--------------------------------
 int UnicodeRefCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeRefCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                  int &outLen) {
     UnicodeChar uChar = (stdChar < VnStdCharOffset)
                             ? (UnicodeChar)stdChar
                             : m_toUnicode[stdChar - VnStdCharOffset];
@@ -450,9 +589,22 @@ int UnicodeRefCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
 
 #define HEX_DIGIT(x) ((x < 10) ? ('0' + x) : ('A' + x - 10))
 
+//--------------------------------
+UnicodeHexCharset::UnicodeHexCharset(UnicodeChar *vnChars)
+    : UnicodeRefCharset(vnChars) {
+    m_asciiOutFloor = probeAsciiFloor(0);
+}
+
 //--------------------------------
 int UnicodeHexCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeHexCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                  int &outLen) {
     UnicodeChar uChar = (stdChar < VnStdCharOffset)
                             ? (UnicodeChar)stdChar
                             : m_toUnicode[stdChar - VnStdCharOffset];
@@ -493,6 +645,13 @@ void UnicodeCStringCharset::startInput() { m_prevIsHex = 0; }
 //----------------------------------------
 int UnicodeCStringCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                      int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UnicodeCStringCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                      int &bytesRead) {
     unsigned char ch;
     UnicodeChar uniCh;
     bytesRead = 0;
@@ -530,6 +689,13 @@ int UnicodeCStringCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //------------------------------------
 int UnicodeCStringCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                    int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UnicodeCStringCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                      int &outLen) {
     UnicodeChar uChar = (stdChar < VnStdCharOffset)
                             ? (UnicodeChar)stdChar
                             : m_toUnicode[stdChar - VnStdCharOffset];
@@ -576,11 +742,23 @@ DoubleByteCharset::DoubleByteCharset(UKWORD *vnChars) {
             (i << 16) + vnChars[i]; // high word is used for StdChar index
     }
     qsort(m_vnChars, TOTAL_VNCHARS, sizeof(UKDWORD), wideCharCompare);
+
+    // trailing bytes are all 8-bit, but plain vowels lead double-byte chars
+    m_asciiInFloor = probeAsciiFloor(1);
+    m_asciiOutFloor = probeAsciiFloor(0);
+    m_asciiLead = 1;
 }
 
 //---------------------------------------------
 int DoubleByteCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                  int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int DoubleByteCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                  int &bytesRead) {
     unsigned char ch;
 
     // read first byte
@@ -615,6 +793,13 @@ int DoubleByteCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //---------------------------------------------
 int DoubleByteCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                                int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int DoubleByteCharset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                  int &outLen) {
     int ret;
     if (stdChar >= VnStdCharOffset) {
         UKWORD wCh = m_toDoubleChar[stdChar - VnStdCharOffset];
@@ -661,7 +846,10 @@ const char *VIQREscapes[] = {
 
 const int VIQREscCount = sizeof(VIQREscapes) / sizeof(char *);
 
-VIQRCharset::VIQRCharset(UKDWORD *vnChars) {
+VIQRCharset::VIQRCharset(UKDWORD *vnChars, CVnCharsetLib *lib) {
+    m_lib = lib;
+    m_escState = 0;
+    m_outEscState = 0;
     memset(m_stdMap, 0, 256 * sizeof(UKWORD));
     int i;
     UKDWORD dw;
@@ -685,6 +873,8 @@ VIQRCharset::VIQRCharset(UKDWORD *vnChars) {
     m_stdMap[(unsigned char)'('] = 24;
     m_stdMap[(unsigned char)'+'] = 26;
     m_stdMap[(unsigned char)'*'] = 26;
+
+    buildDecoder();
 }
 
 //---------------------------------------------------
@@ -693,13 +883,20 @@ void VIQRCharset::startInput() {
     m_atWordBeginning = 1;
     m_gotTone = 0;
     m_escAll = 0;
-    if (VnCharsetLibObj.m_options.viqrEsc)
-        VnCharsetLibObj.m_VIQREscPatterns.reset();
+    if (m_lib->m_options.viqrEsc)
+        m_escState = 0;
+    m_dfaState = m_dfaInit[m_lib->m_options.smartViqr ? 1 : 0];
 }
 
 //---------------------------------------------------
 int VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                            int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int VIQRCharset::decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead) {
     unsigned char ch1;
     bytesRead = 0;
 
@@ -708,8 +905,9 @@ int VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
     bytesRead = 1;
     stdChar = m_stdMap[ch1];
 
-    if (VnCharsetLibObj.m_options.viqrEsc) {
-        if (VnCharsetLibObj.m_VIQREscPatterns.foundAtNextChar(ch1) != -1) {
+    if (m_lib->m_options.viqrEsc) {
+        if (m_lib->m_VIQREscPatterns.foundAtNextChar(m_escState, ch1) !=
+            -1) {
             m_escAll = 1;
         }
     }
@@ -732,7 +930,7 @@ int VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
         unsigned char ch2;
         is.peekNext(ch2);
         unsigned char upper = toupper(ch1);
-        if ((!VnCharsetLibObj.m_options.smartViqr || m_atWordBeginning) &&
+        if ((!m_lib->m_options.smartViqr || m_atWordBeginning) &&
             upper == 'D' && (ch2 == 'd' || ch2 == 'D')) {
             is.getNext(ch2);
             bytesRead++;
@@ -801,6 +999,293 @@ int VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
     return 1;
 }
 
+//---------------------------------------------------
+// State of decodeChar() between two bytes
+//---------------------------------------------------
+enum { VIQR_START, VIQR_ESCAPE, VIQR_BASE, VIQR_MARK };
+
+struct VIQRDecState {
+    int mode;  // VIQR_START: between characters
+               // VIQR_ESCAPE: after a backslash
+               // VIQR_BASE: after a vowel or d, which may take marks
+               // VIQR_MARK: after a vowel with a roof, breve or horn
+    int value; // VIQR_BASE: the letter, VIQR_MARK: the letter with its mark
+    int gotTone, atWordBeginning, escAll, smart;
+
+    // flags that are set again before being read are cleared, so that
+    // equivalent states are merged
+    void normalize() {
+        if (!smart || mode == VIQR_ESCAPE || mode == VIQR_MARK)
+            atWordBeginning = 0;
+        if (mode == VIQR_ESCAPE)
+            gotTone = 0;
+        if (mode != VIQR_BASE && mode != VIQR_MARK)
+            value = 0;
+    }
+
+    int key() const {
+        return ((((value * 4 + mode) * 2 + gotTone) * 2 + atWordBeginning) *
+                    2 +
+                escAll) *
+                   2 +
+               smart;
+    }
+};
+
+//---------------------------------------------------
+// One byte of decodeChar(): s is the state before b and becomes the state
+// after it. Returns the character completed (as in m_stdMap), 0 if none,
+// and sets action to the VIQR_DFA_ flags needed.
+// Only pure VIQR is handled: m_suspicious is always 0
+//---------------------------------------------------
+static UKWORD viqrStep(const UKWORD *stdMap, VIQRDecState &s, UKBYTE b,
+                       int &action) {
+    action = 0;
+    switch (s.mode) {
+    case VIQR_START:
+        if (s.escAll && (b == ' ' || b == '\t' || b == '\r' || b == '\n'))
+            s.escAll = 0;
+        if (b == '\\') {
+            s.mode = VIQR_ESCAPE;
+            return 0;
+        }
+        if (stdMap[b] < 256) {
+            action = VIQR_DFA_BYTE;
+            s.atWordBeginning = 1;
+            s.gotTone = 0;
+            return 0;
+        }
+        if (s.escAll || (!IS_VOWEL(b) && toupper(b) != 'D')) {
+            // can't take any mark
+            action = VIQR_DFA_LETTER;
+            s.atWordBeginning = 0;
+            return 0;
+        }
+        s.mode = VIQR_BASE;
+        s.value = b;
+        return 0;
+
+    case VIQR_ESCAPE:
+        action = VIQR_DFA_BYTE;
+        s.mode = VIQR_START;
+        s.atWordBeginning = 1;
+        s.gotTone = 0;
+        return 0;
+
+    case VIQR_BASE: {
+        unsigned char ch1 = s.value;
+        unsigned char upper = toupper(ch1);
+        UKWORD index = stdMap[b];
+        int dd = (!s.smart || s.atWordBeginning) && upper == 'D' &&
+                 (b == 'd' || b == 'D');
+
+        s.mode = VIQR_START;
+        s.atWordBeginning = 0;
+        if (dd)
+            return stdMap[ch1] + 2;
+
+        if (!IS_VOWEL(ch1) ||
+            !((index <= 10 && index > 0 &&
+               (!s.gotTone || (index != 6 && index != 10))) ||
+              (index == 12 &&
+               (upper == 'A' || upper == 'E' || upper == 'O')) ||
+              (index == 24 && upper == 'A') ||
+              (index == 26 && (upper == 'O' || upper == 'U')))) {
+            action = VIQR_DFA_AGAIN;
+            return stdMap[ch1];
+        }
+
+        s.gotTone = 1;
+        int offset = index;
+        if (offset == 26)
+            offset = 24;
+        if (offset == 24 && (ch1 == 'u' || ch1 == 'U'))
+            offset = 12;
+        if (index > 10) {
+            // a tone may follow
+            s.mode = VIQR_MARK;
+            s.value = stdMap[ch1] + offset;
+            return 0;
+        }
+        return stdMap[ch1] + offset;
+    }
+
+    case VIQR_MARK:
+        s.mode = VIQR_START;
+        s.atWordBeginning = 0;
+        if (stdMap[b] > 0 && stdMap[b] <= 10)
+            return s.value + stdMap[b];
+        action = VIQR_DFA_AGAIN;
+        return s.value;
+    }
+    return 0;
+}
+
+//---------------------------------------------------
+// Generates from the rules of decodeChar() an automaton that decodes VIQR
+// in one forward pass: a table of transitions by state and byte class.
+// The state is the pending letter or escape with the flags of decodeChar().
+// The escape patterns are matched apart: when a byte that starts a
+// character completes one, the state first goes to m_dfaEscAll[state]
+//---------------------------------------------------
+void VIQRCharset::buildDecoder() {
+    std::vector<int> classKeys;
+    std::vector<UKBYTE> classByte;
+    std::vector<VIQRDecState> states;
+    std::map<int, int> ids;
+    int i, c, b;
+
+    // bytes of a class behave the same in every state
+    for (b = 0; b < 256; b++) {
+        int key;
+        if (m_stdMap[b] < 256)
+            key = m_stdMap[b] * 4 + (b == '\\') * 2 +
+                  (b == ' ' || b == '\t' || b == '\r' || b == '\n');
+        else if (IS_VOWEL(b) || toupper(b) == 'D')
+            key = 0x10000 + b;
+        else
+            key = 0x20000; // other letters
+        for (c = 0; c < (int)classKeys.size() && classKeys[c] != key; c++)
+            ;
+        if (c == (int)classKeys.size()) {
+            classKeys.push_back(key);
+            classByte.push_back(b);
+        }
+        m_byteClass[b] = c;
+    }
+    m_classes = classKeys.size();
+
+    // all reachable states
+    for (int smart = 0; smart < 2; smart++) {
+        VIQRDecState s = {VIQR_START, 0, 0, 1, 0, smart};
+        s.normalize();
+        ids[s.key()] = states.size();
+        states.push_back(s);
+    }
+    for (i = 0; i < (int)states.size(); i++) {
+        for (c = -1; c < m_classes; c++) {
+            VIQRDecState s = states[i];
+            int action;
+            if (c < 0) {
+                if (s.mode != VIQR_START)
+                    continue;
+                s.escAll = 1;
+            } else {
+                viqrStep(m_stdMap, s, classByte[c], action);
+                s.normalize();
+            }
+            if (ids.find(s.key()) == ids.end()) {
+                ids[s.key()] = states.size();
+                states.push_back(s);
+            }
+        }
+    }
+
+    // number those between characters first
+    std::stable_partition(states.begin() + 2, states.end(),
+                          [](const VIQRDecState &s) {
+                              return s.mode == VIQR_START;
+                          });
+    m_dfaStarts = 0;
+    for (i = 0; i < (int)states.size(); i++) {
+        ids[states[i].key()] = i;
+        if (states[i].mode == VIQR_START)
+            m_dfaStarts = i + 1;
+    }
+    m_dfaInit[0] = 0;
+    m_dfaInit[1] = 1;
+
+    m_dfa.resize(states.size() * m_classes);
+    m_dfaEscAll.resize(m_dfaStarts);
+    m_dfaEnd.resize(states.size());
+    for (i = 0; i < (int)states.size(); i++) {
+        for (c = 0; c < m_classes; c++) {
+            VIQRDecState s = states[i];
+            int action;
+            UKWORD out = viqrStep(m_stdMap, s, classByte[c], action);
+            s.normalize();
+            VIQRTransition &t = m_dfa[i * m_classes + c];
+            t.next = ids[s.key()];
+            t.out = (out ? out - 255 : 0) | action;
+        }
+
+        VIQRDecState s = states[i];
+        switch (s.mode) {
+        case VIQR_START:
+            s.escAll = 1;
+            m_dfaEscAll[i] = ids[s.key()];
+            m_dfaEnd[i] = INVALID_STD_CHAR;
+            break;
+        case VIQR_ESCAPE:
+            m_dfaEnd[i] = '\\';
+            break;
+        case VIQR_BASE:
+            m_dfaEnd[i] = m_stdMap[s.value] - 256 + VnStdCharOffset;
+            break;
+        case VIQR_MARK:
+            m_dfaEnd[i] = s.value - 256 + VnStdCharOffset;
+            break;
+        }
+    }
+    m_dfaState = 0;
+}
+
+//---------------------------------------------------
+// Same as calling decodeChar() until the chunk is full, with the automaton
+// built by buildDecoder(). Returns 0 at end of input
+//---------------------------------------------------
+int VIQRCharset::decodeSpan(SpanBIStream &is, StdVnChar *chars, int &count) {
+    const VIQRTransition *dfa = m_dfa.data();
+    const PatternList &patterns = m_lib->m_VIQREscPatterns;
+    int viqrEsc = m_lib->m_options.viqrEsc;
+    int state = m_dfaState;
+    const UKBYTE *p;
+    UKBYTE b;
+    int i, len;
+
+    // a byte completes at most 2 characters, the end of input 1 more
+    len = is.peekRun(p);
+    if (len > (VN_SPAN_CHUNK - 1) / 2)
+        len = (VN_SPAN_CHUNK - 1) / 2;
+    if (len > 0)
+        is.skip(len);
+    else if (!is.held() && is.getNext(b)) {
+        // terminator of a null-terminated string
+        p = &b;
+        len = 1;
+    }
+
+    count = 0;
+    for (i = 0; i < len; i++) {
+        const VIQRTransition *t;
+        for (;;) {
+            if (state < m_dfaStarts && viqrEsc &&
+                patterns.foundAtNextChar(m_escState, p[i]) != -1)
+                state = m_dfaEscAll[state];
+            t = dfa + state * m_classes + m_byteClass[p[i]];
+            state = t->next;
+            if (t->out & VIQR_DFA_CHAR)
+                chars[count++] =
+                    (t->out & VIQR_DFA_CHAR) - 1 + VnStdCharOffset;
+            if (!(t->out & VIQR_DFA_AGAIN))
+                break;
+        }
+        if (t->out & VIQR_DFA_BYTE)
+            chars[count++] = p[i];
+        else if (t->out & VIQR_DFA_LETTER)
+            chars[count++] = m_stdMap[p[i]] - 256 + VnStdCharOffset;
+    }
+
+    if (is.eos()) {
+        if (m_dfaEnd[state] != INVALID_STD_CHAR)
+            chars[count++] = m_dfaEnd[state];
+        m_dfaState = m_dfaInit[m_lib->m_options.smartViqr ? 1 : 0];
+        return 0;
+    }
+    m_dfaState = state;
+    return 1;
+}
+
 //---------------------------------------------------
 void VIQRCharset::startOutput() {
     m_escapeBowl = 0;
@@ -808,11 +1293,17 @@ void VIQRCharset::startOutput() {
     m_escapeHook = 0;
     m_escapeTone = 0;
     m_noOutEsc = 0;
-    VnCharsetLibObj.m_VIQROutEscPatterns.reset();
+    m_outEscState = 0;
 }
 
 //---------------------------------------------------
 int VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int VIQRCharset::encodeChar(OutStream &os, StdVnChar stdChar, int &outLen) {
     int ret;
     UKBYTE b;
     if (stdChar >= VnStdCharOffset) {
@@ -824,7 +1315,8 @@ int VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
 
         b = (UKBYTE)dw;
         ret = os.putB(b);
-        if (VnCharsetLibObj.m_VIQROutEscPatterns.foundAtNextChar(b) != -1)
+        if (m_lib->m_VIQREscPatterns.foundAtNextChar(m_outEscState, b) !=
+            -1)
             m_noOutEsc = 1;
 
         if (m_noOutEsc && (b == ' ' || b == '\t' || b == '\r' || b == '\n'))
@@ -846,7 +1338,7 @@ int VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
                 m_escapeTone = (index == 12 || index == 24 || index == 26);
             }
 
-            VnCharsetLibObj.m_VIQROutEscPatterns.reset();
+            m_outEscState = 0;
 
             m_escapeBowl = 0;
             m_escapeHook = 0;
@@ -862,13 +1354,13 @@ int VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
         if (stdChar > 255) {
             outLen = 1;
             ret = os.putB((UKBYTE)PadChar);
-            if (VnCharsetLibObj.m_VIQROutEscPatterns.foundAtNextChar(
-                    (UKBYTE)PadChar) != -1)
+            if (m_lib->m_VIQREscPatterns.foundAtNextChar(m_outEscState,
+                                                         (UKBYTE)PadChar) != -1)
                 m_noOutEsc = 1;
         } else {
             outLen = 1;
             UKWORD index = m_stdMap[stdChar];
-            if (!VnCharsetLibObj.m_options.viqrMixed && !m_noOutEsc &&
+            if (!m_lib->m_options.viqrMixed && !m_noOutEsc &&
                 (stdChar == '\\' ||
                  (index > 0 && index <= 10 && m_escapeTone) ||
                  (index == 12 && m_escapeRoof) ||
@@ -878,13 +1370,14 @@ int VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) {
                 // tone mark, needs an escape character
                 outLen++;
                 ret = os.putB('\\');
-                if (VnCharsetLibObj.m_VIQROutEscPatterns.foundAtNextChar(
-                        '\\') != -1)
+                if (m_lib->m_VIQREscPatterns.foundAtNextChar(m_outEscState,
+                                                             '\\') != -1)
                     m_noOutEsc = 1;
             }
             b = (UKBYTE)stdChar;
             ret = os.putB(b);
-            if (VnCharsetLibObj.m_VIQROutEscPatterns.foundAtNextChar(b) != -1)
+            if (m_lib->m_VIQREscPatterns.foundAtNextChar(m_outEscState, b) !=
+                -1)
                 m_noOutEsc = 1;
             if (m_noOutEsc && (b == ' ' || b == '\t' || b == '\r' || b == '\n'))
                 m_noOutEsc = 0;
@@ -923,6 +1416,13 @@ void UTF8VIQRCharset::startOutput() {
 //-----------------------------------------
 int UTF8VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int UTF8VIQRCharset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                int &bytesRead) {
     UKBYTE ch;
 
     if (!is.peekNext(ch))
@@ -931,16 +1431,363 @@ int UTF8VIQRCharset::nextInput(ByteInStream &is, StdVnChar &stdChar,
     if (ch > 0xBF && ch < 0xFE) {
         m_pViqr->startInput(); // just to reset the VIQR object state
         m_pViqr->m_suspicious = 1;
-        return m_pUtf->nextInput(is, stdChar, bytesRead);
+        return m_pUtf->decodeChar(is, stdChar, bytesRead);
     }
 
-    return m_pViqr->nextInput(is, stdChar, bytesRead);
+    return m_pViqr->decodeChar(is, stdChar, bytesRead);
 }
 
 //-----------------------------------------
 int UTF8VIQRCharset::putChar(ByteOutStream &os, StdVnChar stdChar,
                              int &outLen) {
-    return m_pViqr->putChar(os, stdChar, outLen);
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int UTF8VIQRCharset::encodeChar(OutStream &os, StdVnChar stdChar, int &outLen) {
+    return m_pViqr->encodeChar(os, stdChar, outLen);
+}
+
+/////////////////////////////////////////////
+// Span codecs                             //
+/////////////////////////////////////////////
+
+//-----------------------------------------
+// Decodes up to VN_SPAN_CHUNK characters, dropping invalid ones.
+// Stops early in front of a long run of bytes in [runFloor, 0x80), which
+// the caller copies in bulk.
+// Returns 0 if the charset failed to read, like nextInput()
+//-----------------------------------------
+template <class Charset>
+static int decodeSpan(VnCharset &cs, SpanBIStream &is, StdVnChar *chars,
+                      int &count, int runFloor) {
+    Charset &charset = static_cast<Charset &>(cs);
+    StdVnChar stdChar;
+    int bytesRead;
+    int plain = 0;
+    UKBYTE b;
+
+    count = 0;
+    while (count < VN_SPAN_CHUNK && !is.eos() && !is.held()) {
+        if (runFloor >= 0 && is.peekNext(b) && b >= runFloor && b < 0x80) {
+            if (++plain > 16)
+                break;
+        } else
+            plain = 0;
+
+        stdChar = 0;
+        if (!charset.decodeChar(is, stdChar, bytesRead))
+            return 0;
+        if (stdChar != INVALID_STD_CHAR)
+            chars[count++] = stdChar;
+    }
+    return 1;
+}
+
+//-----------------------------------------
+// VIQR is decoded by its automaton, which knows no plain runs: a letter
+// may combine with the marks after it, so there is never a run floor
+//-----------------------------------------
+static int decodeViqrSpan(VnCharset &cs, SpanBIStream &is, StdVnChar *chars,
+                          int &count, int /*runFloor*/) {
+    return static_cast<VIQRCharset &>(cs).decodeSpan(is, chars, count);
+}
+
+//-----------------------------------------
+// Returns the result of the last putChar, or ret if count is 0
+//-----------------------------------------
+template <class Charset>
+static int encodeSpan(VnCharset &cs, SpanBOStream &os, const StdVnChar *chars,
+                      int count, int ret) {
+    Charset &charset = static_cast<Charset &>(cs);
+    int bytesWritten;
+    for (int i = 0; i < count; i++)
+        ret = charset.encodeChar(os, chars[i], bytesWritten);
+    return ret;
+}
+
+//-----------------------------------------
+// Must agree with the classes created by CVnCharsetLib::getVnCharset()
+//-----------------------------------------
+DllExport VnSpanDecoder VnGetSpanDecoder(int charsetIdx) {
+    switch (charsetIdx) {
+    case CONV_CHARSET_UNICODE:
+        return decodeSpan<UnicodeCharset>;
+    case CONV_CHARSET_UNIDECOMPOSED:
+        return decodeSpan<UnicodeCompCharset>;
+    case CONV_CHARSET_UNIUTF8:
+    case CONV_CHARSET_XUTF8:
+        return decodeSpan<UnicodeUTF8Charset>;
+    case CONV_CHARSET_UNIREF:
+    case CONV_CHARSET_UNIREF_HEX:
+        return decodeSpan<UnicodeRefCharset>;
+    case CONV_CHARSET_UNI_CSTRING:
+        return decodeSpan<UnicodeCStringCharset>;
+    case CONV_CHARSET_WINCP1258:
+        return decodeSpan<WinCP1258Charset>;
+    case CONV_CHARSET_VIQR:
+        return decodeViqrSpan;
+    case CONV_CHARSET_VNSTANDARD:
+        return decodeSpan<VnInternalCharset>;
+    case CONV_CHARSET_UTF8VIQR:
+        return decodeSpan<UTF8VIQRCharset>;
+    default:
+        if (IS_SINGLE_BYTE_CHARSET(charsetIdx))
+            return decodeSpan<SingleByteCharset>;
+        if (IS_DOUBLE_BYTE_CHARSET(charsetIdx))
+            return decodeSpan<DoubleByteCharset>;
+    }
+    return NULL;
+}
+
+//-----------------------------------------
+DllExport VnSpanEncoder VnGetSpanEncoder(int charsetIdx) {
+    switch (charsetIdx) {
+    case CONV_CHARSET_UNICODE:
+        return encodeSpan<UnicodeCharset>;
+    case CONV_CHARSET_UNIDECOMPOSED:
+        return encodeSpan<UnicodeCompCharset>;
+    case CONV_CHARSET_UNIUTF8:
+    case CONV_CHARSET_XUTF8:
+        return encodeSpan<UnicodeUTF8Charset>;
+    case CONV_CHARSET_UNIREF:
+        return encodeSpan<UnicodeRefCharset>;
+    case CONV_CHARSET_UNIREF_HEX:
+        return encodeSpan<UnicodeHexCharset>;
+    case CONV_CHARSET_UNI_CSTRING:
+        return encodeSpan<UnicodeCStringCharset>;
+    case CONV_CHARSET_WINCP1258:
+        return encodeSpan<WinCP1258Charset>;
+    case CONV_CHARSET_VIQR:
+        return encodeSpan<VIQRCharset>;
+    case CONV_CHARSET_VNSTANDARD:
+        return encodeSpan<VnInternalCharset>;
+    case CONV_CHARSET_UTF8VIQR:
+        return encodeSpan<UTF8VIQRCharset>;
+    default:
+        if (IS_SINGLE_BYTE_CHARSET(charsetIdx))
+            return encodeSpan<SingleByteCharset>;
+        if (IS_DOUBLE_BYTE_CHARSET(charsetIdx))
+            return encodeSpan<DoubleByteCharset>;
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////
+// Class: VnTranscodeTable                 //
+/////////////////////////////////////////////
+
+//-----------------------------------------
+VnTranscodeTable::VnTranscodeTable(int inCharset, VnCharset &incs,
+                                   int outCharset, VnCharset &outcs,
+                                   const VnConvOptions &options) {
+    UKBYTE input[2];
+    VnTranscodeEntry entry;
+    int b, second, pairCount;
+
+    m_inCharset = inCharset;
+    m_outCharset = outCharset;
+    m_toUpper = options.toUpper;
+    m_toLower = options.toLower;
+    m_removeTone = options.removeTone;
+    m_next = NULL;
+    m_pairs = NULL;
+    m_ok = 1;
+    m_outUnit = 1;
+
+    incs.startInput();
+    outcs.startOutput();
+
+    memset(m_pairIndex, 0, sizeof(m_pairIndex));
+    pairCount = 0;
+    for (b = 0; b < 256; b++) {
+        input[0] = (UKBYTE)b;
+        buildEntry(incs, outcs, input, 1, m_single[b]);
+        if (incs.byteInput() != 2)
+            continue;
+
+        // find the second bytes this byte combines with, if any
+        for (second = 1; second < 256; second++) {
+            input[1] = (UKBYTE)second;
+            if (buildEntry(incs, outcs, input, 2, entry) != 2)
+                continue;
+            if (m_pairIndex[b] == 0) {
+                pairCount++;
+                m_pairIndex[b] = pairCount;
+                m_pairs = (VnTranscodeEntry *)realloc(
+                    m_pairs, pairCount * 256 * sizeof(VnTranscodeEntry));
+                VnTranscodeEntry *block = m_pairs + (pairCount - 1) * 256;
+                for (int k = 0; k < 256; k++)
+                    block[k].len = 0xFF;
+            }
+            m_pairs[(m_pairIndex[b] - 1) * 256 + second] = entry;
+        }
+    }
+
+    m_runFloor = 0x80;
+    m_runLead = 0;
+    while (m_runFloor > 0) {
+        b = m_runFloor - 1;
+        if (m_single[b].len != 1 || m_single[b].out[0] != b)
+            break;
+        if (m_pairIndex[b])
+            m_runLead = 1;
+        m_runFloor--;
+    }
+    if (m_runFloor == 0x80)
+        m_runFloor = -1;
+}
+
+//-----------------------------------------
+VnTranscodeTable::~VnTranscodeTable() {
+    if (m_pairs)
+        free(m_pairs);
+}
+
+//-----------------------------------------
+// Collects the output of one putChar() call, noting whether it was written
+// byte by byte or in 16-bit words, which fail differently on overflow.
+//-----------------------------------------
+class EntryBOStream : public ByteOutStream {
+public:
+    VnTranscodeEntry &m_entry;
+    int m_out;
+    int m_words, m_bytes;
+
+    EntryBOStream(VnTranscodeEntry &entry)
+        : m_entry(entry), m_out(0), m_words(0), m_bytes(0) {}
+    void add(UKBYTE b) {
+        if (m_out < MAX_TRANSCODE_OUT)
+            m_entry.out[m_out] = b;
+        m_out++;
+    }
+    virtual int putB(UKBYTE b) {
+        m_bytes = 1;
+        add(b);
+        return 1;
+    }
+    virtual int putW(UKWORD w) {
+        m_words = 1;
+        add((UKBYTE)w);
+        add((UKBYTE)(w >> 8));
+        return 1;
+    }
+    virtual int puts(const char *s, int size = -1) {
+        if (size == -1)
+            size = strlen(s);
+        for (int i = 0; i < size; i++)
+            putB(s[i]);
+        return 1;
+    }
+    virtual int isOK() { return 1; }
+};
+
+//-----------------------------------------
+// Converts one input sequence through both charsets, exactly as genConvert
+// would. Returns the number of input bytes consumed.
+//-----------------------------------------
+int VnTranscodeTable::buildEntry(VnCharset &incs, VnCharset &outcs,
+                                 UKBYTE *input, int len,
+                                 VnTranscodeEntry &entry) {
+    StdVnChar stdChar = 0;
+    int bytesRead, bytesWritten;
+    StringBIStream is(input, len);
+
+    entry.len = 0;
+    if (!incs.nextInput(is, stdChar, bytesRead))
+        return 0;
+    bytesRead = len - is.left();
+    if (stdChar == INVALID_STD_CHAR)
+        return bytesRead;
+
+    if (m_toLower)
+        stdChar = StdVnToLower(stdChar);
+    else if (m_toUpper)
+        stdChar = StdVnToUpper(stdChar);
+    if (m_removeTone)
+        stdChar = StdVnGetRoot(stdChar);
+
+    EntryBOStream os(entry);
+    outcs.putChar(os, stdChar, bytesWritten);
+    if (os.m_words)
+        m_outUnit = 2;
+    if (os.m_out > MAX_TRANSCODE_OUT || (os.m_words && os.m_bytes))
+        m_ok = 0;
+    else
+        entry.len = (UKBYTE)os.m_out;
+    return bytesRead;
+}
+
+//-----------------------------------------
+// Same contract as genConvert on a StringBIStream/StringBOStream pair:
+// outLen is the output buffer size on input, and the number of bytes
+// needed on return.
+//-----------------------------------------
+int VnTranscodeTable::convert(UKBYTE *input, int inLen, UKBYTE *output,
+                              int &outLen) {
+    const VnTranscodeEntry *entry;
+    int maxOutLen = outLen;
+    int out = 0;
+    int bad = 0; // like StringBOStream, stop writing after the first overflow
+    int i, k, runLen;
+
+    // as with StringBIStream, the terminator is converted too, unless the
+    // string is empty
+    if (inLen == -1)
+        inLen = (*input) ? strlen((const char *)input) + 1 : 0;
+
+    i = 0;
+    while (i < inLen) {
+        UKBYTE b = input[i];
+        // single bytes go through the table, only longer runs are scanned
+        if (m_runFloor >= 0 && b >= m_runFloor && b < 0x80 && i + 2 < inLen &&
+            input[i + 1] >= m_runFloor && input[i + 1] < 0x80) {
+            runLen = VnAsciiRunLength(input + i, inLen - i, m_runFloor);
+            // the last byte may combine with the one that stopped the run
+            if (m_runLead && i + runLen < inLen)
+                runLen--;
+            if (runLen > 0) {
+                if (!bad) {
+                    k = (maxOutLen - out < runLen) ? maxOutLen - out : runLen;
+                    memcpy(output + out, input + i, k);
+                    bad = (k < runLen);
+                }
+                out += runLen;
+                i += runLen;
+                continue;
+            }
+        }
+
+        entry = &m_single[b];
+        i++;
+        if (m_pairIndex[b] && i < inLen && input[i]) {
+            const VnTranscodeEntry *pair =
+                &m_pairs[(m_pairIndex[b] - 1) * 256 + input[i]];
+            if (pair->len != 0xFF) {
+                entry = pair;
+                i++;
+            }
+        }
+        if (!bad && out + entry->len <= maxOutLen) {
+            // most entries are a single byte, avoid the memcpy call for them
+            if (entry->len == 1)
+                output[out] = entry->out[0];
+            else
+                memcpy(output + out, entry->out, entry->len);
+            out += entry->len;
+            continue;
+        }
+        // 16-bit charsets write whole words
+        for (k = 0; k < entry->len; k += m_outUnit, out += m_outUnit) {
+            if (!bad && out + m_outUnit <= maxOutLen)
+                memcpy(output + out, entry->out + k, m_outUnit);
+            else
+                bad = 1;
+        }
+    }
+    outLen = out;
+    return (out <= maxOutLen) ? 0 : VNCONV_OUT_OF_MEMORY;
 }
 
 //-----------------------------------------
@@ -972,7 +1819,9 @@ CVnCharsetLib::CVnCharsetLib() {
     m_pVIQRCharObj = NULL;
     m_pUVIQRCharObj = NULL;
     m_pWinCP1258 = NULL;
+    m_pUniCString = NULL;
     m_pVnIntCharset = NULL;
+    m_transcodeTables = NULL;
 
     int i;
     for (i = 0; i < CONV_TOTAL_SINGLE_CHARSETS; i++)
@@ -982,14 +1831,15 @@ CVnCharsetLib::CVnCharsetLib() {
         m_dbCharsets[i] = NULL;
 
     VnConvResetOptions(&m_options);
-    m_VIQREscPatterns.init((char **)VIQREscapes, VIQREscCount);
-    m_VIQROutEscPatterns.init((char **)VIQREscapes, VIQREscCount);
+    m_VIQREscPatterns.init(VIQREscapes, VIQREscCount);
 }
 
 //-----------------------------------------
 CVnCharsetLib::~CVnCharsetLib() {
     if (m_pUniCharset)
         delete m_pUniCharset;
+    if (m_pUniCompCharset)
+        delete m_pUniCompCharset;
     if (m_pUniUTF8)
         delete m_pUniUTF8;
     if (m_pUniRef)
@@ -1007,6 +1857,12 @@ CVnCharsetLib::~CVnCharsetLib() {
     if (m_pVnIntCharset)
         delete m_pVnIntCharset;
 
+    while (m_transcodeTables) {
+        VnTranscodeTable *next = m_transcodeTables->m_next;
+        delete m_transcodeTables;
+        m_transcodeTables = next;
+    }
+
     int i;
     for (i = 0; i < CONV_TOTAL_SINGLE_CHARSETS; i++)
         if (m_sgCharsets[i])
@@ -1058,7 +1914,7 @@ VnCharset *CVnCharsetLib::getVnCharset(int charsetIdx) {
 
     case CONV_CHARSET_VIQR:
         if (m_pVIQRCharObj == NULL)
-            m_pVIQRCharObj = new VIQRCharset(VIQRTable);
+            m_pVIQRCharObj = new VIQRCharset(VIQRTable, this);
         return m_pVIQRCharObj;
 
     case CONV_CHARSET_VNSTANDARD:
@@ -1069,7 +1925,7 @@ VnCharset *CVnCharsetLib::getVnCharset(int charsetIdx) {
     case CONV_CHARSET_UTF8VIQR:
         if (m_pUVIQRCharObj == NULL) {
             if (m_pVIQRCharObj == NULL)
-                m_pVIQRCharObj = new VIQRCharset(VIQRTable);
+                m_pVIQRCharObj = new VIQRCharset(VIQRTable, this);
 
             if (m_pUniUTF8 == NULL)
                 m_pUniUTF8 = new UnicodeUTF8Charset(UnicodeTable);
@@ -1093,6 +1949,35 @@ VnCharset *CVnCharsetLib::getVnCharset(int charsetIdx) {
     return NULL;
 }
 
+//-----------------------------------------
+// Returns the transcoding table for the given charsets and the current
+// options, building it on first use. NULL if the pair can't be tabulated.
+//-----------------------------------------
+VnTranscodeTable *CVnCharsetLib::getTranscodeTable(int inCharset,
+                                                   int outCharset) {
+    VnTranscodeTable *table;
+    for (table = m_transcodeTables; table; table = table->m_next) {
+        if (table->m_inCharset == inCharset &&
+            table->m_outCharset == outCharset &&
+            table->m_toUpper == m_options.toUpper &&
+            table->m_toLower == m_options.toLower &&
+            table->m_removeTone == m_options.removeTone)
+            return table->isOK() ? table : NULL;
+    }
+
+    VnCharset *pInCharset = getVnCharset(inCharset);
+    VnCharset *pOutCharset = getVnCharset(outCharset);
+    if (!pInCharset || !pOutCharset || !pInCharset->byteInput() ||
+        !pOutCharset->statelessOutput())
+        return NULL;
+
+    table = new VnTranscodeTable(inCharset, *pInCharset, outCharset,
+                                 *pOutCharset, m_options);
+    table->m_next = m_transcodeTables;
+    m_transcodeTables = table;
+    return table->isOK() ? table : NULL;
+}
+
 //-------------------------------------------------
 DllExport void VnConvSetOptions(VnConvOptions *pOptions) {
     VnCharsetLibObj.m_options = *pOptions;
@@ -1103,6 +1988,11 @@ DllExport void VnConvGetOptions(VnConvOptions *pOptions) {
     *pOptions = VnCharsetLibObj.m_options;
 }
 
+//-------------------------------------------------
+DllExport int VnConvAddViqrEscape(const char *pattern) {
+    return VnCharsetLibObj.m_VIQREscPatterns.addPattern(pattern);
+}
+
 //-------------------------------------------------
 DllExport void VnConvResetOptions(VnConvOptions *pOptions) {
     pOptions->viqrEsc = 1;
@@ -1150,6 +2040,11 @@ WinCP1258Charset::WinCP1258Charset(UKWORD *compositeChars,
         }
 
     qsort(m_vnChars, m_totalChars, sizeof(UKDWORD), wideCharCompare);
+
+    // plain vowels may be followed by a combining tone byte
+    m_asciiInFloor = probeAsciiFloor(1);
+    m_asciiOutFloor = probeAsciiFloor(0);
+    m_asciiLead = 1;
 }
 
 //---------------------------------------------------------------------
@@ -1158,6 +2053,13 @@ WinCP1258Charset::WinCP1258Charset(UKWORD *compositeChars,
 //---------------------------------------------------------------------
 int WinCP1258Charset::nextInput(ByteInStream &is, StdVnChar &stdChar,
                                 int &bytesRead) {
+    return decodeChar(is, stdChar, bytesRead);
+}
+
+//-------------------------------------------
+template <class InStream>
+int WinCP1258Charset::decodeChar(InStream &is, StdVnChar &stdChar,
+                                 int &bytesRead) {
     unsigned char ch;
 
     // read first byte
@@ -1194,6 +2096,13 @@ int WinCP1258Charset::nextInput(ByteInStream &is, StdVnChar &stdChar,
 //---------------------------------------------------------------------
 int WinCP1258Charset::putChar(ByteOutStream &os, StdVnChar stdChar,
                               int &outLen) {
+    return encodeChar(os, stdChar, outLen);
+}
+
+//-------------------------------------------
+template <class OutStream>
+int WinCP1258Charset::encodeChar(OutStream &os, StdVnChar stdChar,
+                                 int &outLen) {
     int ret;
     if (stdChar >= VnStdCharOffset) {
         UKWORD wCh = m_toDoubleChar[stdChar - VnStdCharOffset];
@@ -26,6 +26,9 @@
 #include "byteio.h"
 #include "pattern.h"
 #include "vnconv.h"
+#include <string>
+#include <string_view>
+#include <vector>
 
 #define TOTAL_VNCHARS 213
 #define TOTAL_ALPHA_VNCHARS 186
@@ -68,8 +71,29 @@ const unsigned char PadStartQuote = '\"';
 const unsigned char PadEndQuote = '\"';
 const unsigned char PadEllipsis = '.';
 
+class CVnCharsetLib;
+
 class DllInterface VnCharset {
+protected:
+    //------------------------------------------------------------------------
+    // Bytes in [m_asciiInFloor, 0x80) are read by nextInput(), and bytes in
+    // [m_asciiOutFloor, 0x80) are written by putChar(), as themselves: one
+    // byte per character, without touching the charset state. Runs of such
+    // bytes can be copied in bulk. -1 if the charset has no such run.
+    // m_asciiLead is set if the last byte of a run may still combine with
+    // the byte following the run.
+    //------------------------------------------------------------------------
+    int m_asciiInFloor;
+    int m_asciiOutFloor;
+    int m_asciiLead;
+    int probeAsciiFloor(int input);
+
 public:
+    VnCharset() : m_asciiInFloor(-1), m_asciiOutFloor(-1), m_asciiLead(0) {}
+    int asciiInputFloor() { return m_asciiInFloor; }
+    int asciiOutputFloor() { return m_asciiOutFloor; }
+    int asciiLead() { return m_asciiLead; }
+
     virtual void startInput() {}
     virtual void startOutput() {}
     //	virtual UKBYTE *nextInput(UKBYTE *input, int inLen, StdVnChar & stdChar,
@@ -88,6 +112,15 @@ public:
     //------------------------------------------------------------------------
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen) = 0;
     virtual int elementSize();
+
+    //------------------------------------------------------------------------
+    // Whether conversions can be precomputed into a VnTranscodeTable:
+    // byteInput() is 1 if every input byte is a character on its own, 2 if a
+    // byte may also combine with the next byte, 0 otherwise.
+    // statelessOutput() is 1 if putChar() depends on the character only.
+    //------------------------------------------------------------------------
+    virtual int byteInput() { return 0; }
+    virtual int statelessOutput() { return 0; }
     virtual ~VnCharset() {}
 };
 
@@ -100,7 +133,13 @@ protected:
 public:
     SingleByteCharset(unsigned char *vnChars);
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
+    virtual int byteInput() { return 1; }
+    virtual int statelessOutput() { return 1; }
 };
 
 //--------------------------------------------------
@@ -108,8 +147,13 @@ class VnInternalCharset : public VnCharset {
 public:
     VnInternalCharset() {}
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
     virtual int elementSize();
+    virtual int statelessOutput() { return 1; }
 };
 
 //--------------------------------------------------
@@ -121,8 +165,13 @@ protected:
 public:
     UnicodeCharset(UnicodeChar *vnChars);
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
     virtual int elementSize();
+    virtual int statelessOutput() { return 1; }
 };
 
 //--------------------------------------------------
@@ -135,32 +184,48 @@ protected:
 public:
     DoubleByteCharset(UKWORD *vnChars);
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
+    virtual int byteInput() { return 2; }
+    virtual int statelessOutput() { return 1; }
 };
 
 //--------------------------------------------------
 class UnicodeUTF8Charset : public UnicodeCharset {
 public:
-    UnicodeUTF8Charset(UnicodeChar *vnChars) : UnicodeCharset(vnChars) {}
+    UnicodeUTF8Charset(UnicodeChar *vnChars);
 
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
 };
 
 //--------------------------------------------------
 class UnicodeRefCharset : public UnicodeCharset {
 public:
-    UnicodeRefCharset(UnicodeChar *vnChars) : UnicodeCharset(vnChars) {}
+    UnicodeRefCharset(UnicodeChar *vnChars);
 
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
 };
 
 //--------------------------------------------------
 class UnicodeHexCharset : public UnicodeRefCharset {
 public:
-    UnicodeHexCharset(UnicodeChar *vnChars) : UnicodeRefCharset(vnChars) {}
+    UnicodeHexCharset(UnicodeChar *vnChars);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
 };
 
 //--------------------------------------------------
@@ -171,7 +236,11 @@ protected:
 public:
     UnicodeCStringCharset(UnicodeChar *vnChars) : UnicodeCharset(vnChars) {}
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
     virtual void startInput();
 };
 
@@ -186,7 +255,13 @@ protected:
 public:
     WinCP1258Charset(UKWORD *compositeChars, UKWORD *precomposedChars);
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
+    virtual int byteInput() { return 2; }
+    virtual int statelessOutput() { return 1; }
 };
 
 //--------------------------------------------------
@@ -204,8 +279,25 @@ protected:
 public:
     UnicodeCompCharset(UnicodeChar *uniChars, UKDWORD *uniCompChars);
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
     virtual int elementSize();
+    virtual int statelessOutput() { return 1; }
+};
+
+//--------------------------------------------------
+// Transition of the VIQR decoding automaton, see VIQRCharset::buildDecoder()
+#define VIQR_DFA_CHAR 0x0FFF   // completed character, index in vnChars + 1
+#define VIQR_DFA_AGAIN 0x1000  // the byte also starts the next character
+#define VIQR_DFA_LETTER 0x2000 // the byte is a letter that takes no marks
+#define VIQR_DFA_BYTE 0x4000   // the byte is a character as it is
+
+struct VIQRTransition {
+    UKWORD next; // next state
+    UKWORD out;  // VIQR_DFA_ flags
 };
 
 //--------------------------------------------------
@@ -221,14 +313,33 @@ protected:
     int m_gotTone;
     int m_escAll;
     int m_noOutEsc;
+    int m_escState;       // matching state of the escape patterns
+    int m_outEscState;    // same for the output
+    CVnCharsetLib *m_lib; // options and escape patterns
+
+    // decoding automaton
+    UKBYTE m_byteClass[256];
+    int m_classes;
+    int m_dfaStarts;  // states [0, m_dfaStarts) are between characters
+    int m_dfaInit[2]; // start state without and with smartViqr
+    int m_dfaState;
+    std::vector<VIQRTransition> m_dfa;
+    std::vector<UKWORD> m_dfaEscAll; // same state after an escape pattern
+    std::vector<StdVnChar> m_dfaEnd; // pending character at end of input
+    void buildDecoder();
 
 public:
     int m_suspicious;
-    VIQRCharset(UKDWORD *vnChars);
+    VIQRCharset(UKDWORD *vnChars, CVnCharsetLib *lib);
     virtual void startInput();
     virtual void startOutput();
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
+    int decodeSpan(SpanBIStream &is, StdVnChar *chars, int &count);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
 };
 
 //--------------------------------------------------
@@ -243,7 +354,64 @@ public:
     virtual void startInput();
     virtual void startOutput();
     virtual int nextInput(ByteInStream &is, StdVnChar &stdChar, int &bytesRead);
+    template <class InStream>
+    int decodeChar(InStream &is, StdVnChar &stdChar, int &bytesRead);
     virtual int putChar(ByteOutStream &os, StdVnChar stdChar, int &outLen);
+    template <class OutStream>
+    int encodeChar(OutStream &os, StdVnChar stdChar, int &outLen);
+};
+
+//--------------------------------------------------
+// Buffer-to-buffer codecs, bound to the concrete charset class at compile
+// time. Characters are decoded and encoded VN_SPAN_CHUNK at a time, so the
+// only indirect calls left are one per chunk.
+//--------------------------------------------------
+#define VN_SPAN_CHUNK 256
+
+typedef int (*VnSpanDecoder)(VnCharset &cs, SpanBIStream &is,
+                             StdVnChar *chars, int &count, int runFloor);
+typedef int (*VnSpanEncoder)(VnCharset &cs, SpanBOStream &os,
+                             const StdVnChar *chars, int count, int ret);
+
+//--------------------------------------------------
+// Direct translation from input bytes to output bytes for a pair of
+// charsets, with the case and tone options folded in.
+// Built for a byteInput() charset and a statelessOutput() charset.
+//--------------------------------------------------
+#define MAX_TRANSCODE_OUT 8
+
+struct VnTranscodeEntry {
+    UKBYTE len; // 0: invalid input, nothing is written
+    UKBYTE out[MAX_TRANSCODE_OUT];
+};
+
+class VnTranscodeTable {
+protected:
+    VnTranscodeEntry m_single[256];
+    // second level, for bytes that may start a double-byte character.
+    // m_pairIndex[b] is 0 if b never does, otherwise the pairs starting
+    // with b are at m_pairs[(m_pairIndex[b] - 1) * 256 + secondByte], where
+    // len = 0xFF marks a byte that does not combine with b
+    UKBYTE m_pairIndex[256];
+    VnTranscodeEntry *m_pairs;
+    int m_runFloor; // bytes in [m_runFloor, 0x80) are copied unchanged
+    int m_runLead;  // some of those bytes start a double-byte character
+    int m_outUnit;  // output is written in units of this many bytes
+    int m_ok;
+
+    int buildEntry(VnCharset &incs, VnCharset &outcs, UKBYTE *input, int len,
+                   VnTranscodeEntry &entry);
+
+public:
+    int m_inCharset, m_outCharset;
+    int m_toUpper, m_toLower, m_removeTone;
+    VnTranscodeTable *m_next;
+
+    VnTranscodeTable(int inCharset, VnCharset &incs, int outCharset,
+                     VnCharset &outcs, const VnConvOptions &options);
+    ~VnTranscodeTable();
+    int isOK() { return m_ok; }
+    int convert(UKBYTE *input, int inLen, UKBYTE *output, int &outLen);
 };
 
 //--------------------------------------------------
@@ -261,13 +429,47 @@ protected:
     WinCP1258Charset *m_pWinCP1258;
     UnicodeCStringCharset *m_pUniCString;
     VnInternalCharset *m_pVnIntCharset;
+    VnTranscodeTable *m_transcodeTables;
 
 public:
-    PatternList m_VIQREscPatterns, m_VIQROutEscPatterns;
+    PatternList m_VIQREscPatterns;
     VnConvOptions m_options;
     CVnCharsetLib();
     ~CVnCharsetLib();
     VnCharset *getVnCharset(int charsetIdx);
+    VnTranscodeTable *getTranscodeTable(int inCharset, int outCharset);
+    int convert(int inCharset, int outCharset, UKBYTE *input, UKBYTE *output,
+                int *pInLen, int *pMaxOutLen);
+};
+
+//--------------------------------------------------
+// Converts input that comes in pieces, such as from a pipe or a socket,
+// with the options set when it is created. A character split between two
+// pieces is completed with the next one, so the output of all the calls
+// together is the same as that of VnConvert() on the whole input.
+//--------------------------------------------------
+#define VN_STREAM_HOLD 16     // longest character read, with lookahead
+#define VN_STREAM_SLICE 65536 // input converted at a time
+#define VN_STREAM_MAX_OUT 8   // longest character written
+
+class DllInterface VnStreamConverter {
+protected:
+    CVnCharsetLib m_lib; // charsets keep their state between pieces
+    VnCharset *m_inCharset, *m_outCharset;
+    VnSpanDecoder m_decoder;
+    VnSpanEncoder m_encoder;
+    std::vector<UKBYTE> m_pending; // input not converted yet
+    int m_unit;                    // size in bytes of an input unit
+    int convert(std::string &output, int final);
+
+public:
+    VnStreamConverter(int inCharset, int outCharset);
+    int isOK() { return m_inCharset && m_outCharset; }
+    // Appends to output what can be converted so far.
+    // Returns 0 if successful
+    int feed(const UKBYTE *data, int len, std::string &output);
+    // Converts what is left at the end of input
+    int finish(std::string &output);
 };
 
 extern unsigned char SingleByteTables[][TOTAL_VNCHARS];
@@ -285,6 +487,21 @@ extern int StdVnRootChar[TOTAL_VNCHARS];
 
 DllInterface int genConvert(VnCharset &incs, VnCharset &outcs,
                             ByteInStream &input, ByteOutStream &output);
+DllInterface int spanConvert(VnCharset &incs, VnSpanDecoder decoder,
+                             VnCharset &outcs, VnSpanEncoder encoder,
+                             SpanBIStream &input, SpanBOStream &output,
+                             const VnConvOptions &options);
+DllInterface int spanConvertNext(VnCharset &incs, VnSpanDecoder decoder,
+                                 VnCharset &outcs, VnSpanEncoder encoder,
+                                 SpanBIStream &input, SpanBOStream &output,
+                                 const VnConvOptions &options);
+DllInterface VnSpanDecoder VnGetSpanDecoder(int charsetIdx);
+DllInterface VnSpanEncoder VnGetSpanEncoder(int charsetIdx);
+
+// VnNormalizeUtf8() on a string
+std::string VnNormalizeUtf8String(std::string_view text, int form);
+// The Vietnamese letter a precomposed character is, as a VnLexiName, or -1
+int VnLetterOfUnicode(unsigned int ch);
 
 StdVnChar StdVnToUpper(StdVnChar ch);
 StdVnChar StdVnToLower(StdVnChar ch);
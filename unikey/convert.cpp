@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: GPL-2.0-or-later
  */
 
+#include "asciirun.h"
 #include "charset.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +14,22 @@
 #if defined(_WIN32)
 #include <fcntl.h>
 #include <io.h>
+#else
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define VN_FILE_READ_SIZE (1 << 20)
+#define VN_FILE_CHUNK_SIZE (1 << 20) // smallest piece converted in parallel
+#define VN_FILE_MAX_CHUNK (1 << 23)  // largest piece converted in memory
 #endif
 
 #include "vnconv.h"
@@ -22,12 +40,34 @@ DllExport int genConvert(VnCharset &incs, VnCharset &outcs, ByteInStream &input,
                          ByteOutStream &output) {
     StdVnChar stdChar;
     int bytesRead, bytesWritten;
+    const UKBYTE *run;
+    int runAvail, runLen;
 
     incs.startInput();
     outcs.startOutput();
 
+    // bytes in [runFloor, 0x80) go through both charsets unchanged.
+    // Plain letters are affected by the case options only
+    int runFloor = incs.asciiInputFloor();
+    if (outcs.asciiOutputFloor() < 0 || VnCharsetLibObj.m_options.toLower ||
+        VnCharsetLibObj.m_options.toUpper)
+        runFloor = -1;
+    else if (runFloor >= 0 && runFloor < outcs.asciiOutputFloor())
+        runFloor = outcs.asciiOutputFloor();
+
     int ret = 1;
     while (!input.eos()) {
+        if (runFloor >= 0 && (runAvail = input.peekRun(run)) > 0) {
+            runLen = VnAsciiRunLength(run, runAvail, runFloor);
+            if (runLen < runAvail && incs.asciiLead())
+                runLen--;
+            if (runLen > 0) {
+                ret = output.puts((const char *)run, runLen);
+                input.skip(runLen);
+                continue;
+            }
+        }
+
         stdChar = 0;
         if (incs.nextInput(input, stdChar, bytesRead)) {
             if (stdChar != INVALID_STD_CHAR) {
@@ -45,6 +85,71 @@ DllExport int genConvert(VnCharset &incs, VnCharset &outcs, ByteInStream &input,
     return (ret ? 0 : VNCONV_OUT_OF_MEMORY);
 }
 
+//----------------------------------------------
+// Same as genConvert, for buffers. The decoder and encoder must be the
+// span codecs of incs and outcs.
+//----------------------------------------------
+DllExport int spanConvert(VnCharset &incs, VnSpanDecoder decoder,
+                          VnCharset &outcs, VnSpanEncoder encoder,
+                          SpanBIStream &input, SpanBOStream &output,
+                          const VnConvOptions &options) {
+    incs.startInput();
+    outcs.startOutput();
+    return spanConvertNext(incs, decoder, outcs, encoder, input, output,
+                           options);
+}
+
+//----------------------------------------------
+// spanConvert without resetting the charsets, to go on from where an
+// earlier call stopped. Stops before the bytes held back by input
+//----------------------------------------------
+DllExport int spanConvertNext(VnCharset &incs, VnSpanDecoder decoder,
+                              VnCharset &outcs, VnSpanEncoder encoder,
+                              SpanBIStream &input, SpanBOStream &output,
+                              const VnConvOptions &options) {
+    StdVnChar chars[VN_SPAN_CHUNK];
+    int count, i;
+    const UKBYTE *run;
+    int runAvail, runLen;
+
+    int runFloor = incs.asciiInputFloor();
+    if (outcs.asciiOutputFloor() < 0 || options.toLower || options.toUpper)
+        runFloor = -1;
+    else if (runFloor >= 0 && runFloor < outcs.asciiOutputFloor())
+        runFloor = outcs.asciiOutputFloor();
+
+    int ret = 1;
+    while (!input.eos() && !input.held()) {
+        if (runFloor >= 0 && (runAvail = input.peekRun(run)) > 0) {
+            runLen = VnAsciiRunLength(run, runAvail, runFloor);
+            // the byte after the run may be held back
+            if ((runLen < runAvail || input.holding()) && incs.asciiLead())
+                runLen--;
+            if (runLen > 0) {
+                ret = output.puts((const char *)run, runLen);
+                input.skip(runLen);
+                continue;
+            }
+        }
+
+        int more = decoder(incs, input, chars, count, runFloor);
+        if (options.toLower || options.toUpper || options.removeTone) {
+            for (i = 0; i < count; i++) {
+                if (options.toLower)
+                    chars[i] = StdVnToLower(chars[i]);
+                else if (options.toUpper)
+                    chars[i] = StdVnToUpper(chars[i]);
+                if (options.removeTone)
+                    chars[i] = StdVnGetRoot(chars[i]);
+            }
+        }
+        ret = encoder(outcs, output, chars, count, ret);
+        if (!more)
+            break;
+    }
+    return (ret ? 0 : VNCONV_OUT_OF_MEMORY);
+}
+
 //----------------------------------------------
 // Arguments:
 //       inCharset: charset of input
@@ -67,6 +172,15 @@ DllExport int genConvert(VnCharset &incs, VnCharset &outcs, ByteInStream &input,
 
 DllExport int VnConvert(int inCharset, int outCharset, UKBYTE *input,
                         UKBYTE *output, int *pInLen, int *pMaxOutLen) {
+    return VnCharsetLibObj.convert(inCharset, outCharset, input, output,
+                                   pInLen, pMaxOutLen);
+}
+
+//----------------------------------------------
+// VnConvert with the charsets and options of this library object
+//----------------------------------------------
+int CVnCharsetLib::convert(int inCharset, int outCharset, UKBYTE *input,
+                           UKBYTE *output, int *pInLen, int *pMaxOutLen) {
     int inLen, maxOutLen;
     int ret = -1;
 
@@ -76,21 +190,634 @@ DllExport int VnConvert(int inCharset, int outCharset, UKBYTE *input,
     if (inLen != -1 && inLen < 0) // invalid inLen
         return ret;
 
-    VnCharset *pInCharset = VnCharsetLibObj.getVnCharset(inCharset);
-    VnCharset *pOutCharset = VnCharsetLibObj.getVnCharset(outCharset);
+    VnTranscodeTable *pTable = getTranscodeTable(inCharset, outCharset);
+    if (pTable) {
+        ret = pTable->convert(input, inLen, output, *pMaxOutLen);
+        if (inLen != -1)
+            *pInLen = 0;
+        return ret;
+    }
+
+    VnCharset *pInCharset = getVnCharset(inCharset);
+    VnCharset *pOutCharset = getVnCharset(outCharset);
 
     if (!pInCharset || !pOutCharset)
         return VNCONV_INVALID_CHARSET;
 
-    StringBIStream is(input, inLen, pInCharset->elementSize());
-    StringBOStream os(output, maxOutLen);
+    SpanBIStream is(input, inLen, pInCharset->elementSize());
+    SpanBOStream os(output, maxOutLen);
 
-    ret = genConvert(*pInCharset, *pOutCharset, is, os);
+    ret = spanConvert(*pInCharset, VnGetSpanDecoder(inCharset), *pOutCharset,
+                      VnGetSpanEncoder(outCharset), is, os, m_options);
     *pMaxOutLen = os.getOutBytes();
     *pInLen = is.left();
     return ret;
 }
 
+//---------------------------------------
+// Size in bytes of an input unit of the charset
+//---------------------------------------
+static int vnInputUnit(int charset) {
+    switch (charset) {
+    case CONV_CHARSET_UNICODE:
+    case CONV_CHARSET_UNIDECOMPOSED:
+        return 2;
+    case CONV_CHARSET_VNSTANDARD:
+        return 4;
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////
+// Class: VnStreamConverter                //
+/////////////////////////////////////////////
+
+//----------------------------------------------
+VnStreamConverter::VnStreamConverter(int inCharset, int outCharset) {
+    m_lib.m_options = VnCharsetLibObj.m_options;
+    m_lib.m_VIQREscPatterns = VnCharsetLibObj.m_VIQREscPatterns;
+    m_inCharset = m_lib.getVnCharset(inCharset);
+    m_outCharset = m_lib.getVnCharset(outCharset);
+    m_decoder = VnGetSpanDecoder(inCharset);
+    m_encoder = VnGetSpanEncoder(outCharset);
+    m_unit = vnInputUnit(inCharset);
+    if (isOK()) {
+        m_inCharset->startInput();
+        m_outCharset->startOutput();
+    }
+}
+
+//----------------------------------------------
+// Converts the pending input, but for its last VN_STREAM_HOLD bytes unless
+// this is the end of input. Characters that start before those bytes are
+// read whole, as no character is longer. The input is converted a slice at
+// a time, to bound the output buffer
+//----------------------------------------------
+int VnStreamConverter::convert(std::string &output, int final) {
+    // a truncated last unit is dropped rather than read past
+    int keep = final ? m_pending.size() % m_unit : VN_STREAM_HOLD;
+    int ret = 0;
+    int left, hold;
+    SpanBIStream is(m_pending.data(), m_pending.size(),
+                    m_inCharset->elementSize());
+
+    while (!is.eos()) {
+        left = is.left();
+        hold = left - VN_STREAM_SLICE;
+        if (hold < keep)
+            hold = keep;
+        if (left <= hold)
+            break;
+        is.hold(hold);
+
+        size_t done = output.size();
+        size_t room =
+            (size_t)(left - hold + VN_STREAM_HOLD) * VN_STREAM_MAX_OUT;
+        output.resize(done + room);
+        SpanBOStream os((UKBYTE *)&output[done], room);
+        if (spanConvertNext(*m_inCharset, m_decoder, *m_outCharset, m_encoder,
+                            is, os, m_lib.m_options) != 0 ||
+            (size_t)os.getOutBytes() > room) {
+            output.resize(done);
+            ret = VNCONV_OUT_OF_MEMORY;
+            break;
+        }
+        output.resize(done + os.getOutBytes());
+    }
+
+    left = is.eos() ? 0 : is.left();
+    m_pending.erase(m_pending.begin(), m_pending.end() - left);
+    return ret;
+}
+
+//----------------------------------------------
+// Returns 0 if successful
+//----------------------------------------------
+int VnStreamConverter::feed(const UKBYTE *data, int len, std::string &output) {
+    if (!isOK())
+        return VNCONV_INVALID_CHARSET;
+    if (len < 0)
+        return -1;
+    if (m_pending.size() > (size_t)(INT_MAX - len))
+        return VNCONV_OUT_OF_MEMORY;
+    m_pending.insert(m_pending.end(), data, data + len);
+    return convert(output, 0);
+}
+
+//----------------------------------------------
+// The converter can then be used for another stream.
+// Returns 0 if successful
+//----------------------------------------------
+int VnStreamConverter::finish(std::string &output) {
+    if (!isOK())
+        return VNCONV_INVALID_CHARSET;
+    int ret = convert(output, 1);
+    m_pending.clear();
+    m_inCharset->startInput();
+    m_outCharset->startOutput();
+    return ret;
+}
+
+#if !defined(_WIN32)
+//---------------------------------------
+// Maps the whole input if it is a regular file.
+// Returns 0 if it can't be mapped (pipes, terminals, empty files), the
+// input is then read as a stream
+//---------------------------------------
+static int vnMapInput(int fd, UKBYTE *&data, size_t &len) {
+    struct stat st;
+
+    data = NULL;
+    len = 0;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return 0;
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return 0;
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    data = (UKBYTE *)p;
+    len = st.st_size;
+    return 1;
+}
+
+//---------------------------------------
+// Returns 0 on write error
+//---------------------------------------
+static int vnWriteOutput(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 1;
+}
+
+//---------------------------------------
+// Feeds data to conv, or finishes it if data is NULL, and writes what comes
+// out but for its first skip bytes. Nothing is written if outFd is -1, the
+// bytes are only counted in outBytes.
+// Returns 0 if successful
+//---------------------------------------
+static int vnStreamWrite(VnStreamConverter &conv, const UKBYTE *data, int len,
+                         size_t &skip, int outFd, size_t &outBytes,
+                         std::string &buf) {
+    buf.clear();
+    int ret = data ? conv.feed(data, len, buf) : conv.finish(buf);
+    if (ret != 0)
+        return ret;
+    size_t drop = (skip < buf.size()) ? skip : buf.size();
+    skip -= drop;
+    outBytes += buf.size() - drop;
+    struct iovec iov = {&buf[drop], buf.size() - drop};
+    if (outFd != -1 && iov.iov_len > 0 && !vnWriteOutput(outFd, &iov, 1))
+        return VNCONV_ERR_WRITING;
+    return 0;
+}
+
+//---------------------------------------
+// Converts input[from, to) a slice at a time and writes the output as it
+// comes, but for its first skip bytes. For pieces too large to convert in
+// memory. See vnStreamWrite for outFd and outBytes.
+// Returns 0 if successful
+//---------------------------------------
+static int vnStreamRange(int inCharset, int outCharset, const UKBYTE *input,
+                         size_t from, size_t to, size_t skip, int outFd,
+                         size_t &outBytes) {
+    VnStreamConverter conv(inCharset, outCharset);
+    std::string buf;
+    int ret = 0;
+
+    outBytes = 0;
+    while (from < to && ret == 0) {
+        size_t len = (to - from < VN_FILE_READ_SIZE) ? to - from
+                                                     : VN_FILE_READ_SIZE;
+        ret = vnStreamWrite(conv, input + from, len, skip, outFd, outBytes,
+                            buf);
+        from += len;
+    }
+    if (ret == 0)
+        ret = vnStreamWrite(conv, NULL, 0, skip, outFd, outBytes, buf);
+    return ret;
+}
+
+//---------------------------------------
+// Converts what is read from inFd up to its end, writing the output as it
+// comes. For input that can't be mapped.
+// Returns 0 if successful
+//---------------------------------------
+static int vnStreamInput(int inCharset, int outCharset, int inFd, int outFd) {
+    VnStreamConverter conv(inCharset, outCharset);
+    std::vector<UKBYTE> data(VN_FILE_READ_SIZE);
+    std::string buf;
+    size_t skip = 0, outBytes = 0;
+    ssize_t n;
+
+    for (;;) {
+        n = read(inFd, data.data(), data.size());
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return VNCONV_ERR_INPUT_FILE;
+        }
+        int ret = vnStreamWrite(conv, data.data(), n, skip, outFd, outBytes,
+                                buf);
+        if (ret != 0)
+            return ret;
+    }
+    return vnStreamWrite(conv, NULL, 0, skip, outFd, outBytes, buf);
+}
+
+//---------------------------------------
+// Converts input with the given library object into a newly allocated
+// output buffer, growing it to the exact size needed if the first guess
+// was too small.
+// Returns 0 if successful
+//---------------------------------------
+static int vnConvertAlloc(CVnCharsetLib &lib, int inCharset, int outCharset,
+                          UKBYTE *input, size_t inSize, UKBYTE *&output,
+                          int &outLen) {
+    int ret = 0;
+
+    output = NULL;
+    if (inSize > INT_MAX)
+        return VNCONV_OUT_OF_MEMORY;
+    size_t guess = inSize + inSize / 2 + 64;
+    outLen = (guess > INT_MAX) ? INT_MAX : (int)guess;
+    for (;;) {
+        UKBYTE *p = (UKBYTE *)realloc(output, outLen);
+        if (p == NULL)
+            return VNCONV_OUT_OF_MEMORY;
+        output = p;
+        if (inSize == 0) {
+            outLen = 0;
+            return 0;
+        }
+        int maxOutLen = outLen;
+        int inLen = inSize;
+        ret = lib.convert(inCharset, outCharset, input, output, &inLen,
+                          &outLen);
+        if (ret != VNCONV_OUT_OF_MEMORY || outLen <= maxOutLen)
+            return ret;
+        if (outLen < 0) // more than INT_MAX bytes
+            return ret;
+    }
+}
+
+//---------------------------------------
+// Bytes that may combine with a preceding vowel in VIQR
+//---------------------------------------
+static int vnIsViqrMark(UKBYTE b) {
+    return b == '\'' || b == '`' || b == '~' || b == '^' || b == '(' ||
+           b == '+' || b == '*' || b == '\\' || b == 0;
+}
+
+//---------------------------------------
+// Finds the first point at or after pos where the input can be cut: right
+// after a line feed. There every decoder and encoder is back in its initial
+// state, so the pieces on each side can be converted independently.
+// sync is set to the cut, except for UTF8VIQR, where a multi-byte UTF-8
+// character leaves the VIQR that follows it marked as suspicious, even past
+// a line feed. There a cut is only taken after a line whose last such
+// character is followed by plain text only, and sync is set to the start
+// of that character: converting from sync brings the decoder to the same
+// state as at the cut.
+// Returns len if there is no cut point.
+//---------------------------------------
+static size_t vnFindCut(int inCharset, const UKBYTE *data, size_t len,
+                        size_t pos, size_t &sync) {
+    int unit = vnInputUnit(inCharset);
+    int viqr = (inCharset == CONV_CHARSET_VIQR ||
+                inCharset == CONV_CHARSET_UTF8VIQR);
+    size_t i, k, lower;
+
+    if (unit > 1) {
+        for (i = (pos + unit - 1) / unit * unit; i + unit <= len; i += unit) {
+            UKDWORD value = 0;
+            memcpy(&value, data + i, unit);
+            if (value == '\n') {
+                sync = i + unit;
+                return sync;
+            }
+        }
+        return len;
+    }
+
+    lower = pos;
+    while (pos < len) {
+        const UKBYTE *p = (const UKBYTE *)memchr(data + pos, '\n', len - pos);
+        if (p == NULL)
+            break;
+        i = p - data;
+        pos = i + 1;
+        sync = pos;
+        if (viqr) {
+            // an escaped line feed doesn't reset anything
+            for (k = i; k > 0 && data[k - 1] == '\\'; k--)
+                ;
+            if ((i - k) & 1)
+                continue;
+        }
+        if (inCharset != CONV_CHARSET_UTF8VIQR)
+            return pos;
+
+        // look for the last UTF-8 character of the line, with only plain
+        // text after it. What lies before lower was already rejected
+        for (k = i; k > lower && data[k - 1] < 0x80 &&
+                    !vnIsViqrMark(data[k - 1]);
+             k--)
+            ;
+        lower = pos;
+        if (k < 2 || (data[k - 1] & 0xC0) != 0x80)
+            continue;
+        if ((data[k - 2] & 0xE0) == 0xC0)
+            k -= 2;
+        else if (k >= 3 && (data[k - 2] & 0xC0) == 0x80 &&
+                 (data[k - 3] & 0xF0) == 0xE0)
+            k -= 3;
+        else
+            continue;
+        // and it must not be escaped
+        for (sync = k; sync > 0 && data[sync - 1] == '\\'; sync--)
+            ;
+        if ((k - sync) & 1)
+            continue;
+        sync = k;
+        return pos;
+    }
+    return len;
+}
+
+//---------------------------------------
+struct VnFileChunk {
+    size_t start, sync, end; // input converted from sync, output from start
+    UKBYTE *output;
+    int outLen, skip;
+    int ret;
+};
+
+//---------------------------------------
+// Pieces larger than this are converted as a stream by the writer instead
+//---------------------------------------
+static int vnChunkInMemory(const VnFileChunk &chunk) {
+    return chunk.end - chunk.sync <= VN_FILE_MAX_CHUNK;
+}
+
+//---------------------------------------
+// Converts the chunks in order of their index, taking the next unclaimed
+// one each time
+//---------------------------------------
+static void vnConvertChunks(CVnCharsetLib *lib, int inCharset, int outCharset,
+                            UKBYTE *input, std::vector<VnFileChunk> *chunks,
+                            std::atomic<size_t> *next) {
+    size_t i;
+    while ((i = (*next)++) < chunks->size()) {
+        VnFileChunk &chunk = (*chunks)[i];
+        chunk.skip = 0;
+        chunk.ret = 0;
+        if (!vnChunkInMemory(chunk))
+            continue;
+        if (chunk.sync < chunk.start) {
+            // output of the characters before the cut, converted again only
+            // to bring the codecs to the right state
+            UKBYTE *head;
+            chunk.ret = vnConvertAlloc(*lib, inCharset, outCharset,
+                                       input + chunk.sync,
+                                       chunk.start - chunk.sync, head,
+                                       chunk.skip);
+            free(head);
+            if (chunk.ret != 0)
+                continue;
+        }
+        chunk.ret = vnConvertAlloc(*lib, inCharset, outCharset,
+                                   input + chunk.sync, chunk.end - chunk.sync,
+                                   chunk.output, chunk.outLen);
+    }
+}
+
+//---------------------------------------
+// Writes the output of a chunk, converting it now if it is too large to
+// have been converted in memory.
+// Returns 0 if successful
+//---------------------------------------
+static int vnWriteChunk(int inCharset, int outCharset, const UKBYTE *input,
+                        const VnFileChunk &chunk, int outFd) {
+    size_t skip = 0;
+    int ret;
+
+    if (vnChunkInMemory(chunk)) {
+        if (chunk.outLen <= chunk.skip)
+            return 0;
+        struct iovec iov = {chunk.output + chunk.skip,
+                            (size_t)(chunk.outLen - chunk.skip)};
+        return vnWriteOutput(outFd, &iov, 1) ? 0 : VNCONV_ERR_WRITING;
+    }
+
+    if (chunk.sync < chunk.start) {
+        ret = vnStreamRange(inCharset, outCharset, input, chunk.sync,
+                            chunk.start, 0, -1, skip);
+        if (ret != 0)
+            return ret;
+    }
+    size_t outBytes;
+    return vnStreamRange(inCharset, outCharset, input, chunk.sync, chunk.end,
+                         skip, outFd, outBytes);
+}
+
+//---------------------------------------
+// Arguments:
+//   inFile: input file name. NULL if STDIN is used
+//   outFile: output file name, NULL if STDOUT is used
+// Regular files are mapped and converted in memory a piece at a time, other
+// input as a stream. The output file is written under a temporary name in
+// the same directory, then renamed over outFile, so outFile may also be the
+// input file.
+// Returns:
+//     0: successful
+//     errCode: if failed
+//---------------------------------------
+DllExport int VnFileConvert(int inCharset, int outCharset, const char *inFile,
+                            const char *outFile) {
+    return VnFileConvertParallel(inCharset, outCharset, inFile, outFile, 1);
+}
+
+//---------------------------------------
+// Same as VnFileConvert, with the pieces of the input, cut at line feeds
+// (see vnFindCut), converted on up to threads threads, each with its own
+// charset objects. 0 threads means one per CPU.
+// The output is identical to that of VnFileConvert
+//---------------------------------------
+DllExport int VnFileConvertParallel(int inCharset, int outCharset,
+                                    const char *inFile, const char *outFile,
+                                    int threads) {
+    int inFd = STDIN_FILENO;
+    int outFd = STDOUT_FILENO;
+    int dirFd = -1;
+    UKBYTE *input = NULL;
+    size_t inSize = 0;
+    int mapped = 0;
+    int ret = 0;
+    size_t i, pos, sync, chunkSize, batch;
+    std::string outDir, tmpName;
+    const char *outName = NULL;
+    UKWORD sign = 0xFEFF;
+    std::vector<VnFileChunk> chunks;
+    std::vector<std::unique_ptr<CVnCharsetLib>> libs;
+    struct stat st;
+
+    if (!VnCharsetLibObj.getVnCharset(inCharset) ||
+        !VnCharsetLibObj.getVnCharset(outCharset))
+        return VNCONV_INVALID_CHARSET;
+
+    if (inFile != NULL) {
+        inFd = open(inFile, O_RDONLY | O_CLOEXEC);
+        if (inFd == -1)
+            return VNCONV_ERR_INPUT_FILE;
+    }
+    mapped = vnMapInput(inFd, input, inSize);
+
+    if (outFile != NULL) {
+        // write to a temporary file next to the output file, the output
+        // may be the input file
+        const char *slash = strrchr(outFile, '/');
+        if (slash == NULL) {
+            outDir = ".";
+            outName = outFile;
+        } else {
+            outDir.assign(outFile, slash == outFile ? 1 : slash - outFile);
+            outName = slash + 1;
+        }
+        dirFd = open(outDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd == -1) {
+            ret = VNCONV_ERR_OUTPUT_FILE;
+            goto end;
+        }
+        tmpName = outDir + "/.vnconvXXXXXX";
+        outFd = mkstemp(&tmpName[0]);
+        if (outFd == -1) {
+            ret = VNCONV_ERR_OUTPUT_FILE;
+            goto end;
+        }
+        // keep the permissions of the file being replaced
+        if (fstatat(dirFd, outName, &st, 0) == 0)
+            fchmod(outFd, st.st_mode & 07777);
+    }
+
+    if (outCharset == CONV_CHARSET_UNICODE) {
+        struct iovec iov = {&sign, sizeof(UKWORD)};
+        if (!vnWriteOutput(outFd, &iov, 1))
+            ret = VNCONV_ERR_WRITING;
+    }
+    if (ret == 0 && !mapped)
+        ret = vnStreamInput(inCharset, outCharset, inFd, outFd);
+    if (ret != 0 || !mapped)
+        goto done;
+
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads <= 0)
+        threads = 1;
+    for (int t = 1; t < threads; t++) {
+        libs.push_back(std::make_unique<CVnCharsetLib>());
+        libs.back()->m_options = VnCharsetLibObj.m_options;
+        libs.back()->m_VIQREscPatterns = VnCharsetLibObj.m_VIQREscPatterns;
+    }
+
+    // a few chunks per thread, to even out the load. Their output is kept
+    // until it is written, so only so many are converted at a time
+    chunkSize = inSize / threads / 4;
+    if (chunkSize < VN_FILE_CHUNK_SIZE)
+        chunkSize = VN_FILE_CHUNK_SIZE;
+    if (chunkSize > VN_FILE_MAX_CHUNK)
+        chunkSize = VN_FILE_MAX_CHUNK;
+    batch = threads * 2;
+    pos = sync = 0;
+    while (pos < inSize && ret == 0) {
+        while (pos < inSize && chunks.size() < batch) {
+            VnFileChunk chunk;
+            chunk.start = pos;
+            chunk.sync = sync;
+            chunk.output = NULL;
+            chunk.outLen = 0;
+            if (inSize - pos <= chunkSize)
+                chunk.end = inSize;
+            else
+                chunk.end = vnFindCut(inCharset, input, inSize,
+                                      pos + chunkSize, sync);
+            chunks.push_back(chunk);
+            pos = chunk.end;
+        }
+
+        std::atomic<size_t> next(0);
+        if (threads == 1) {
+            vnConvertChunks(&VnCharsetLibObj, inCharset, outCharset, input,
+                            &chunks, &next);
+        } else {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < libs.size() && t < chunks.size(); t++)
+                workers.emplace_back(vnConvertChunks, libs[t].get(),
+                                     inCharset, outCharset, input, &chunks,
+                                     &next);
+            // this thread takes its share too
+            vnConvertChunks(&VnCharsetLibObj, inCharset, outCharset, input,
+                            &chunks, &next);
+            for (auto &worker : workers)
+                worker.join();
+        }
+
+        for (i = 0; i < chunks.size(); i++) {
+            if (ret == 0)
+                ret = chunks[i].ret;
+            if (ret == 0)
+                ret = vnWriteChunk(inCharset, outCharset, input, chunks[i],
+                                   outFd);
+            free(chunks[i].output);
+        }
+        chunks.clear();
+    }
+
+done:
+    if (outFile != NULL) {
+        if (close(outFd) != 0 && ret == 0)
+            ret = VNCONV_ERR_WRITING;
+        outFd = STDOUT_FILENO;
+        const char *tmpBase = tmpName.c_str() + outDir.size() + 1;
+        if (ret == 0 && renameat(dirFd, tmpBase, dirFd, outName) != 0)
+            ret = VNCONV_ERR_OUTPUT_FILE;
+        if (ret != 0)
+            unlinkat(dirFd, tmpBase, 0);
+    }
+
+end:
+    for (i = 0; i < chunks.size(); i++)
+        free(chunks[i].output);
+    if (mapped)
+        munmap(input, inSize);
+    if (inFd != STDIN_FILENO)
+        close(inFd);
+    if (outFd != STDOUT_FILENO) {
+        close(outFd);
+        unlink(tmpName.c_str());
+    }
+    if (dirFd != -1)
+        close(dirFd);
+    return ret;
+}
+
+#else
 //---------------------------------------
 // Arguments:
 //   inFile: input file name. NULL if STDIN is used
@@ -188,6 +915,18 @@ end:
     return ret;
 }
 
+//---------------------------------------
+// The file is always converted on the calling thread here
+//---------------------------------------
+DllExport int VnFileConvertParallel(int inCharset, int outCharset,
+                                    const char *inFile, const char *outFile,
+                                    int threads) {
+    (void)threads;
+    return VnFileConvert(inCharset, outCharset, inFile, outFile);
+}
+
+#endif
+
 //------------------------------------------------
 // Returns:
 //     0: successful
@@ -0,0 +1,244 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "charset.h"
+#include "ukengine.h"
+#include "vnlexi.h"
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+
+#define VN_DETECT_SAMPLE 65536 // bytes of input looked at
+#define VN_DETECT_WORD 7       // letters in the longest syllable: nghieng
+#define VN_DETECT_ENOUGH 256   // words and stray bytes that settle a candidate
+
+// Candidates, the more common first as they win ties
+static const int DetectCharsets[] = {
+    CONV_CHARSET_UNIUTF8,   CONV_CHARSET_TCVN3,   CONV_CHARSET_VNIWIN,
+    CONV_CHARSET_VISCII,    CONV_CHARSET_VPS,     CONV_CHARSET_WINCP1258,
+    CONV_CHARSET_VIQR,      CONV_CHARSET_UNIREF,  CONV_CHARSET_BKHCM1,
+    CONV_CHARSET_VIETWAREF, CONV_CHARSET_ISC,     CONV_CHARSET_BKHCM2,
+    CONV_CHARSET_VIETWAREX, CONV_CHARSET_VNIMAC,
+};
+
+static const int DetectCount = sizeof(DetectCharsets) / sizeof(int);
+
+// For the charsets with tables: bytes outside printable ASCII that take part
+// in Vietnamese letters, filled from the tables on first use
+static UKBYTE DetectLetterBytes[DetectCount][256];
+static std::once_flag detectInitFlag;
+
+struct DetectScore {
+    int index;    // in DetectCharsets
+    int valid;    // words with Vietnamese letters that are syllables
+    int invalid;  // such words that are not, and bytes that mean nothing
+    int evidence; // valid words less twice the invalid ones
+};
+
+//----------------------------------------------------
+static void markLetterBytes(UKBYTE *bytes, UKWORD w) {
+    bytes[w & 0xFF] = 1;
+    bytes[w >> 8] = 1;
+}
+
+//----------------------------------------------------
+static void detectClassInit() {
+    int c, i, id;
+    for (c = 0; c < DetectCount; c++) {
+        id = DetectCharsets[c];
+        UKBYTE *bytes = DetectLetterBytes[c];
+        for (i = 0; i < TOTAL_ALPHA_VNCHARS; i++) {
+            if (IS_SINGLE_BYTE_CHARSET(id))
+                bytes[SingleByteTables[id - CONV_CHARSET_TCVN3][i]] = 1;
+            else if (IS_DOUBLE_BYTE_CHARSET(id))
+                markLetterBytes(bytes,
+                                DoubleByteTables[id - CONV_CHARSET_VNIWIN][i]);
+            else if (id == CONV_CHARSET_WINCP1258) {
+                markLetterBytes(bytes, WinCP1258[i]);
+                markLetterBytes(bytes, WinCP1258Pre[i]);
+            }
+        }
+        memset(bytes + 0x20, 0, 0x60);
+        bytes[0] = bytes['\t'] = bytes['\n'] = bytes['\r'] = 0;
+    }
+}
+
+//----------------------------------------------------
+// Decodes the sample as a candidate charset and checks its words
+//----------------------------------------------------
+static void scoreCharset(CVnCharsetLib &lib, UKBYTE *data, int len,
+                         DetectScore &score) {
+    int id = DetectCharsets[score.index];
+    VnCharset *cs = lib.getVnCharset(id);
+    VnSpanDecoder decoder = VnGetSpanDecoder(id);
+    // other charsets decode the bytes they have no letter for as themselves
+    int unicode = (id == CONV_CHARSET_UNIUTF8 || id == CONV_CHARSET_UNIREF);
+    StdVnChar chars[VN_SPAN_CHUNK];
+    VnLexiName word[VN_DETECT_WORD];
+    int wordLen = 0, marked = 0, broken = 0, lower = 0;
+    int i, count, more = 1;
+    SpanBIStream is(data, len);
+
+    cs->startInput();
+    while (more && score.valid + score.invalid < VN_DETECT_ENOUGH) {
+        count = 0;
+        if (!is.eos())
+            more = decoder(*cs, is, chars, count, -1);
+        else
+            more = 0;
+        // one character past the end to close the last word
+        if (!more)
+            chars[count++] = ' ';
+
+        for (i = 0; i < count; i++) {
+            StdVnChar ch = chars[i];
+            VnLexiName sym = vnl_nonVnChar;
+            if (ch >= VnStdCharOffset &&
+                ch < VnStdCharOffset + TOTAL_ALPHA_VNCHARS)
+                sym = (VnLexiName)(ch - VnStdCharOffset);
+            else if (ch >= 'a' && ch <= 'z')
+                sym = AZLexiLower[ch - 'a'];
+            else if (ch >= 'A' && ch <= 'Z')
+                sym = AZLexiUpper[ch - 'A'];
+
+            if (sym != vnl_nonVnChar) {
+                if (StdVnRootChar[sym] != sym)
+                    marked = 1;
+                // upper case after lower case
+                if (!(sym & 1) && lower)
+                    broken = 1;
+                lower = sym & 1;
+                if (wordLen == VN_DETECT_WORD)
+                    broken = 1;
+                else
+                    word[wordLen++] = (VnLexiName)(sym | 1);
+                continue;
+            }
+
+            if (marked) {
+                if (!broken && isVnSyllable(word, wordLen))
+                    score.valid++;
+                else
+                    score.invalid++;
+            }
+            wordLen = marked = broken = lower = 0;
+
+            if ((ch < 0x20 && ch != '\t' && ch != '\n' && ch != '\r') ||
+                (!unicode && ch >= 0x80 && ch < 0x100))
+                score.invalid++;
+        }
+    }
+}
+
+//----------------------------------------------------
+// Ranks the candidates that the byte statistics of the sample leave, by
+// decoding the sample and checking its syllables.
+// Returns the number of guesses written
+//
+// There is no table of byte bigrams. Its frequencies would need a corpus,
+// which the tree lacks, and it would take about 3000 of the 65536 pairs of
+// each charset, 8 KiB for each of the 14. Decoding a candidate and checking
+// its words against the syllable rules tests every byte in the context of
+// its whole word, which bigrams only estimate. It is cheap enough: the byte
+// counts leave 2 to 11 candidates for a Vietnamese paragraph, and decoding
+// stops after 256 words, so a 64 KiB sample takes under a millisecond.
+//----------------------------------------------------
+DllExport int VnDetectCharset(const UKBYTE *input, int inLen,
+                              VnCharsetGuess *guesses, int maxGuesses) {
+    if (input == NULL || maxGuesses <= 0)
+        return 0;
+    if (inLen == -1)
+        inLen = strlen((const char *)input);
+    if (inLen <= 0)
+        return 0;
+    if (inLen > VN_DETECT_SAMPLE)
+        inLen = VN_DETECT_SAMPLE;
+    std::call_once(detectInitFlag, detectClassInit);
+
+    // byte counts, and UTF-8 sequences complete or broken
+    int hist[256] = {0};
+    int i, b, follow = 0, multi = 0, bad = 0, high = 0;
+    for (i = 0; i < inLen; i++) {
+        b = input[i];
+        hist[b]++;
+        if (follow > 0) {
+            if ((b & 0xC0) == 0x80) {
+                if (--follow == 0)
+                    multi++;
+                continue;
+            }
+            bad++;
+            follow = 0;
+        }
+        if (b >= 0xC2 && b < 0xF5)
+            follow = (b >= 0xF0) ? 3 : (b >= 0xE0) ? 2 : 1;
+        else if (b >= 0x80)
+            bad++;
+    }
+    for (b = 0x80; b < 0x100; b++)
+        high += hist[b];
+
+    // charsets are costly to set up, and hold decoder state
+    static thread_local CVnCharsetLib lib;
+    VnConvResetOptions(&lib.m_options);
+    DetectScore scores[DetectCount];
+    int c, id, n = 0;
+    for (c = 0; c < DetectCount; c++) {
+        id = DetectCharsets[c];
+        if (id == CONV_CHARSET_UNIUTF8) {
+            if (bad * 2 > multi)
+                continue;
+        } else if (id == CONV_CHARSET_VIQR || id == CONV_CHARSET_UNIREF) {
+            if (high * 32 > inLen)
+                continue;
+            if (id == CONV_CHARSET_UNIREF && (!hist['&'] || !hist['#']))
+                continue;
+        } else {
+            // no letter byte of the charset, or many bytes that aren't any
+            int letters = 0, strays = 0;
+            for (b = 0; b < 0x100; b++) {
+                if (DetectLetterBytes[c][b])
+                    letters += hist[b];
+                else if (b >= 0x80)
+                    strays += hist[b];
+            }
+            if (letters == 0 || strays * 2 > high)
+                continue;
+        }
+        scores[n].index = c;
+        scores[n].valid = scores[n].invalid = 0;
+        // ASCII text decodes the same as UTF-8, whatever it is
+        if (id != CONV_CHARSET_UNIUTF8 || multi > 0)
+            scoreCharset(lib, (UKBYTE *)input, inLen, scores[n]);
+        // the UTF-8 decoder drops broken sequences
+        if (id == CONV_CHARSET_UNIUTF8)
+            scores[n].invalid += bad;
+        scores[n].evidence = scores[n].valid - 2 * scores[n].invalid;
+        if (scores[n].evidence < 0)
+            scores[n].evidence = 0;
+        n++;
+    }
+
+    std::stable_sort(scores, scores + n,
+                     [](const DetectScore &a, const DetectScore &b) {
+                         return a.evidence > b.evidence;
+                     });
+
+    // the share of the evidence, by how clean the charset decodes
+    long total = 0;
+    for (i = 0; i < n; i++)
+        total += scores[i].evidence;
+    if (n > maxGuesses)
+        n = maxGuesses;
+    for (i = 0; i < n; i++) {
+        DetectScore &s = scores[i];
+        guesses[i].charset = DetectCharsets[s.index];
+        guesses[i].confidence =
+            s.evidence ? (int)(100L * s.evidence * s.valid /
+                               (total * (s.valid + s.invalid)))
+                       : 0;
+    }
+    return n;
+}
@@ -8,6 +8,9 @@
 
 #include "keycons.h"
 #include "vnlexi.h"
+#include <array>
+#include <string>
+#include <string_view>
 #include <unordered_set>
 
 #if defined(_WIN32)
@@ -90,20 +93,81 @@ protected:
     UkInputMethod m_im;
     int m_keyMap[256];
 
-    void useBuiltIn(UkKeyMapping *map);
+    void useBuiltIn(const UkKeyMapping *map);
+};
+
+///////////////////////////////////////////
+// Writes the key strokes that type Vietnamese words with an input method:
+// the keys of each letter, then the tone key of the word
+class UkKeyStrokeWriter {
+
+public:
+    explicit UkKeyStrokeWriter(const UkInputProcessor &input);
+
+    // Returns false if the input method can't type a letter of the word
+    bool writeWord(const VnLexiName *word, int len, std::string &keys) const;
+    // Writes each word of UTF-8 text, the rest as it is
+    std::string writeText(std::string_view text) const;
+
+protected:
+    int m_keyMap[256];
+    // keys of each letter without tone, their count first
+    unsigned char m_letterKeys[vnl_lastChar][3];
+    unsigned char m_toneKeys[6];
+    unsigned char m_escKey;
+    // the hook key of o+ in u+o+ hooks the u too
+    bool m_hookBoth;
 };
 
 void UkResetKeyMap(int keyMap[256]);
-void SetupInputClassifierTable();
 
-DllInterface extern UkKeyMapping TelexMethodMapping[];
-DllInterface extern UkKeyMapping SimpleTelexMethodMapping[];
-DllInterface extern UkKeyMapping SimpleTelex2MethodMapping[];
-DllInterface extern UkKeyMapping VniMethodMapping[];
-DllInterface extern UkKeyMapping VIQRMethodMapping[];
-DllInterface extern UkKeyMapping MsViMethodMapping[];
+DllInterface extern const UkKeyMapping TelexMethodMapping[];
+DllInterface extern const UkKeyMapping SimpleTelexMethodMapping[];
+DllInterface extern const UkKeyMapping SimpleTelex2MethodMapping[];
+DllInterface extern const UkKeyMapping VniMethodMapping[];
+DllInterface extern const UkKeyMapping VIQRMethodMapping[];
+DllInterface extern const UkKeyMapping MsViMethodMapping[];
+
+inline constexpr VnLexiName AZLexiUpper[] = {
+    vnl_A, vnl_B, vnl_C, vnl_D, vnl_E, vnl_F, vnl_G, vnl_H, vnl_I,
+    vnl_J, vnl_K, vnl_L, vnl_M, vnl_N, vnl_O, vnl_P, vnl_Q, vnl_R,
+    vnl_S, vnl_T, vnl_U, vnl_V, vnl_W, vnl_X, vnl_Y, vnl_Z};
+
+inline constexpr VnLexiName AZLexiLower[] = {
+    vnl_a, vnl_b, vnl_c, vnl_d, vnl_e, vnl_f, vnl_g, vnl_h, vnl_i,
+    vnl_j, vnl_k, vnl_l, vnl_m, vnl_n, vnl_o, vnl_p, vnl_q, vnl_r,
+    vnl_s, vnl_t, vnl_u, vnl_v, vnl_w, vnl_x, vnl_y, vnl_z};
+
+struct AscVnLexi {
+    unsigned char asc;
+    VnLexiName lexi;
+};
+
+// List of western characters outside range A-Z that are
+// also Vietnamese characters
+inline constexpr AscVnLexi AscVnLexiList[] = {
+    {0xC0, vnl_A2}, {0xC1, vnl_A1}, {0xC2, vnl_Ar}, {0xC2, vnl_A4},
+    {0xC8, vnl_E2}, {0xC9, vnl_E1}, {0xCA, vnl_Er}, {0xCC, vnl_I2},
+    {0xCD, vnl_I1}, {0xD2, vnl_O2}, {0xD3, vnl_O1}, {0xD4, vnl_Or},
+    {0xD5, vnl_O4}, {0xD9, vnl_U2}, {0xDA, vnl_U1}, {0xDD, vnl_Y1},
+    {0xE0, vnl_a2}, {0xE1, vnl_a1}, {0xE2, vnl_ar}, {0xE3, vnl_a4},
+    {0xE8, vnl_e2}, {0xE9, vnl_e1}, {0xEA, vnl_er}, {0xEC, vnl_i2},
+    {0xED, vnl_i1}, {0xF2, vnl_o2}, {0xF3, vnl_o1}, {0xF4, vnl_or},
+    {0xF5, vnl_o4}, {0xF9, vnl_u2}, {0xFA, vnl_u1}, {0xFD, vnl_y1}};
+
+// Built when compiling, so that the table lies in read only memory
+inline constexpr std::array<VnLexiName, 256> IsoVnLexiMap = [] {
+    std::array<VnLexiName, 256> map{};
+    map.fill(vnl_nonVnChar);
+    for (const AscVnLexi &item : AscVnLexiList)
+        map[item.asc] = item.lexi;
+    for (int i = 0; i < 26; i++) {
+        map['a' + i] = AZLexiLower[i];
+        map['A' + i] = AZLexiUpper[i];
+    }
+    return map;
+}();
 
-extern VnLexiName IsoVnLexiMap[];
 inline VnLexiName IsoToVnLexi(unsigned int keyCode) {
     return (keyCode >= 256) ? vnl_nonVnChar : IsoVnLexiMap[keyCode];
 }
@@ -37,6 +37,8 @@ struct UnikeyOptions {
     int useIME; // for Win32 only
     int spellCheckEnabled;
     int autoNonVnRestore;
+    int autoComplete;
+    int phraseMacro; // macro keys may span words
 };
 
 #define UKOPT_FLAG_ALL 0xFFFFFFFF
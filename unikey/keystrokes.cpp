@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "charset.h"
+#include "inputproc.h"
+#include "ukengine.h"
+#include <vector>
+
+// Actions that add the diacritic of a letter, the more specific first
+static const struct {
+    VnLexiName sym;
+    int actions[4];
+} LetterActions[] = {
+    {vnl_ar, {vneRoof_a, vneRoofAll, -1, -1}},
+    {vnl_er, {vneRoof_e, vneRoofAll, -1, -1}},
+    {vnl_or, {vneRoof_o, vneRoofAll, -1, -1}},
+    {vnl_ab, {vneBowl, vneHookAll, vne_telex_w, -1}},
+    {vnl_oh, {vneHook_o, vneHook_uo, vneHookAll, vne_telex_w}},
+    {vnl_uh, {vneHook_u, vneHook_uo, vneHookAll, vne_telex_w}},
+    {vnl_dd, {vneDd, -1, -1, -1}},
+};
+
+//-------------------------------------------
+// The key of an action, a letter or a digit if one has it, 0 if none
+//-------------------------------------------
+static unsigned char findKey(const int keyMap[256], int action) {
+    static const char preferred[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    for (const char *p = preferred; *p; p++) {
+        if (keyMap[(unsigned char)*p] == action)
+            return *p;
+    }
+    for (int c = 33; c < 127; c++) {
+        if (keyMap[c] == action)
+            return c;
+    }
+    return 0;
+}
+
+//-------------------------------------------
+static inline bool isLetter(int sym, VnLexiName lower) {
+    return (StdVnNoTone[sym] | 1) == lower;
+}
+
+//-------------------------------------------
+UkKeyStrokeWriter::UkKeyStrokeWriter(const UkInputProcessor &input) {
+    int i, sym;
+    input.getKeyMap(m_keyMap);
+
+    for (sym = 0; sym < vnl_lastChar; sym++) {
+        unsigned char *keys = m_letterKeys[sym];
+        keys[0] = 0;
+        if (StdVnNoTone[sym] != sym)
+            continue;
+        int root = StdVnRootChar[sym];
+        UnicodeChar base = UnicodeTable[root];
+        if (base >= 0x80)
+            continue;
+        if (root == sym) {
+            keys[0] = 1;
+            keys[1] = base;
+            continue;
+        }
+
+        // the base letter and the key of its diacritic, or a key that maps
+        // to the letter
+        unsigned char key = 0;
+        for (const auto &letter : LetterActions) {
+            if (letter.sym != (sym | 1))
+                continue;
+            for (i = 0; i < 4 && letter.actions[i] >= 0 && !key; i++)
+                key = findKey(m_keyMap, letter.actions[i]);
+        }
+        if (key) {
+            keys[0] = 2;
+            keys[1] = base;
+            keys[2] = key;
+        } else if ((key = findKey(m_keyMap, vneCount + sym))) {
+            keys[0] = 1;
+            keys[1] = key;
+        }
+    }
+
+    for (i = 0; i < 6; i++)
+        m_toneKeys[i] = findKey(m_keyMap, vneTone0 + i);
+    m_escKey = findKey(m_keyMap, vneEscChar);
+
+    const unsigned char *ohKeys = m_letterKeys[vnl_oh];
+    int hook = (ohKeys[0] == 2) ? m_keyMap[ohKeys[2]] : vneNormal;
+    m_hookBoth =
+        (hook == vneHook_uo || hook == vneHookAll || hook == vne_telex_w);
+}
+
+//-------------------------------------------
+// The tone key goes last, where the engine puts the tone on the right vowel
+//-------------------------------------------
+bool UkKeyStrokeWriter::writeWord(const VnLexiName *word, int len,
+                                  std::string &keys) const {
+    int i, tone = 0;
+    size_t start = keys.size();
+
+    for (i = 0; i < len; i++) {
+        if (word[i] < 0 || word[i] >= vnl_lastChar)
+            break;
+        int sym = StdVnNoTone[word[i]];
+        if (sym != word[i])
+            tone = (word[i] - sym) / 2;
+        const unsigned char *letterKeys = m_letterKeys[sym];
+        if (letterKeys[0] == 0)
+            break;
+
+        // u+o+ takes one hook key after the o, but h, kh, th and no onset
+        // make it uo+
+        if (m_hookBoth && letterKeys[0] == 2 && isLetter(sym, vnl_uh) &&
+            i > 0 && !isLetter(word[i - 1], vnl_h) && i + 1 < len &&
+            isLetter(word[i + 1], vnl_oh)) {
+            keys += (char)letterKeys[1];
+            continue;
+        }
+        keys.append((const char *)letterKeys + 1, letterKeys[0]);
+    }
+
+    if (i < len || (tone && !m_toneKeys[tone])) {
+        keys.resize(start);
+        return false;
+    }
+    if (tone)
+        keys += (char)m_toneKeys[tone];
+    return true;
+}
+
+//-------------------------------------------
+// Reads the character at i, returns its length
+//-------------------------------------------
+static size_t getUtf8(std::string_view text, size_t i, unsigned int &ch) {
+    unsigned char b = text[i];
+    size_t n = (b >= 0xF0) ? 4 : (b >= 0xE0) ? 3 : (b >= 0xC0) ? 2 : 1;
+    if (n > text.size() - i)
+        n = 1;
+    ch = (n == 1) ? b : b & (0x7F >> n);
+    for (size_t k = 1; k < n; k++)
+        ch = (ch << 6) | (text[i + k] & 0x3F);
+    return n;
+}
+
+//-------------------------------------------
+// Keys the input method would take as marks of a word are escaped, if it has
+// an escape key
+//-------------------------------------------
+std::string UkKeyStrokeWriter::writeText(std::string_view text) const {
+    std::string composed = VnNormalizeUtf8String(text, VN_NORM_NFC);
+    std::string keys;
+    std::vector<VnLexiName> word;
+    size_t i = 0, wordStart = 0, n;
+    unsigned int ch = 0;
+
+    keys.reserve(composed.size() + composed.size() / 4);
+    while (i <= composed.size()) {
+        int letter = -1;
+        n = 1;
+        if (i < composed.size()) {
+            n = getUtf8(composed, i, ch);
+            letter = VnLetterOfUnicode(ch);
+        }
+        if (letter >= 0) {
+            if (word.empty())
+                wordStart = i;
+            word.push_back((VnLexiName)letter);
+            i += n;
+            continue;
+        }
+
+        // the engine takes marks after a syllable only
+        bool escape = false;
+        if (!word.empty()) {
+            if (writeWord(word.data(), word.size(), keys)) {
+                for (auto &sym : word)
+                    sym = (VnLexiName)(sym | 1);
+                escape = isVnSyllable(word.data(), word.size());
+            } else {
+                keys.append(composed, wordStart, i - wordStart);
+            }
+        }
+        word.clear();
+        if (i == composed.size())
+            break;
+        if (escape && ch < 0x80 && m_escKey && m_keyMap[ch] != vneNormal)
+            keys += (char)m_escKey;
+        keys.append(composed, i, n);
+        i += n;
+    }
+    return keys;
+}
@@ -7,22 +7,41 @@
 #include "mactab.h"
 #include "vnconv.h"
 #include <iostream>
+#include <new>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 using namespace std;
 #define UKMACRO_VERSION_UTF8 1
 
+//---------------------------------------------------------------
+CMacroTable::CMacroTable(const CMacroTable &other) { *this = other; }
+
+//---------------------------------------------------------------
+CMacroTable &CMacroTable::operator=(const CMacroTable &other) {
+    if (this == &other)
+        return *this;
+    m_count = other.m_count;
+    m_memSize = other.m_memSize;
+    m_occupied = other.m_occupied;
+    memcpy(m_table, other.m_table, m_count * sizeof(MacroDef));
+    memcpy(m_macroMem, other.m_macroMem, m_occupied * sizeof(MacroChar));
+    m_encodedCharset = -1;
+    return *this;
+}
+
 //---------------------------------------------------------------
 void CMacroTable::init() {
-    m_memSize = MACRO_MEM_SIZE;
+    m_memSize = MACRO_MEM_CHARS;
     m_count = 0;
     m_occupied = 0;
+    m_encodedCharset = -1;
 }
 
 //---------------------------------------------------------------
-char *MacCompareStartMem;
+const MacroChar *MacCompareStartMem;
 
 #define STD_TO_LOWER(x)                                                        \
     (((x) >= VnStdCharOffset &&                                                \
@@ -30,28 +49,44 @@ char *MacCompareStartMem;
          ? (x + 1)                                                             \
          : (x))
 
+//---------------------------------------------------------------
+// The character in 16 bits, 0 if it can't be
+//---------------------------------------------------------------
+static inline MacroChar packMacroChar(StdVnChar ch) {
+    if (ch >= VnStdCharOffset && ch < VnStdCharOffset + TOTAL_VNCHARS)
+        return MACRO_VN_BASE + (ch - VnStdCharOffset);
+    if (ch > 0xFFFF || (ch >= 0xD800 && ch < 0xE000))
+        return 0;
+    return ch;
+}
+
+//---------------------------------------------------------------
+static inline StdVnChar unpackMacroChar(MacroChar ch) {
+    if (ch >= MACRO_VN_BASE && ch < MACRO_VN_BASE + TOTAL_VNCHARS)
+        return VnStdCharOffset + (ch - MACRO_VN_BASE);
+    return ch;
+}
+
+//---------------------------------------------------------------
+static inline StdVnChar lowerMacroChar(MacroChar ch) {
+    StdVnChar c = unpackMacroChar(ch);
+    return STD_TO_LOWER(c);
+}
+
 int macCompare(const void *p1, const void *p2) {
-    StdVnChar *s1 =
-        (StdVnChar *)((char *)MacCompareStartMem + ((MacroDef *)p1)->keyOffset);
-    StdVnChar *s2 =
-        (StdVnChar *)((char *)MacCompareStartMem + ((MacroDef *)p2)->keyOffset);
+    const MacroChar *s1 = MacCompareStartMem + ((MacroDef *)p1)->keyOffset;
+    const MacroChar *s2 = MacCompareStartMem + ((MacroDef *)p2)->keyOffset;
 
     int i;
     StdVnChar ls1, ls2;
 
     for (i = 0; s1[i] != 0 && s2[i] != 0; i++) {
-        ls1 = STD_TO_LOWER(s1[i]);
-        ls2 = STD_TO_LOWER(s2[i]);
+        ls1 = lowerMacroChar(s1[i]);
+        ls2 = lowerMacroChar(s2[i]);
         if (ls1 > ls2)
             return 1;
         if (ls1 < ls2)
             return -1;
-        /*
-        if (s1[i] > s2[i])
-            return 1;
-        if (s1[i] < s2[i])
-            return -1;
-        */
     }
     if (s1[i] == 0)
         return (s2[i] == 0) ? 0 : -1;
@@ -61,24 +96,17 @@ int macCompare(const void *p1, const void *p2) {
 //---------------------------------------------------------------
 int macKeyCompare(const void *key, const void *ele) {
     StdVnChar *s1 = (StdVnChar *)key;
-    StdVnChar *s2 = (StdVnChar *)((char *)MacCompareStartMem +
-                                  ((MacroDef *)ele)->keyOffset);
+    const MacroChar *s2 = MacCompareStartMem + ((MacroDef *)ele)->keyOffset;
 
     StdVnChar ls1, ls2;
     int i;
     for (i = 0; s1[i] != 0 && s2[i] != 0; i++) {
         ls1 = STD_TO_LOWER(s1[i]);
-        ls2 = STD_TO_LOWER(s2[i]);
+        ls2 = lowerMacroChar(s2[i]);
         if (ls1 > ls2)
             return 1;
         if (ls1 < ls2)
             return -1;
-        /*
-        if (s1[i] > s2[i])
-            return 1;
-        if (s1[i] < s2[i])
-            return -1;
-        */
     }
     if (s1[i] == 0)
         return (s2[i] == 0) ? 0 : -1;
@@ -87,14 +115,240 @@ int macKeyCompare(const void *key, const void *ele) {
 
 //---------------------------------------------------------------
 const StdVnChar *CMacroTable::lookup(StdVnChar *key) {
+    // the text unpacked, as callers keep the pointer
+    static StdVnChar text[MAX_MACRO_TEXT_LEN + 1];
     MacCompareStartMem = m_macroMem;
     MacroDef *p = (MacroDef *)bsearch(key, m_table, m_count, sizeof(MacroDef),
                                       macKeyCompare);
-    if (p)
-        return (StdVnChar *)(m_macroMem + p->textOffset);
+    if (p && getText(p - m_table, text, MAX_MACRO_TEXT_LEN + 1) >= 0)
+        return text;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// Compare the prefix with as many characters of the key, 0 if the key
+// starts with it
+//---------------------------------------------------------------
+static int macPrefixCompare(const StdVnChar *prefix, const MacroChar *key) {
+    StdVnChar ls1, ls2;
+    for (int i = 0; prefix[i] != 0; i++) {
+        ls1 = STD_TO_LOWER(prefix[i]);
+        ls2 = lowerMacroChar(key[i]);
+        if (ls1 > ls2)
+            return 1;
+        if (ls1 < ls2)
+            return -1;
+    }
     return 0;
 }
 
+//---------------------------------------------------------------
+// The items whose keys start with the prefix are next to each other in the
+// sorted table, from first to before last
+//---------------------------------------------------------------
+void CMacroTable::keyPrefixRange(const StdVnChar *prefix, int &first,
+                                 int &last) const {
+    int lo = 0, hi = m_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (macPrefixCompare(prefix, m_macroMem + m_table[mid].keyOffset) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    first = lo;
+
+    hi = m_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (macPrefixCompare(prefix, m_macroMem + m_table[mid].keyOffset) >= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    last = lo;
+}
+
+//---------------------------------------------------------------
+// Test if some macro key starts with the prefix, the letters compared the
+// way lookup() compares them
+//---------------------------------------------------------------
+bool CMacroTable::hasKeyPrefix(const StdVnChar *prefix) const {
+    int first, last;
+    keyPrefixRange(prefix, first, last);
+    return first < last;
+}
+
+//---------------------------------------------------------------
+static int trieNext(const MacroTrieNode *trie, int node, MacroChar ch) {
+    for (int n = trie[node].child; n >= 0; n = trie[n].sibling) {
+        if (trie[n].ch == ch)
+            return n;
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+int CMacroTable::suffixNext(int node, StdVnChar ch) const {
+    ch = STD_TO_LOWER(ch);
+    MacroChar packed = packMacroChar(ch);
+    if (packed == 0 || m_encodedCharset < 0)
+        return -1;
+    return trieNext(trie(), node, packed);
+}
+
+//---------------------------------------------------------------
+// Add the key to the trie from its last character, the first key added
+// keeps its item as lookup() has no order among equal keys either
+//---------------------------------------------------------------
+static void addSuffixKey(std::vector<MacroTrieNode> &trie,
+                         const MacroChar *key, int item) {
+    int len = 0;
+    while (key[len] != 0)
+        len++;
+    if (len == 0 || trie.size() + len > MAX_MACRO_TRIE_NODES)
+        return;
+
+    int node = 0;
+    for (int i = len - 1; i >= 0; i--) {
+        MacroChar lower = packMacroChar(lowerMacroChar(key[i]));
+        int next = trieNext(trie.data(), node, lower);
+        if (next < 0) {
+            next = trie.size();
+            trie.push_back({lower, -1, trie[node].child, -1});
+            trie[node].child = next;
+        }
+        node = next;
+    }
+    if (trie[node].item < 0)
+        trie[node].item = item;
+}
+
+//---------------------------------------------------------------
+// Convert the characters at the end of out, false if the charset can't
+// write them
+//---------------------------------------------------------------
+static bool appendEncoded(int charset, const StdVnChar *chars, int len,
+                          std::vector<UKBYTE> &out) {
+    size_t start = out.size();
+    for (int room = len * 4 + 8;; room *= 2) {
+        out.resize(start + room);
+        int inLen = len * sizeof(StdVnChar);
+        int outLen = room;
+        int ret = VnConvert(CONV_CHARSET_VNSTANDARD, charset, (UKBYTE *)chars,
+                            out.data() + start, &inLen, &outLen);
+        if (ret == 0) {
+            out.resize(start + outLen);
+            return true;
+        }
+        if (ret != VNCONV_OUT_OF_MEMORY) {
+            out.resize(start);
+            return false;
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// Build the trie and encode the case forms of every text, a form that the
+// case leaves as it is shares the bytes of the text as stored
+//---------------------------------------------------------------
+const CMacroTable *
+CMacroTable::compile(int charset,
+                     const std::function<void *(size_t)> &alloc) const {
+    static StdVnChar text[MAX_MACRO_TEXT_LEN + 1];
+    static StdVnChar form[MAX_MACRO_TEXT_LEN + 1];
+    std::vector<MacroForms> forms(m_count);
+    std::vector<MacroTrieNode> trie = {{0, -1, -1, -1}};
+    std::vector<UKBYTE> bytes;
+    int i, c, f, len;
+    bool changed;
+
+    for (i = 0; i < m_count; i++)
+        addSuffixKey(trie, m_macroMem + m_table[i].keyOffset, i);
+
+    for (i = 0; i < m_count; i++) {
+        MacroForms &def = forms[i];
+        len = getText(i, text, MAX_MACRO_TEXT_LEN + 1);
+        for (f = 0; f < VnCaseTotal; f++) {
+            changed = false;
+            for (c = 0; c < len; c++) {
+                if (f == VnCaseAllCapital)
+                    form[c] = StdVnToUpper(text[c]);
+                else if (f == VnCaseAllSmall)
+                    form[c] = StdVnToLower(text[c]);
+                else
+                    form[c] = text[c];
+                changed = changed || form[c] != text[c];
+            }
+            if (f != VnCaseNoChange && !changed) {
+                def.offset[f] = def.offset[VnCaseNoChange];
+                def.len[f] = def.len[VnCaseNoChange];
+                continue;
+            }
+
+            int used = bytes.size();
+            if (appendEncoded(charset, form, len, bytes)) {
+                def.offset[f] = used;
+                def.len[f] = bytes.size() - used;
+            } else
+                def.offset[f] = -1;
+        }
+    }
+
+    size_t formsSize = forms.size() * sizeof(MacroForms);
+    size_t trieSize = trie.size() * sizeof(MacroTrieNode);
+    UKBYTE *mem = (UKBYTE *)alloc(sizeof(CMacroTable) + formsSize + trieSize +
+                                  bytes.size());
+    if (!mem)
+        return 0;
+    CMacroTable *table = new (mem) CMacroTable(*this);
+    table->m_formsOffset = sizeof(CMacroTable);
+    table->m_trieOffset = table->m_formsOffset + formsSize;
+    table->m_encodedOffset = table->m_trieOffset + trieSize;
+    if (formsSize > 0)
+        memcpy(mem + table->m_formsOffset, forms.data(), formsSize);
+    memcpy(mem + table->m_trieOffset, trie.data(), trieSize);
+    if (!bytes.empty())
+        memcpy(mem + table->m_encodedOffset, bytes.data(), bytes.size());
+
+    for (c = 0; c < 128; c++) {
+        StdVnChar ch = c;
+        int inLen = sizeof(StdVnChar);
+        int outLen = sizeof(m_encodedAscii[c]) - 1;
+        if (VnConvert(CONV_CHARSET_VNSTANDARD, charset, (UKBYTE *)&ch,
+                      table->m_encodedAscii[c] + 1, &inLen, &outLen) == 0)
+            table->m_encodedAscii[c][0] = outLen;
+        else
+            table->m_encodedAscii[c][0] = 0xFF;
+    }
+    table->m_encodedCharset = charset;
+    return table;
+}
+
+//---------------------------------------------------------------
+const UKBYTE *CMacroTable::encodedText(int idx, VnCaseType form, int charset,
+                                       int &len) const {
+    if (idx < 0 || idx >= m_count || charset != m_encodedCharset)
+        return 0;
+    const UKBYTE *base = (const UKBYTE *)this;
+    const MacroForms *forms = (const MacroForms *)(base + m_formsOffset);
+    if (forms[idx].offset[form] < 0)
+        return 0;
+    len = forms[idx].len[form];
+    return base + m_encodedOffset + forms[idx].offset[form];
+}
+
+//---------------------------------------------------------------
+const UKBYTE *CMacroTable::encodedAscii(StdVnChar ch, int charset,
+                                        int &len) const {
+    if (ch >= 128 || charset != m_encodedCharset)
+        return 0;
+    if (m_encodedAscii[ch][0] == 0xFF)
+        return 0;
+    len = m_encodedAscii[ch][0];
+    return m_encodedAscii[ch] + 1;
+}
+
 //----------------------------------------------------------------------------
 // Read header, if it's present in the file. Get the version of the file
 // If header is absent, go back to the beginning of file and set version to 0
@@ -181,8 +435,7 @@ int CMacroTable::loadFromFile(const char *fname) {
             addItem(line, CONV_CHARSET_VIQR);
     }
     fclose(f);
-    MacCompareStartMem = m_macroMem;
-    qsort(m_table, m_count, sizeof(MacroDef), macCompare);
+    sort();
     // Convert old version
     if (version != UKMACRO_VERSION_UTF8) {
         writeToFile(fname);
@@ -190,6 +443,13 @@ int CMacroTable::loadFromFile(const char *fname) {
     return 1;
 }
 
+//---------------------------------------------------------------
+void CMacroTable::sort() {
+    MacCompareStartMem = m_macroMem;
+    qsort(m_table, m_count, sizeof(MacroDef), macCompare);
+    m_encodedCharset = -1;
+}
+
 //---------------------------------------------------------------
 int CMacroTable::writeToFile(const char *fname) {
     FILE *f;
@@ -210,21 +470,21 @@ int CMacroTable::writeToFp(FILE *f) {
 
     writeHeader(f);
 
-    UKBYTE *p;
+    StdVnChar chars[MAX_MACRO_TEXT_LEN + 1];
     for (int i = 0; i < m_count; i++) {
-        p = (UKBYTE *)m_macroMem + m_table[i].keyOffset;
+        getKey(i, chars, MAX_MACRO_TEXT_LEN + 1);
         inLen = -1;
         maxOutLen = sizeof(key);
         ret = VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_UNIUTF8,
-                        (UKBYTE *)p, (UKBYTE *)key, &inLen, &maxOutLen);
+                        (UKBYTE *)chars, (UKBYTE *)key, &inLen, &maxOutLen);
         if (ret != 0)
             continue;
 
-        p = (UKBYTE *)m_macroMem + m_table[i].textOffset;
+        getText(i, chars, MAX_MACRO_TEXT_LEN + 1);
         inLen = -1;
         maxOutLen = sizeof(text);
-        ret = VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_UNIUTF8, p,
-                        (UKBYTE *)text, &inLen, &maxOutLen);
+        ret = VnConvert(CONV_CHARSET_VNSTANDARD, CONV_CHARSET_UNIUTF8,
+                        (UKBYTE *)chars, (UKBYTE *)text, &inLen, &maxOutLen);
         if (ret != 0)
             continue;
         if (i < m_count - 1)
@@ -238,43 +498,63 @@ int CMacroTable::writeToFp(FILE *f) {
     return 1;
 }
 
+//---------------------------------------------------------------
+// Store the characters packed, returns where they start or -1 if some of
+// them can't be or there is no room
+//---------------------------------------------------------------
+int CMacroTable::addPacked(const StdVnChar *chars) {
+    int len = 0;
+    while (chars[len] != 0)
+        len++;
+    if (m_occupied + len + 1 > m_memSize)
+        return -1;
+
+    int offset = m_occupied;
+    for (int i = 0; i < len; i++) {
+        MacroChar ch = packMacroChar(chars[i]);
+        if (ch == 0)
+            return -1;
+        m_macroMem[offset + i] = ch;
+    }
+    m_macroMem[offset + len] = 0;
+    m_occupied = offset + len + 1;
+    return offset;
+}
+
 //---------------------------------------------------------------
 int CMacroTable::addItem(const void *key, const void *text, int charset) {
+    StdVnChar chars[MAX_MACRO_TEXT_LEN];
     int ret;
     int inLen, maxOutLen;
-    int offset = m_occupied;
-    char *p = m_macroMem + offset;
+    int occupied = m_occupied;
 
     if (m_count >= MAX_MACRO_ITEMS)
         return -1;
 
-    m_table[m_count].keyOffset = offset;
-
     // Convert macro key to VN standard
     inLen = -1; // input is null-terminated
     maxOutLen = MAX_MACRO_KEY_LEN * sizeof(StdVnChar);
-    if (maxOutLen + offset > m_memSize)
-        maxOutLen = m_memSize - offset;
     ret = VnConvert(charset, CONV_CHARSET_VNSTANDARD, (UKBYTE *)key,
-                    (UKBYTE *)p, &inLen, &maxOutLen);
+                    (UKBYTE *)chars, &inLen, &maxOutLen);
     if (ret != 0)
         return -1;
-
-    offset += maxOutLen;
-    p += maxOutLen;
+    m_table[m_count].keyOffset = addPacked(chars);
+    if (m_table[m_count].keyOffset < 0)
+        return -1;
 
     // convert macro text to VN standard
-    m_table[m_count].textOffset = offset;
     inLen = -1; // input is null-terminated
     maxOutLen = MAX_MACRO_TEXT_LEN * sizeof(StdVnChar);
-    if (maxOutLen + offset > m_memSize)
-        maxOutLen = m_memSize - offset;
     ret = VnConvert(charset, CONV_CHARSET_VNSTANDARD, (UKBYTE *)text,
-                    (UKBYTE *)p, &inLen, &maxOutLen);
-    if (ret != 0)
+                    (UKBYTE *)chars, &inLen, &maxOutLen);
+    if (ret == 0)
+        m_table[m_count].textOffset = addPacked(chars);
+    if (ret != 0 || m_table[m_count].textOffset < 0) {
+        m_occupied = occupied;
         return -1;
+    }
 
-    m_occupied = offset + maxOutLen;
+    m_encodedCharset = -1;
     m_count++;
     return (m_count - 1);
 }
@@ -302,18 +582,31 @@ int CMacroTable::addItem(const char *item, int charset) {
 void CMacroTable::resetContent() {
     m_occupied = 0;
     m_count = 0;
+    m_encodedCharset = -1;
+}
+
+//---------------------------------------------------------------
+static int unpackMacroText(const MacroChar *p, StdVnChar *buf, int size) {
+    int len;
+    for (len = 0; p[len] != 0; len++) {
+        if (len + 1 >= size)
+            return -1;
+        buf[len] = unpackMacroChar(p[len]);
+    }
+    buf[len] = 0;
+    return len;
 }
 
 //---------------------------------------------------------------
-const StdVnChar *CMacroTable::getKey(int idx) const {
+int CMacroTable::getKey(int idx, StdVnChar *buf, int size) const {
     if (idx < 0 || idx >= m_count)
-        return 0;
-    return (StdVnChar *)(m_macroMem + m_table[idx].keyOffset);
+        return -1;
+    return unpackMacroText(m_macroMem + m_table[idx].keyOffset, buf, size);
 }
 
 //---------------------------------------------------------------
-const StdVnChar *CMacroTable::getText(int idx) const {
+int CMacroTable::getText(int idx, StdVnChar *buf, int size) const {
     if (idx < 0 || idx >= m_count)
-        return 0;
-    return (StdVnChar *)(m_macroMem + m_table[idx].textOffset);
+        return -1;
+    return unpackMacroText(m_macroMem + m_table[idx].textOffset, buf, size);
 }
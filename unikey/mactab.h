@@ -9,6 +9,7 @@
 
 #include "charset.h"
 #include "keycons.h"
+#include <functional>
 
 #if defined(_WIN32)
 #if defined(UNIKEYHOOK)
@@ -22,39 +23,118 @@
 #define DllImport
 #endif
 
+// Forms of the macro text, by the case of the key typed
+enum VnCaseType {
+    VnCaseNoChange,
+    VnCaseAllCapital,
+    VnCaseAllSmall,
+    VnCaseTotal
+};
+
+// Keys and texts are kept in 16 bits a character. The Vietnamese letters,
+// past the BMP as StdVnChar, take the code points of the surrogates, which
+// a macro can't hold as themselves
+typedef UKWORD MacroChar;
+#define MACRO_VN_BASE 0xD800
+
+// as many characters as the table held at 32 bits each
+#define MACRO_MEM_CHARS (MACRO_MEM_SIZE / sizeof(StdVnChar))
+
 struct MacroDef {
-    int keyOffset;
+    int keyOffset; // in characters of the macro memory
     int textOffset;
 };
 
+// The case forms of a text in the charset of the encoded texts, offsets in
+// their bytes, -1 if the charset can't write the form
+struct MacroForms {
+    int offset[VnCaseTotal];
+    int len[VnCaseTotal];
+};
+
+// keys are at most MAX_MACRO_KEY_LEN - 1 characters
+#define MAX_MACRO_TRIE_NODES ((MAX_MACRO_KEY_LEN - 1) * MAX_MACRO_ITEMS + 1)
+
+// A node of the trie of the keys spelled backwards, letters in lower case
+struct MacroTrieNode {
+    MacroChar ch;
+    short child;   // first node one character further back, -1 if none
+    short sibling; // next node after the same characters, -1 if none
+    short item;    // macro of the key that starts here, -1 if none
+};
+
+static_assert(MAX_MACRO_TRIE_NODES <= 0x8000 && MAX_MACRO_ITEMS <= 0x8000,
+              "trie nodes and items must fit in a short");
+
 #if !defined(WIN32)
 typedef char TCHAR;
 #endif
 
 class DllInterface CMacroTable {
 public:
+    CMacroTable() = default;
+    // copies the keys and the texts, not their encoding
+    CMacroTable(const CMacroTable &other);
+    CMacroTable &operator=(const CMacroTable &other);
+
     void init();
     int loadFromFile(const char *fname);
     int writeToFile(const char *fname);
     int writeToFp(FILE *f);
 
     const StdVnChar *lookup(StdVnChar *key);
-    const StdVnChar *getKey(int idx) const;
-    const StdVnChar *getText(int idx) const;
+    bool hasKeyPrefix(const StdVnChar *prefix) const;
+    void keyPrefixRange(const StdVnChar *prefix, int &first, int &last) const;
+    // Walk the keys from their end: start at the root, node 0, and follow
+    // the characters backwards. Returns -1 when no key ends with them, or
+    // the table is not compiled
+    int suffixNext(int node, StdVnChar ch) const;
+    // macro of the key the walk has spelled out, or -1
+    int suffixItem(int node) const { return trie()[node].item; }
+    // The key or the text unpacked into buf, which has room for size
+    // characters with the null. Returns the length, -1 if there is no item
+    // or no room
+    int getKey(int idx, StdVnChar *buf, int size) const;
+    int getText(int idx, StdVnChar *buf, int size) const;
+    // Copy the table to the memory alloc gives for the size it asks, with
+    // the trie of the keys and the case forms of all the texts encoded for
+    // the charset after it, so that the copy can be read only from then on.
+    // Null if alloc gives none
+    const CMacroTable *
+    compile(int charset, const std::function<void *(size_t)> &alloc) const;
+    int encodedCharset() const { return m_encodedCharset; }
+    // The text in the case form, as the charset writes it, null if the
+    // texts are not encoded for the charset
+    const UKBYTE *encodedText(int idx, VnCaseType form, int charset,
+                              int &len) const;
+    // the same for a character of ASCII
+    const UKBYTE *encodedAscii(StdVnChar ch, int charset, int &len) const;
     int getCount() const { return m_count; }
     void resetContent();
     int addItem(const char *item, int charset);
     int addItem(const void *key, const void *text, int charset);
+    // Sort the items added by key, lookups need it
+    void sort();
 
 protected:
     bool readHeader(FILE *f, int &version);
     void writeHeader(FILE *f);
+    const MacroTrieNode *trie() const {
+        return (const MacroTrieNode *)((const UKBYTE *)this + m_trieOffset);
+    }
+    int addPacked(const StdVnChar *chars);
 
     MacroDef m_table[MAX_MACRO_ITEMS];
-    char m_macroMem[MACRO_MEM_SIZE];
+    MacroChar m_macroMem[MACRO_MEM_CHARS];
 
     int m_count;
     int m_memSize, m_occupied;
+
+    // In bytes from the table, what follows the copy compile() makes: the
+    // MacroForms of each item, the trie, then the bytes of the forms
+    int m_formsOffset, m_trieOffset, m_encodedOffset;
+    UKBYTE m_encodedAscii[128][8]; // the length first
+    int m_encodedCharset;          // -1 if the texts are not encoded
 };
 
 #endif
@@ -0,0 +1,268 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "asciirun.h"
+#include "charset.h"
+#include <map>
+#include <mutex>
+#include <string.h>
+
+// Combining marks of Vietnamese letters, in the order NFD puts them: by
+// combining class, the diacritic before the tone among those above
+enum VnMark {
+    vnm_horn,
+    vnm_dotBelow,
+    vnm_circumflex,
+    vnm_breve,
+    vnm_grave,
+    vnm_acute,
+    vnm_tilde,
+    vnm_hookAbove,
+    vnm_total
+};
+
+static const UnicodeChar VnMarkChars[vnm_total] = {
+    0x031B, 0x0323, 0x0302, 0x0306, 0x0300, 0x0301, 0x0303, 0x0309};
+
+// Marks of the tones, in the order of the tables
+static const int VnToneMarks[6] = {
+    -1, vnm_acute, vnm_grave, vnm_hookAbove, vnm_tilde, vnm_dotBelow};
+
+// Letters that carry a diacritic, with their base letter
+static const struct {
+    UnicodeChar ch;
+    UnicodeChar base;
+    int mark;
+} VnShapedLetters[] = {
+    {0x00C2, 'A', vnm_circumflex}, {0x00E2, 'a', vnm_circumflex},
+    {0x0102, 'A', vnm_breve},      {0x0103, 'a', vnm_breve},
+    {0x00CA, 'E', vnm_circumflex}, {0x00EA, 'e', vnm_circumflex},
+    {0x00D4, 'O', vnm_circumflex}, {0x00F4, 'o', vnm_circumflex},
+    {0x01A0, 'O', vnm_horn},       {0x01A1, 'o', vnm_horn},
+    {0x01AF, 'U', vnm_horn},       {0x01B0, 'u', vnm_horn},
+};
+
+#define VN_NORM_LOW_END 0x01B1    // letters below, then
+#define VN_NORM_HIGH_START 0x1EA0 // letters from here
+#define VN_NORM_HIGH_END 0x1EFA   // to here
+#define VN_NORM_MAX_OUT 7         // longest letter written, with its length
+
+// Letter index of the characters that are Vietnamese letters, or -1
+static short VnLowLetters[VN_NORM_LOW_END];
+static short VnHighLetters[VN_NORM_HIGH_END - VN_NORM_HIGH_START];
+// The letter with a mark added, or -1
+static short VnComposeTable[TOTAL_ALPHA_VNCHARS][vnm_total];
+// UTF-8 of each letter, its length first
+static UKBYTE VnNfcTable[TOTAL_ALPHA_VNCHARS][VN_NORM_MAX_OUT + 1];
+static UKBYTE VnNfdTable[TOTAL_ALPHA_VNCHARS][VN_NORM_MAX_OUT + 1];
+static std::once_flag normInitFlag;
+
+//--------------------------------------------
+static int putUtf8(UKBYTE *p, UnicodeChar ch) {
+    if (ch < 0x80) {
+        p[0] = (UKBYTE)ch;
+        return 1;
+    }
+    if (ch < 0x800) {
+        p[0] = 0xC0 | (ch >> 6);
+        p[1] = 0x80 | (ch & 0x3F);
+        return 2;
+    }
+    p[0] = 0xE0 | (ch >> 12);
+    p[1] = 0x80 | ((ch >> 6) & 0x3F);
+    p[2] = 0x80 | (ch & 0x3F);
+    return 3;
+}
+
+//--------------------------------------------
+static void normClassInit() {
+    std::map<UKDWORD, int> byMarks; // base << 16 | marks -> letter
+    UnicodeChar base[TOTAL_ALPHA_VNCHARS];
+    int marks[TOTAL_ALPHA_VNCHARS];
+    int k, m;
+
+    memset(VnLowLetters, 0xFF, sizeof(VnLowLetters));
+    memset(VnHighLetters, 0xFF, sizeof(VnHighLetters));
+    memset(VnComposeTable, 0xFF, sizeof(VnComposeTable));
+
+    for (k = 0; k < TOTAL_ALPHA_VNCHARS; k++) {
+        UnicodeChar ch = UnicodeTable[k];
+        if (ch < VN_NORM_LOW_END)
+            VnLowLetters[ch] = k;
+        else if (ch >= VN_NORM_HIGH_START && ch < VN_NORM_HIGH_END)
+            VnHighLetters[ch - VN_NORM_HIGH_START] = k;
+        VnNfcTable[k][0] = putUtf8(VnNfcTable[k] + 1, ch);
+
+        int tone = (k - StdVnNoTone[k]) / 2;
+        base[k] = UnicodeTable[StdVnNoTone[k]];
+        marks[k] = tone ? 1 << VnToneMarks[tone] : 0;
+        for (const auto &shaped : VnShapedLetters) {
+            if (shaped.ch == base[k]) {
+                base[k] = shaped.base;
+                marks[k] |= 1 << shaped.mark;
+            }
+        }
+        byMarks[(base[k] << 16) | marks[k]] = k;
+
+        UKBYTE *p = VnNfdTable[k] + 1;
+        p += putUtf8(p, base[k]);
+        for (m = 0; m < vnm_total; m++) {
+            if (marks[k] & (1 << m))
+                p += putUtf8(p, VnMarkChars[m]);
+        }
+        VnNfdTable[k][0] = p - VnNfdTable[k] - 1;
+    }
+
+    // each letter with a mark is the letter without it, composed with it
+    for (k = 0; k < TOTAL_ALPHA_VNCHARS; k++) {
+        for (m = 0; m < vnm_total; m++) {
+            if (!(marks[k] & (1 << m)))
+                continue;
+            auto it = byMarks.find((base[k] << 16) | (marks[k] & ~(1 << m)));
+            if (it != byMarks.end())
+                VnComposeTable[it->second][m] = k;
+        }
+    }
+}
+
+//--------------------------------------------
+static inline int vnLetterOf(UnicodeChar ch) {
+    if (ch < VN_NORM_LOW_END)
+        return VnLowLetters[ch];
+    if (ch >= VN_NORM_HIGH_START && ch < VN_NORM_HIGH_END)
+        return VnHighLetters[ch - VN_NORM_HIGH_START];
+    return -1;
+}
+
+//--------------------------------------------
+static inline int vnMarkOf(UnicodeChar ch) {
+    switch (ch) {
+    case 0x031B:
+        return vnm_horn;
+    case 0x0323:
+        return vnm_dotBelow;
+    case 0x0302:
+        return vnm_circumflex;
+    case 0x0306:
+        return vnm_breve;
+    case 0x0300:
+    case 0x0340: // grave tone mark
+        return vnm_grave;
+    case 0x0301:
+    case 0x0341: // acute tone mark
+        return vnm_acute;
+    case 0x0303:
+        return vnm_tilde;
+    case 0x0309:
+        return vnm_hookAbove;
+    }
+    return -1;
+}
+
+//--------------------------------------------
+// Reads the character at p, returns its length, 1 for a broken sequence
+//--------------------------------------------
+static inline int getUtf8(const UKBYTE *p, int left, UnicodeChar &ch) {
+    UKBYTE b = p[0];
+    if (b >= 0xC2 && b < 0xE0 && left >= 2 && (p[1] & 0xC0) == 0x80) {
+        ch = ((b & 0x1F) << 6) | (p[1] & 0x3F);
+        return 2;
+    }
+    if (b >= 0xE0 && b < 0xF0 && left >= 3 && (p[1] & 0xC0) == 0x80 &&
+        (p[2] & 0xC0) == 0x80) {
+        ch = ((b & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        return 3;
+    }
+    ch = 0xFFFF; // nothing we know
+    return 1;
+}
+
+//--------------------------------------------
+// A letter is held until the marks after it are added to it, then written
+// in the form of the table
+//--------------------------------------------
+static void normalizeUtf8(const UKBYTE *input, int len, SpanBOStream &os,
+                          const UKBYTE (*table)[VN_NORM_MAX_OUT + 1]) {
+    int i = 0, n, mark, next;
+    int letter = -1;
+    UnicodeChar ch;
+
+    while (i < len) {
+        n = (int)VnAsciiRunLength(input + i, len - i, 0);
+        if (n > 0) {
+            if (letter >= 0)
+                os.puts((const char *)table[letter] + 1, table[letter][0]);
+            // marks may follow the last byte
+            letter = vnLetterOf(input[i + n - 1]);
+            os.puts((const char *)input + i, (letter >= 0) ? n - 1 : n);
+            i += n;
+            continue;
+        }
+
+        n = getUtf8(input + i, len - i, ch);
+        if (letter >= 0 && (mark = vnMarkOf(ch)) >= 0 &&
+            (next = VnComposeTable[letter][mark]) >= 0) {
+            letter = next;
+            i += n;
+            continue;
+        }
+
+        if (letter >= 0)
+            os.puts((const char *)table[letter] + 1, table[letter][0]);
+        letter = vnLetterOf(ch);
+        if (letter < 0)
+            os.puts((const char *)input + i, n);
+        i += n;
+    }
+    if (letter >= 0)
+        os.puts((const char *)table[letter] + 1, table[letter][0]);
+}
+
+//--------------------------------------------
+// Arguments:
+//       form: VN_NORM_NFC or VN_NORM_NFD
+//       inLen: size of input, -1 if it is null-terminated
+//       maxOutLen: [in]  size of output
+//                  [out] number of bytes output, if enough memory
+//                        number of bytes needed for output, if not enough
+//                        memory
+// Returns: 0 if successful
+//          error code: if failed
+//--------------------------------------------
+DllExport int VnNormalizeUtf8(int form, const UKBYTE *input, int inLen,
+                              UKBYTE *output, int *pMaxOutLen) {
+    if (inLen == -1)
+        inLen = strlen((const char *)input) + 1;
+    if (inLen < 0 || (form != VN_NORM_NFC && form != VN_NORM_NFD))
+        return -1;
+    std::call_once(normInitFlag, normClassInit);
+
+    SpanBOStream os(output, *pMaxOutLen);
+    normalizeUtf8(input, inLen, os,
+                  (form == VN_NORM_NFC) ? VnNfcTable : VnNfdTable);
+    *pMaxOutLen = os.getOutBytes();
+    return os.isOK() ? 0 : VNCONV_OUT_OF_MEMORY;
+}
+
+//--------------------------------------------
+int VnLetterOfUnicode(unsigned int ch) {
+    if (ch > 0xFFFF)
+        return -1;
+    std::call_once(normInitFlag, normClassInit);
+    return vnLetterOf(ch);
+}
+
+//--------------------------------------------
+std::string VnNormalizeUtf8String(std::string_view text, int form) {
+    std::string output;
+    int outLen = text.size() * 3 + 1;
+    output.resize(outLen);
+    if (VnNormalizeUtf8(form, (const UKBYTE *)text.data(), text.size(),
+                        (UKBYTE *)output.data(), &outLen) != 0)
+        return std::string(text);
+    output.resize(outLen);
+    return output;
+}
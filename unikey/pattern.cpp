@@ -5,76 +5,81 @@
  */
 
 #include "pattern.h"
+#include <string.h>
 
 //////////////////////////////////////////////////
-// Pattern matching (based on KPM algorithm)
+// Pattern matching (Aho-Corasick algorithm)
 //////////////////////////////////////////////////
 
-//----------------------------
-void PatternState::reset() {
-    m_pos = 0;
-    m_found = 0;
-}
-
-//----------------------------
-void PatternState::init(char *pattern) {
-    m_pos = 0;
-    m_found = 0;
-    m_pattern = pattern;
-
-    int i = 0, j = -1;
-    m_border[i] = j;
-    while (m_pattern[i]) {
-        while (j >= 0 && m_pattern[i] != m_pattern[j])
-            j = m_border[j];
-        i++;
-        j++;
-        m_border[i] = j;
-    }
-}
-
-//-----------------------------------------------------
-// get next input char, returns 1 if pattern is found.
 //-----------------------------------------------------
-int PatternState::foundAtNextChar(char ch) {
-    int ret = 0;
-    // int j = m_pos;
-    while (m_pos >= 0 && ch != m_pattern[m_pos])
-        m_pos = m_border[m_pos];
-    m_pos++;
-    if (m_pattern[m_pos] == 0) {
-        m_found++;
-        m_pos = m_border[m_pos];
-        ret = 1;
-    }
-    return ret;
+void PatternList::init(const char *const *patterns, int count) {
+    m_patterns.clear();
+    for (int i = 0; i < count; i++)
+        m_patterns.push_back(patterns[i]);
+    build();
 }
 
 //-----------------------------------------------------
-void PatternList::init(char **patterns, int count) {
-    m_count = count;
-    delete[] m_patterns;
-    m_patterns = new PatternState[count];
-    for (int i = 0; i < count; i++)
-        m_patterns[i].init(patterns[i]);
+// Patterns can't be empty, longer than MAX_PATTERN_LEN or contain
+// a line feed, which is where converters start afresh.
+// Returns 0 if successful
+//-----------------------------------------------------
+int PatternList::addPattern(const char *pattern) {
+    size_t len = strlen(pattern);
+    if (len == 0 || len > MAX_PATTERN_LEN || memchr(pattern, '\n', len))
+        return -1;
+    m_patterns.push_back(pattern);
+    build();
+    return 0;
 }
 
 //-----------------------------------------------------
-// return the order number of the pattern that is found.
-// If more than 1 pattern is found, returns any pattern
-// Returns -1 if no pattern is found
+// Builds the full transition table: a trie of the patterns, with
+// the missing transitions taken from the longest proper suffix that
+// is also in the trie
 //-----------------------------------------------------
-int PatternList::foundAtNextChar(char ch) {
-    int patternFound = -1;
-    for (int i = 0; i < m_count; i++) {
-        if (m_patterns[i].foundAtNextChar(ch))
-            patternFound = i;
+void PatternList::build() {
+    std::vector<int> fail(1, 0);
+    int states = 1;
+    int i, ch;
+
+    m_next.assign(256, 0);
+    m_found.assign(1, -1);
+
+    // trie, missing transitions are marked by 0 for now
+    for (i = 0; i < (int)m_patterns.size(); i++) {
+        int state = 0;
+        for (unsigned char c : m_patterns[i]) {
+            if (m_next[state * 256 + c] == 0) {
+                m_next[state * 256 + c] = states++;
+                m_next.resize(states * 256, 0);
+                m_found.push_back(-1);
+                fail.push_back(0);
+            }
+            state = m_next[state * 256 + c];
+        }
+        m_found[state] = i;
     }
-    return patternFound;
-}
 
-//-----------------------------------------------------
-void PatternList::reset() {
-    for (int i = 0; i < m_count; i++)
-        m_patterns[i].reset();
+    // breadth first, so that the suffix of each state is complete
+    // before the state is reached
+    std::vector<int> queue;
+    for (ch = 0; ch < 256; ch++) {
+        if (m_next[ch])
+            queue.push_back(m_next[ch]);
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+        int state = queue[head];
+        if (m_found[fail[state]] > m_found[state])
+            m_found[state] = m_found[fail[state]];
+        for (ch = 0; ch < 256; ch++) {
+            int &next = m_next[state * 256 + ch];
+            if (next) {
+                fail[next] = m_next[fail[state] * 256 + ch];
+                queue.push_back(next);
+            } else {
+                next = m_next[fail[state] * 256 + ch];
+            }
+        }
+    }
 }
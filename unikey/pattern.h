@@ -6,6 +6,9 @@
 #ifndef __PATTERN_H
 #define __PATTERN_H
 
+#include <string>
+#include <vector>
+
 #if defined(_WIN32)
 #if defined(UNIKEYHOOK)
 #define DllInterface __declspec(dllexport)
@@ -18,35 +21,31 @@
 
 #define MAX_PATTERN_LEN 40
 
-class DllInterface PatternState {
-public:
-    char *m_pattern;
-    int m_border[MAX_PATTERN_LEN + 1];
-    int m_pos;
-    int m_found;
-    void init(char *pattern);
-    void reset();
-    int foundAtNextChar(
-        char ch); // get next input char, returns 1 if pattern is found.
-};
-
+//----------------------------------------------------------
+// Matches a set of patterns at once (Aho-Corasick automaton).
+// The automaton itself is read-only once built, the matching
+// state is an int kept by the caller, 0 being the initial state.
+//----------------------------------------------------------
 class DllInterface PatternList {
 public:
-    PatternState *m_patterns;
-    int m_count;
-    void init(char **patterns, int count);
-    int foundAtNextChar(char ch);
-    void reset();
-
-    PatternList() {
-        m_count = 0;
-        m_patterns = 0;
-    }
+    void init(const char *const *patterns, int count);
+    int addPattern(const char *pattern);
+    int count() const { return m_patterns.size(); }
 
-    ~PatternList() {
-        if (m_patterns)
-            delete[] m_patterns;
+    // get next input char, returns the order number of the pattern
+    // that is found, -1 if none
+    int foundAtNextChar(int &state, unsigned char ch) const {
+        state = m_next[state * 256 + ch];
+        return m_found[state];
     }
+
+    PatternList() { build(); }
+
+protected:
+    std::vector<std::string> m_patterns;
+    std::vector<int> m_next;  // transitions, 256 per state
+    std::vector<int> m_found; // pattern ending at each state, or -1
+    void build();
 };
 
 #endif
@@ -0,0 +1,49 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "sharedseg.h"
+#include <sys/mman.h>
+#include <utility>
+
+//--------------------------------------------
+UkSharedSegment::UkSharedSegment(UkSharedSegment &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+//--------------------------------------------
+UkSharedSegment &UkSharedSegment::operator=(UkSharedSegment &&other) noexcept {
+    if (this != &other) {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+//--------------------------------------------
+void UkSharedSegment::release() {
+    if (m_data)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+//--------------------------------------------
+void *UkSharedSegment::create(size_t size) {
+    release();
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    m_data = p;
+    m_size = size;
+    return p;
+}
+
+//--------------------------------------------
+bool UkSharedSegment::seal() {
+    return m_data && mprotect(m_data, m_size, PROT_READ) == 0;
+}
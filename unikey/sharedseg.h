@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#ifndef __UK_SHARED_SEGMENT_H
+#define __UK_SHARED_SEGMENT_H
+
+#include <stddef.h>
+
+// Memory that is written once, then sealed read only. What it holds is
+// shared by the engines of an input method, which can't change it by
+// mistake
+class UkSharedSegment {
+public:
+    UkSharedSegment() = default;
+    UkSharedSegment(const UkSharedSegment &) = delete;
+    UkSharedSegment &operator=(const UkSharedSegment &) = delete;
+    UkSharedSegment(UkSharedSegment &&other) noexcept;
+    UkSharedSegment &operator=(UkSharedSegment &&other) noexcept;
+    ~UkSharedSegment() { release(); }
+
+    // Map size bytes to fill, null on failure
+    void *create(size_t size);
+    // Make the segment read only
+    bool seal();
+    void release();
+
+    const void *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif
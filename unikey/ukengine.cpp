@@ -5,11 +5,13 @@
  */
 
 #include "keycons.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
-#include <mutex>
 #include <stdlib.h>
 #include <string.h>
 #include <unordered_map>
+#include <utility>
 
 /*
 #if defined(_WIN32)
@@ -35,18 +37,43 @@ using namespace std;
     ((x) >= VnStdCharOffset &&                                                 \
      (x) < (VnStdCharOffset + TOTAL_ALPHA_VNCHARS) && IS_EVEN(x))
 
-bool IsVnVowel[vnl_lastChar];
+// The tables below are built when compiling and lie in read only memory
 
-extern VnLexiName AZLexiUpper[]; // defined in inputproc.cpp
-extern VnLexiName AZLexiLower[];
+static constexpr std::array<bool, vnl_lastChar> IsVnVowel = [] {
+    std::array<bool, vnl_lastChar> vowel{};
+    vowel.fill(true);
+    for (int i = 0; i < 26; i++) {
+        char ch = 'a' + i;
+        if (ch != 'a' && ch != 'e' && ch != 'i' && ch != 'o' && ch != 'u' &&
+            ch != 'y') {
+            vowel[AZLexiLower[i]] = false;
+            vowel[AZLexiUpper[i]] = false;
+        }
+    }
+    vowel[vnl_dd] = false;
+    vowel[vnl_DD] = false;
+    return vowel;
+}();
 
 // see vnconv/data.cpp for explanation of these characters
-unsigned char SpecialWesternChars[] = {
+constexpr unsigned char SpecialWesternChars[] = {
     0x80, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A,
     0x8B, 0x8C, 0x8E, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
     0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9E, 0x9F, 0x00};
 
-StdVnChar IsoStdVnCharMap[256];
+static constexpr std::array<StdVnChar, 256> IsoStdVnCharMap = [] {
+    std::array<StdVnChar, 256> map{};
+    int i;
+    for (i = 0; i < 256; i++)
+        map[i] = i;
+    for (i = 0; SpecialWesternChars[i]; i++)
+        map[SpecialWesternChars[i]] = (vnl_lastChar + i) + VnStdCharOffset;
+    for (i = 0; i < 256; i++) {
+        if (IsoVnLexiMap[i] != vnl_nonVnChar)
+            map[i] = IsoVnLexiMap[i] + VnStdCharOffset;
+    }
+    return map;
+}();
 
 inline StdVnChar IsoToStdVnChar(int keyCode) {
     return (keyCode < 256) ? IsoStdVnCharMap[keyCode] : keyCode;
@@ -66,636 +93,636 @@ struct VowelSeqInfo {
     VowelSeq withHook; // hook & bowl
 };
 
-VowelSeqInfo VSeqList[] = {{1,
-                            1,
-                            1,
-                            {vnl_a, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_a, vs_nil, vs_nil},
-                            -1,
-                            vs_ar,
-                            -1,
-                            vs_ab},
-                           {1,
-                            1,
-                            1,
-                            {vnl_ar, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_ar, vs_nil, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_ab},
-                           {1,
-                            1,
-                            1,
-                            {vnl_ab, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_ab, vs_nil, vs_nil},
-                            -1,
-                            vs_ar,
-                            0,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_e, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_e, vs_nil, vs_nil},
-                            -1,
-                            vs_er,
-                            -1,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_er, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_er, vs_nil, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_i, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_i, vs_nil, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_o, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_o, vs_nil, vs_nil},
-                            -1,
-                            vs_or,
-                            -1,
-                            vs_oh},
-                           {1,
-                            1,
-                            1,
-                            {vnl_or, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_or, vs_nil, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_oh},
-                           {1,
-                            1,
-                            1,
-                            {vnl_oh, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_oh, vs_nil, vs_nil},
-                            -1,
-                            vs_or,
-                            0,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_u, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_u, vs_nil, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_uh},
-                           {1,
-                            1,
-                            1,
-                            {vnl_uh, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_uh, vs_nil, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {1,
-                            1,
-                            1,
-                            {vnl_y, vnl_nonVnChar, vnl_nonVnChar},
-                            {vs_y, vs_nil, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_a, vnl_i, vnl_nonVnChar},
-                            {vs_a, vs_ai, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_a, vnl_o, vnl_nonVnChar},
-                            {vs_a, vs_ao, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_a, vnl_u, vnl_nonVnChar},
-                            {vs_a, vs_au, vs_nil},
-                            -1,
-                            vs_aru,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_a, vnl_y, vnl_nonVnChar},
-                            {vs_a, vs_ay, vs_nil},
-                            -1,
-                            vs_ary,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_ar, vnl_u, vnl_nonVnChar},
-                            {vs_ar, vs_aru, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_ar, vnl_y, vnl_nonVnChar},
-                            {vs_ar, vs_ary, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_e, vnl_o, vnl_nonVnChar},
-                            {vs_e, vs_eo, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            0,
-                            0,
-                            {vnl_e, vnl_u, vnl_nonVnChar},
-                            {vs_e, vs_eu, vs_nil},
-                            -1,
-                            vs_eru,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_er, vnl_u, vnl_nonVnChar},
-                            {vs_er, vs_eru, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_i, vnl_a, vnl_nonVnChar},
-                            {vs_i, vs_ia, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            0,
-                            1,
-                            {vnl_i, vnl_e, vnl_nonVnChar},
-                            {vs_i, vs_ie, vs_nil},
-                            -1,
-                            vs_ier,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_i, vnl_er, vnl_nonVnChar},
-                            {vs_i, vs_ier, vs_nil},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_i, vnl_u, vnl_nonVnChar},
-                            {vs_i, vs_iu, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_o, vnl_a, vnl_nonVnChar},
-                            {vs_o, vs_oa, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_oab},
-                           {2,
-                            1,
-                            1,
-                            {vnl_o, vnl_ab, vnl_nonVnChar},
-                            {vs_o, vs_oab, vs_nil},
-                            -1,
-                            vs_nil,
-                            1,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_o, vnl_e, vnl_nonVnChar},
-                            {vs_o, vs_oe, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_o, vnl_i, vnl_nonVnChar},
-                            {vs_o, vs_oi, vs_nil},
-                            -1,
-                            vs_ori,
-                            -1,
-                            vs_ohi},
-                           {2,
-                            1,
-                            0,
-                            {vnl_or, vnl_i, vnl_nonVnChar},
-                            {vs_or, vs_ori, vs_nil},
-                            0,
-                            vs_nil,
-                            -1,
-                            vs_ohi},
-                           {2,
-                            1,
-                            0,
-                            {vnl_oh, vnl_i, vnl_nonVnChar},
-                            {vs_oh, vs_ohi, vs_nil},
-                            -1,
-                            vs_ori,
-                            0,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_a, vnl_nonVnChar},
-                            {vs_u, vs_ua, vs_nil},
-                            -1,
-                            vs_uar,
-                            -1,
-                            vs_uha},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_ar, vnl_nonVnChar},
-                            {vs_u, vs_uar, vs_nil},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            0,
-                            1,
-                            {vnl_u, vnl_e, vnl_nonVnChar},
-                            {vs_u, vs_ue, vs_nil},
-                            -1,
-                            vs_uer,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_er, vnl_nonVnChar},
-                            {vs_u, vs_uer, vs_nil},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_u, vnl_i, vnl_nonVnChar},
-                            {vs_u, vs_ui, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_uhi},
-                           {2,
-                            0,
-                            1,
-                            {vnl_u, vnl_o, vnl_nonVnChar},
-                            {vs_u, vs_uo, vs_nil},
-                            -1,
-                            vs_uor,
-                            -1,
-                            vs_uho},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_or, vnl_nonVnChar},
-                            {vs_u, vs_uor, vs_nil},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_uoh},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_oh, vnl_nonVnChar},
-                            {vs_u, vs_uoh, vs_nil},
-                            -1,
-                            vs_uor,
-                            1,
-                            vs_uhoh},
-                           {2,
-                            0,
-                            0,
-                            {vnl_u, vnl_u, vnl_nonVnChar},
-                            {vs_u, vs_uu, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_uhu},
-                           {2,
-                            1,
-                            1,
-                            {vnl_u, vnl_y, vnl_nonVnChar},
-                            {vs_u, vs_uy, vs_nil},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_uh, vnl_a, vnl_nonVnChar},
-                            {vs_uh, vs_uha, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_uh, vnl_i, vnl_nonVnChar},
-                            {vs_uh, vs_uhi, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {2,
-                            0,
-                            1,
-                            {vnl_uh, vnl_o, vnl_nonVnChar},
-                            {vs_uh, vs_uho, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_uhoh},
-                           {2,
-                            1,
-                            1,
-                            {vnl_uh, vnl_oh, vnl_nonVnChar},
-                            {vs_uh, vs_uhoh, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {2,
-                            1,
-                            0,
-                            {vnl_uh, vnl_u, vnl_nonVnChar},
-                            {vs_uh, vs_uhu, vs_nil},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {2,
-                            0,
-                            1,
-                            {vnl_y, vnl_e, vnl_nonVnChar},
-                            {vs_y, vs_ye, vs_nil},
-                            -1,
-                            vs_yer,
-                            -1,
-                            vs_nil},
-                           {2,
-                            1,
-                            1,
-                            {vnl_y, vnl_er, vnl_nonVnChar},
-                            {vs_y, vs_yer, vs_nil},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            0,
-                            0,
-                            {vnl_i, vnl_e, vnl_u},
-                            {vs_i, vs_ie, vs_ieu},
-                            -1,
-                            vs_ieru,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_i, vnl_er, vnl_u},
-                            {vs_i, vs_ier, vs_ieru},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_o, vnl_a, vnl_i},
-                            {vs_o, vs_oa, vs_oai},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_o, vnl_a, vnl_y},
-                            {vs_o, vs_oa, vs_oay},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_o, vnl_e, vnl_o},
-                            {vs_o, vs_oe, vs_oeo},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            0,
-                            0,
-                            {vnl_u, vnl_a, vnl_y},
-                            {vs_u, vs_ua, vs_uay},
-                            -1,
-                            vs_uary,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_u, vnl_ar, vnl_y},
-                            {vs_u, vs_uar, vs_uary},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            0,
-                            0,
-                            {vnl_u, vnl_o, vnl_i},
-                            {vs_u, vs_uo, vs_uoi},
-                            -1,
-                            vs_uori,
-                            -1,
-                            vs_uhoi},
-                           {3,
-                            0,
-                            0,
-                            {vnl_u, vnl_o, vnl_u},
-                            {vs_u, vs_uo, vs_uou},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_uhou},
-                           {3,
-                            1,
-                            0,
-                            {vnl_u, vnl_or, vnl_i},
-                            {vs_u, vs_uor, vs_uori},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_uohi},
-                           {3,
-                            0,
-                            0,
-                            {vnl_u, vnl_oh, vnl_i},
-                            {vs_u, vs_uoh, vs_uohi},
-                            -1,
-                            vs_uori,
-                            1,
-                            vs_uhohi},
-                           {3,
-                            0,
-                            0,
-                            {vnl_u, vnl_oh, vnl_u},
-                            {vs_u, vs_uoh, vs_uohu},
-                            -1,
-                            vs_nil,
-                            1,
-                            vs_uhohu},
-                           {3,
-                            1,
-                            0,
-                            {vnl_u, vnl_y, vnl_a},
-                            {vs_u, vs_uy, vs_uya},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            0,
-                            1,
-                            {vnl_u, vnl_y, vnl_e},
-                            {vs_u, vs_uy, vs_uye},
-                            -1,
-                            vs_uyer,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            1,
-                            {vnl_u, vnl_y, vnl_er},
-                            {vs_u, vs_uy, vs_uyer},
-                            2,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_u, vnl_y, vnl_u},
-                            {vs_u, vs_uy, vs_uyu},
-                            -1,
-                            vs_nil,
-                            -1,
-                            vs_nil},
-                           {3,
-                            0,
-                            0,
-                            {vnl_uh, vnl_o, vnl_i},
-                            {vs_uh, vs_uho, vs_uhoi},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_uhohi},
-                           {3,
-                            0,
-                            0,
-                            {vnl_uh, vnl_o, vnl_u},
-                            {vs_uh, vs_uho, vs_uhou},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_uhohu},
-                           {3,
-                            1,
-                            0,
-                            {vnl_uh, vnl_oh, vnl_i},
-                            {vs_uh, vs_uhoh, vs_uhohi},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_uh, vnl_oh, vnl_u},
-                            {vs_uh, vs_uhoh, vs_uhohu},
-                            -1,
-                            vs_nil,
-                            0,
-                            vs_nil},
-                           {3,
-                            0,
-                            0,
-                            {vnl_y, vnl_e, vnl_u},
-                            {vs_y, vs_ye, vs_yeu},
-                            -1,
-                            vs_yeru,
-                            -1,
-                            vs_nil},
-                           {3,
-                            1,
-                            0,
-                            {vnl_y, vnl_er, vnl_u},
-                            {vs_y, vs_yer, vs_yeru},
-                            1,
-                            vs_nil,
-                            -1,
-                            vs_nil}};
+constexpr VowelSeqInfo VSeqList[] = {{1,
+                                      1,
+                                      1,
+                                      {vnl_a, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_a, vs_nil, vs_nil},
+                                      -1,
+                                      vs_ar,
+                                      -1,
+                                      vs_ab},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_ar, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_ar, vs_nil, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_ab},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_ab, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_ab, vs_nil, vs_nil},
+                                      -1,
+                                      vs_ar,
+                                      0,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_e, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_e, vs_nil, vs_nil},
+                                      -1,
+                                      vs_er,
+                                      -1,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_er, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_er, vs_nil, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_i, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_i, vs_nil, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_o, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_o, vs_nil, vs_nil},
+                                      -1,
+                                      vs_or,
+                                      -1,
+                                      vs_oh},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_or, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_or, vs_nil, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_oh},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_oh, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_oh, vs_nil, vs_nil},
+                                      -1,
+                                      vs_or,
+                                      0,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_u, vs_nil, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uh},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_uh, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_uh, vs_nil, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {1,
+                                      1,
+                                      1,
+                                      {vnl_y, vnl_nonVnChar, vnl_nonVnChar},
+                                      {vs_y, vs_nil, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_a, vnl_i, vnl_nonVnChar},
+                                      {vs_a, vs_ai, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_a, vnl_o, vnl_nonVnChar},
+                                      {vs_a, vs_ao, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_a, vnl_u, vnl_nonVnChar},
+                                      {vs_a, vs_au, vs_nil},
+                                      -1,
+                                      vs_aru,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_a, vnl_y, vnl_nonVnChar},
+                                      {vs_a, vs_ay, vs_nil},
+                                      -1,
+                                      vs_ary,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_ar, vnl_u, vnl_nonVnChar},
+                                      {vs_ar, vs_aru, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_ar, vnl_y, vnl_nonVnChar},
+                                      {vs_ar, vs_ary, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_e, vnl_o, vnl_nonVnChar},
+                                      {vs_e, vs_eo, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      0,
+                                      0,
+                                      {vnl_e, vnl_u, vnl_nonVnChar},
+                                      {vs_e, vs_eu, vs_nil},
+                                      -1,
+                                      vs_eru,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_er, vnl_u, vnl_nonVnChar},
+                                      {vs_er, vs_eru, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_i, vnl_a, vnl_nonVnChar},
+                                      {vs_i, vs_ia, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      0,
+                                      1,
+                                      {vnl_i, vnl_e, vnl_nonVnChar},
+                                      {vs_i, vs_ie, vs_nil},
+                                      -1,
+                                      vs_ier,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_i, vnl_er, vnl_nonVnChar},
+                                      {vs_i, vs_ier, vs_nil},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_i, vnl_u, vnl_nonVnChar},
+                                      {vs_i, vs_iu, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_o, vnl_a, vnl_nonVnChar},
+                                      {vs_o, vs_oa, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_oab},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_o, vnl_ab, vnl_nonVnChar},
+                                      {vs_o, vs_oab, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_o, vnl_e, vnl_nonVnChar},
+                                      {vs_o, vs_oe, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_o, vnl_i, vnl_nonVnChar},
+                                      {vs_o, vs_oi, vs_nil},
+                                      -1,
+                                      vs_ori,
+                                      -1,
+                                      vs_ohi},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_or, vnl_i, vnl_nonVnChar},
+                                      {vs_or, vs_ori, vs_nil},
+                                      0,
+                                      vs_nil,
+                                      -1,
+                                      vs_ohi},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_oh, vnl_i, vnl_nonVnChar},
+                                      {vs_oh, vs_ohi, vs_nil},
+                                      -1,
+                                      vs_ori,
+                                      0,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_a, vnl_nonVnChar},
+                                      {vs_u, vs_ua, vs_nil},
+                                      -1,
+                                      vs_uar,
+                                      -1,
+                                      vs_uha},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_ar, vnl_nonVnChar},
+                                      {vs_u, vs_uar, vs_nil},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      0,
+                                      1,
+                                      {vnl_u, vnl_e, vnl_nonVnChar},
+                                      {vs_u, vs_ue, vs_nil},
+                                      -1,
+                                      vs_uer,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_er, vnl_nonVnChar},
+                                      {vs_u, vs_uer, vs_nil},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_u, vnl_i, vnl_nonVnChar},
+                                      {vs_u, vs_ui, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uhi},
+                                     {2,
+                                      0,
+                                      1,
+                                      {vnl_u, vnl_o, vnl_nonVnChar},
+                                      {vs_u, vs_uo, vs_nil},
+                                      -1,
+                                      vs_uor,
+                                      -1,
+                                      vs_uho},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_or, vnl_nonVnChar},
+                                      {vs_u, vs_uor, vs_nil},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uoh},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_oh, vnl_nonVnChar},
+                                      {vs_u, vs_uoh, vs_nil},
+                                      -1,
+                                      vs_uor,
+                                      1,
+                                      vs_uhoh},
+                                     {2,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_u, vnl_nonVnChar},
+                                      {vs_u, vs_uu, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uhu},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_y, vnl_nonVnChar},
+                                      {vs_u, vs_uy, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_uh, vnl_a, vnl_nonVnChar},
+                                      {vs_uh, vs_uha, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_uh, vnl_i, vnl_nonVnChar},
+                                      {vs_uh, vs_uhi, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {2,
+                                      0,
+                                      1,
+                                      {vnl_uh, vnl_o, vnl_nonVnChar},
+                                      {vs_uh, vs_uho, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_uhoh},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_uh, vnl_oh, vnl_nonVnChar},
+                                      {vs_uh, vs_uhoh, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      0,
+                                      {vnl_uh, vnl_u, vnl_nonVnChar},
+                                      {vs_uh, vs_uhu, vs_nil},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {2,
+                                      0,
+                                      1,
+                                      {vnl_y, vnl_e, vnl_nonVnChar},
+                                      {vs_y, vs_ye, vs_nil},
+                                      -1,
+                                      vs_yer,
+                                      -1,
+                                      vs_nil},
+                                     {2,
+                                      1,
+                                      1,
+                                      {vnl_y, vnl_er, vnl_nonVnChar},
+                                      {vs_y, vs_yer, vs_nil},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_i, vnl_e, vnl_u},
+                                      {vs_i, vs_ie, vs_ieu},
+                                      -1,
+                                      vs_ieru,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_i, vnl_er, vnl_u},
+                                      {vs_i, vs_ier, vs_ieru},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_o, vnl_a, vnl_i},
+                                      {vs_o, vs_oa, vs_oai},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_o, vnl_a, vnl_y},
+                                      {vs_o, vs_oa, vs_oay},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_o, vnl_e, vnl_o},
+                                      {vs_o, vs_oe, vs_oeo},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_a, vnl_y},
+                                      {vs_u, vs_ua, vs_uay},
+                                      -1,
+                                      vs_uary,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_u, vnl_ar, vnl_y},
+                                      {vs_u, vs_uar, vs_uary},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_o, vnl_i},
+                                      {vs_u, vs_uo, vs_uoi},
+                                      -1,
+                                      vs_uori,
+                                      -1,
+                                      vs_uhoi},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_o, vnl_u},
+                                      {vs_u, vs_uo, vs_uou},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uhou},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_u, vnl_or, vnl_i},
+                                      {vs_u, vs_uor, vs_uori},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_uohi},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_oh, vnl_i},
+                                      {vs_u, vs_uoh, vs_uohi},
+                                      -1,
+                                      vs_uori,
+                                      1,
+                                      vs_uhohi},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_u, vnl_oh, vnl_u},
+                                      {vs_u, vs_uoh, vs_uohu},
+                                      -1,
+                                      vs_nil,
+                                      1,
+                                      vs_uhohu},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_u, vnl_y, vnl_a},
+                                      {vs_u, vs_uy, vs_uya},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      1,
+                                      {vnl_u, vnl_y, vnl_e},
+                                      {vs_u, vs_uy, vs_uye},
+                                      -1,
+                                      vs_uyer,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      1,
+                                      {vnl_u, vnl_y, vnl_er},
+                                      {vs_u, vs_uy, vs_uyer},
+                                      2,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_u, vnl_y, vnl_u},
+                                      {vs_u, vs_uy, vs_uyu},
+                                      -1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_uh, vnl_o, vnl_i},
+                                      {vs_uh, vs_uho, vs_uhoi},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_uhohi},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_uh, vnl_o, vnl_u},
+                                      {vs_uh, vs_uho, vs_uhou},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_uhohu},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_uh, vnl_oh, vnl_i},
+                                      {vs_uh, vs_uhoh, vs_uhohi},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_uh, vnl_oh, vnl_u},
+                                      {vs_uh, vs_uhoh, vs_uhohu},
+                                      -1,
+                                      vs_nil,
+                                      0,
+                                      vs_nil},
+                                     {3,
+                                      0,
+                                      0,
+                                      {vnl_y, vnl_e, vnl_u},
+                                      {vs_y, vs_ye, vs_yeu},
+                                      -1,
+                                      vs_yeru,
+                                      -1,
+                                      vs_nil},
+                                     {3,
+                                      1,
+                                      0,
+                                      {vnl_y, vnl_er, vnl_u},
+                                      {vs_y, vs_yer, vs_yeru},
+                                      1,
+                                      vs_nil,
+                                      -1,
+                                      vs_nil}};
 
 struct ConSeqInfo {
     int len;
@@ -703,135 +730,168 @@ struct ConSeqInfo {
     bool suffix;
 };
 
-ConSeqInfo CSeqList[] = {{1, {vnl_b, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_c, vnl_nonVnChar, vnl_nonVnChar}, true},
-                         {2, {vnl_c, vnl_h, vnl_nonVnChar}, true},
-                         {1, {vnl_d, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_dd, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {2, {vnl_d, vnl_z, vnl_nonVnChar}, false},
-                         {1, {vnl_g, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {2, {vnl_g, vnl_h, vnl_nonVnChar}, false},
-                         {2, {vnl_g, vnl_i, vnl_nonVnChar}, false},
-                         {3, {vnl_g, vnl_i, vnl_n}, false},
-                         {1, {vnl_h, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_k, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {2, {vnl_k, vnl_h, vnl_nonVnChar}, false},
-                         {1, {vnl_l, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_m, vnl_nonVnChar, vnl_nonVnChar}, true},
-                         {1, {vnl_n, vnl_nonVnChar, vnl_nonVnChar}, true},
-                         {2, {vnl_n, vnl_g, vnl_nonVnChar}, true},
-                         {3, {vnl_n, vnl_g, vnl_h}, false},
-                         {2, {vnl_n, vnl_h, vnl_nonVnChar}, true},
-                         {1, {vnl_p, vnl_nonVnChar, vnl_nonVnChar}, true},
-                         {2, {vnl_p, vnl_h, vnl_nonVnChar}, false},
-                         {1, {vnl_q, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {2, {vnl_q, vnl_u, vnl_nonVnChar}, false},
-                         {1, {vnl_r, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_s, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_t, vnl_nonVnChar, vnl_nonVnChar}, true},
-                         {2, {vnl_t, vnl_h, vnl_nonVnChar}, false},
-                         {2, {vnl_t, vnl_r, vnl_nonVnChar}, false},
-                         {1, {vnl_v, vnl_nonVnChar, vnl_nonVnChar}, false},
-                         {1, {vnl_x, vnl_nonVnChar, vnl_nonVnChar}, false}};
+constexpr ConSeqInfo CSeqList[] = {
+    {1, {vnl_b, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_c, vnl_nonVnChar, vnl_nonVnChar}, true},
+    {2, {vnl_c, vnl_h, vnl_nonVnChar}, true},
+    {1, {vnl_d, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_dd, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {2, {vnl_d, vnl_z, vnl_nonVnChar}, false},
+    {1, {vnl_g, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {2, {vnl_g, vnl_h, vnl_nonVnChar}, false},
+    {2, {vnl_g, vnl_i, vnl_nonVnChar}, false},
+    {3, {vnl_g, vnl_i, vnl_n}, false},
+    {1, {vnl_h, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_k, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {2, {vnl_k, vnl_h, vnl_nonVnChar}, false},
+    {1, {vnl_l, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_m, vnl_nonVnChar, vnl_nonVnChar}, true},
+    {1, {vnl_n, vnl_nonVnChar, vnl_nonVnChar}, true},
+    {2, {vnl_n, vnl_g, vnl_nonVnChar}, true},
+    {3, {vnl_n, vnl_g, vnl_h}, false},
+    {2, {vnl_n, vnl_h, vnl_nonVnChar}, true},
+    {1, {vnl_p, vnl_nonVnChar, vnl_nonVnChar}, true},
+    {2, {vnl_p, vnl_h, vnl_nonVnChar}, false},
+    {1, {vnl_q, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {2, {vnl_q, vnl_u, vnl_nonVnChar}, false},
+    {1, {vnl_r, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_s, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_t, vnl_nonVnChar, vnl_nonVnChar}, true},
+    {2, {vnl_t, vnl_h, vnl_nonVnChar}, false},
+    {2, {vnl_t, vnl_r, vnl_nonVnChar}, false},
+    {1, {vnl_v, vnl_nonVnChar, vnl_nonVnChar}, false},
+    {1, {vnl_x, vnl_nonVnChar, vnl_nonVnChar}, false}};
 
 const int VSeqCount = sizeof(VSeqList) / sizeof(VowelSeqInfo);
 struct VSeqPair {
     VnLexiName v[3];
     VowelSeq vs;
 };
-VSeqPair SortedVSeqList[VSeqCount];
+
+// sorted by the letters for lookupVSeq()
+static constexpr std::array<VSeqPair, VSeqCount> SortedVSeqList = [] {
+    std::array<VSeqPair, VSeqCount> list{};
+    for (int i = 0; i < VSeqCount; i++) {
+        for (int j = 0; j < 3; j++)
+            list[i].v[j] = VSeqList[i].v[j];
+        list[i].vs = (VowelSeq)i;
+    }
+    std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) {
+        return std::lexicographical_compare(a.v, a.v + 3, b.v, b.v + 3);
+    });
+    return list;
+}();
 
 const int CSeqCount = sizeof(CSeqList) / sizeof(ConSeqInfo);
 struct CSeqPair {
     VnLexiName c[3];
     ConSeq cs;
 };
-CSeqPair SortedCSeqList[CSeqCount];
+
+// sorted by the letters for lookupCSeq()
+static constexpr std::array<CSeqPair, CSeqCount> SortedCSeqList = [] {
+    std::array<CSeqPair, CSeqCount> list{};
+    for (int i = 0; i < CSeqCount; i++) {
+        for (int j = 0; j < 3; j++)
+            list[i].c[j] = CSeqList[i].c[j];
+        list[i].cs = (ConSeq)i;
+    }
+    std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) {
+        return std::lexicographical_compare(a.c, a.c + 3, b.c, b.c + 3);
+    });
+    return list;
+}();
 
 struct VCPair {
     VowelSeq v;
     ConSeq c;
 };
 
-VCPair VCPairList[] = {{vs_a, cs_c},    {vs_a, cs_ch},   {vs_a, cs_m},
-                       {vs_a, cs_n},    {vs_a, cs_ng},   {vs_a, cs_nh},
-                       {vs_a, cs_p},    {vs_a, cs_t},    {vs_ar, cs_c},
-                       {vs_ar, cs_m},   {vs_ar, cs_n},   {vs_ar, cs_ng},
-                       {vs_ar, cs_p},   {vs_ar, cs_t},   {vs_ab, cs_c},
-                       {vs_ab, cs_m},   {vs_ab, cs_n},   {vs_ab, cs_ng},
-                       {vs_ab, cs_p},   {vs_ab, cs_t},
-
-                       {vs_e, cs_c},    {vs_e, cs_ch},   {vs_e, cs_m},
-                       {vs_e, cs_n},    {vs_e, cs_ng},   {vs_e, cs_nh},
-                       {vs_e, cs_p},    {vs_e, cs_t},    {vs_er, cs_c},
-                       {vs_er, cs_ch},  {vs_er, cs_m},   {vs_er, cs_n},
-                       {vs_er, cs_nh},  {vs_er, cs_p},   {vs_er, cs_t},
-
-                       {vs_i, cs_c},    {vs_i, cs_ch},   {vs_i, cs_m},
-                       {vs_i, cs_n},    {vs_i, cs_nh},   {vs_i, cs_p},
-                       {vs_i, cs_t},
-
-                       {vs_o, cs_c},    {vs_o, cs_m},    {vs_o, cs_n},
-                       {vs_o, cs_ng},   {vs_o, cs_p},    {vs_o, cs_t},
-                       {vs_or, cs_c},   {vs_or, cs_m},   {vs_or, cs_n},
-                       {vs_or, cs_ng},  {vs_or, cs_p},   {vs_or, cs_t},
-                       {vs_oh, cs_m},   {vs_oh, cs_n},   {vs_oh, cs_p},
-                       {vs_oh, cs_t},
-
-                       {vs_u, cs_c},    {vs_u, cs_m},    {vs_u, cs_n},
-                       {vs_u, cs_ng},   {vs_u, cs_p},    {vs_u, cs_t},
-                       {vs_uh, cs_c},   {vs_uh, cs_m},   {vs_uh, cs_n},
-                       {vs_uh, cs_ng},  {vs_uh, cs_t},
-
-                       {vs_y, cs_t},    {vs_ie, cs_c},   {vs_ie, cs_m},
-                       {vs_ie, cs_n},   {vs_ie, cs_ng},  {vs_ie, cs_p},
-                       {vs_ie, cs_t},   {vs_ier, cs_c},  {vs_ier, cs_m},
-                       {vs_ier, cs_n},  {vs_ier, cs_ng}, {vs_ier, cs_p},
-                       {vs_ier, cs_t},
-
-                       {vs_oa, cs_c},   {vs_oa, cs_ch},  {vs_oa, cs_m},
-                       {vs_oa, cs_n},   {vs_oa, cs_ng},  {vs_oa, cs_nh},
-                       {vs_oa, cs_p},   {vs_oa, cs_t},   {vs_oab, cs_c},
-                       {vs_oab, cs_m},  {vs_oab, cs_n},  {vs_oab, cs_ng},
-                       {vs_oab, cs_t},
-
-                       {vs_oe, cs_n},   {vs_oe, cs_t},
-
-                       {vs_ua, cs_n},   {vs_ua, cs_ng},  {vs_ua, cs_t},
-                       {vs_uar, cs_n},  {vs_uar, cs_ng}, {vs_uar, cs_t},
-
-                       {vs_ue, cs_c},   {vs_ue, cs_ch},  {vs_ue, cs_n},
-                       {vs_ue, cs_nh},  {vs_uer, cs_c},  {vs_uer, cs_ch},
-                       {vs_uer, cs_n},  {vs_uer, cs_nh},
-
-                       {vs_uo, cs_c},   {vs_uo, cs_m},   {vs_uo, cs_n},
-                       {vs_uo, cs_ng},  {vs_uo, cs_p},   {vs_uo, cs_t},
-                       {vs_uor, cs_c},  {vs_uor, cs_m},  {vs_uor, cs_n},
-                       {vs_uor, cs_ng}, {vs_uor, cs_t},  {vs_uho, cs_c},
-                       {vs_uho, cs_m},  {vs_uho, cs_n},  {vs_uho, cs_ng},
-                       {vs_uho, cs_p},  {vs_uho, cs_t},  {vs_uhoh, cs_c},
-                       {vs_uhoh, cs_m}, {vs_uhoh, cs_n}, {vs_uhoh, cs_ng},
-                       {vs_uhoh, cs_p}, {vs_uhoh, cs_t},
-
-                       {vs_uy, cs_c},   {vs_uy, cs_ch},  {vs_uy, cs_n},
-                       {vs_uy, cs_nh},  {vs_uy, cs_p},   {vs_uy, cs_t},
-
-                       {vs_ye, cs_m},   {vs_ye, cs_n},   {vs_ye, cs_ng},
-                       {vs_ye, cs_p},   {vs_ye, cs_t},   {vs_yer, cs_m},
-                       {vs_yer, cs_n},  {vs_yer, cs_ng}, {vs_yer, cs_t},
-
-                       {vs_uye, cs_n},  {vs_uye, cs_t},  {vs_uyer, cs_n},
-                       {vs_uyer, cs_t}
+constexpr VCPair VCPairList[] = {
+    {vs_a, cs_c},    {vs_a, cs_ch},   {vs_a, cs_m},
+    {vs_a, cs_n},    {vs_a, cs_ng},   {vs_a, cs_nh},
+    {vs_a, cs_p},    {vs_a, cs_t},    {vs_ar, cs_c},
+    {vs_ar, cs_m},   {vs_ar, cs_n},   {vs_ar, cs_ng},
+    {vs_ar, cs_p},   {vs_ar, cs_t},   {vs_ab, cs_c},
+    {vs_ab, cs_m},   {vs_ab, cs_n},   {vs_ab, cs_ng},
+    {vs_ab, cs_p},   {vs_ab, cs_t},
+
+    {vs_e, cs_c},    {vs_e, cs_ch},   {vs_e, cs_m},
+    {vs_e, cs_n},    {vs_e, cs_ng},   {vs_e, cs_nh},
+    {vs_e, cs_p},    {vs_e, cs_t},    {vs_er, cs_c},
+    {vs_er, cs_ch},  {vs_er, cs_m},   {vs_er, cs_n},
+    {vs_er, cs_nh},  {vs_er, cs_p},   {vs_er, cs_t},
+
+    {vs_i, cs_c},    {vs_i, cs_ch},   {vs_i, cs_m},
+    {vs_i, cs_n},    {vs_i, cs_nh},   {vs_i, cs_p},
+    {vs_i, cs_t},
+
+    {vs_o, cs_c},    {vs_o, cs_m},    {vs_o, cs_n},
+    {vs_o, cs_ng},   {vs_o, cs_p},    {vs_o, cs_t},
+    {vs_or, cs_c},   {vs_or, cs_m},   {vs_or, cs_n},
+    {vs_or, cs_ng},  {vs_or, cs_p},   {vs_or, cs_t},
+    {vs_oh, cs_m},   {vs_oh, cs_n},   {vs_oh, cs_p},
+    {vs_oh, cs_t},
+
+    {vs_u, cs_c},    {vs_u, cs_m},    {vs_u, cs_n},
+    {vs_u, cs_ng},   {vs_u, cs_p},    {vs_u, cs_t},
+    {vs_uh, cs_c},   {vs_uh, cs_m},   {vs_uh, cs_n},
+    {vs_uh, cs_ng},  {vs_uh, cs_t},
+
+    {vs_y, cs_t},    {vs_ie, cs_c},   {vs_ie, cs_m},
+    {vs_ie, cs_n},   {vs_ie, cs_ng},  {vs_ie, cs_p},
+    {vs_ie, cs_t},   {vs_ier, cs_c},  {vs_ier, cs_m},
+    {vs_ier, cs_n},  {vs_ier, cs_ng}, {vs_ier, cs_p},
+    {vs_ier, cs_t},
+
+    {vs_oa, cs_c},   {vs_oa, cs_ch},  {vs_oa, cs_m},
+    {vs_oa, cs_n},   {vs_oa, cs_ng},  {vs_oa, cs_nh},
+    {vs_oa, cs_p},   {vs_oa, cs_t},   {vs_oab, cs_c},
+    {vs_oab, cs_m},  {vs_oab, cs_n},  {vs_oab, cs_ng},
+    {vs_oab, cs_t},
+
+    {vs_oe, cs_n},   {vs_oe, cs_t},
+
+    {vs_ua, cs_n},   {vs_ua, cs_ng},  {vs_ua, cs_t},
+    {vs_uar, cs_n},  {vs_uar, cs_ng}, {vs_uar, cs_t},
+
+    {vs_ue, cs_c},   {vs_ue, cs_ch},  {vs_ue, cs_n},
+    {vs_ue, cs_nh},  {vs_uer, cs_c},  {vs_uer, cs_ch},
+    {vs_uer, cs_n},  {vs_uer, cs_nh},
+
+    {vs_uo, cs_c},   {vs_uo, cs_m},   {vs_uo, cs_n},
+    {vs_uo, cs_ng},  {vs_uo, cs_p},   {vs_uo, cs_t},
+    {vs_uor, cs_c},  {vs_uor, cs_m},  {vs_uor, cs_n},
+    {vs_uor, cs_ng}, {vs_uor, cs_t},
+
+    {vs_uy, cs_c},   {vs_uy, cs_ch},  {vs_uy, cs_n},
+    {vs_uy, cs_nh},  {vs_uy, cs_p},   {vs_uy, cs_t},
+
+    {vs_uho, cs_c},  {vs_uho, cs_m},  {vs_uho, cs_n},
+    {vs_uho, cs_ng}, {vs_uho, cs_p},  {vs_uho, cs_t},
+    {vs_uhoh, cs_c}, {vs_uhoh, cs_m}, {vs_uhoh, cs_n},
+    {vs_uhoh, cs_ng}, {vs_uhoh, cs_p}, {vs_uhoh, cs_t},
+
+    {vs_ye, cs_m},   {vs_ye, cs_n},   {vs_ye, cs_ng},
+    {vs_ye, cs_p},   {vs_ye, cs_t},   {vs_yer, cs_m},
+    {vs_yer, cs_n},  {vs_yer, cs_ng}, {vs_yer, cs_t},
+
+    {vs_uye, cs_n},  {vs_uye, cs_t},  {vs_uyer, cs_n},
+    {vs_uyer, cs_t}
 
 };
 
-const int VCPairCount = sizeof(VCPairList) / sizeof(VCPair);
-
-// TODO: auto-complete: e.g. luan -> lua^n
+// VCPairList by vowel sequence and consonant sequence, for isValidVC()
+static constexpr auto VCPairTable = [] {
+    std::array<std::array<bool, CSeqCount>, VSeqCount> table{};
+    for (const VCPair &p : VCPairList)
+        table[p.v][p.c] = true;
+    return table;
+}();
 
 typedef int (UkEngine::*UkKeyProc)(UkKeyEvent &ev);
 
-UkKeyProc UkKeyProcList[vneCount] = {
+constexpr UkKeyProc UkKeyProcList[vneCount] = {
     &UkEngine::processRoof,    // vneRoofAll
     &UkEngine::processRoof,    // vneRoof_a
     &UkEngine::processRoof,    // vneRoof_e
@@ -859,12 +919,10 @@ VowelSeq lookupVSeq(VnLexiName v1, VnLexiName v2 = vnl_nonVnChar,
 ConSeq lookupCSeq(VnLexiName c1, VnLexiName c2 = vnl_nonVnChar,
                   VnLexiName c3 = vnl_nonVnChar);
 
-bool UkEngine::m_classInit = false;
-
 //------------------------------------------------
 int tripleVowelCompare(const void *p1, const void *p2) {
-    VSeqPair *t1 = (VSeqPair *)p1;
-    VSeqPair *t2 = (VSeqPair *)p2;
+    const VSeqPair *t1 = (const VSeqPair *)p1;
+    const VSeqPair *t2 = (const VSeqPair *)p2;
 
     for (int i = 0; i < 3; i++) {
         if (t1->v[i] < t2->v[i])
@@ -877,8 +935,8 @@ int tripleVowelCompare(const void *p1, const void *p2) {
 
 //------------------------------------------------
 int tripleConCompare(const void *p1, const void *p2) {
-    CSeqPair *t1 = (CSeqPair *)p1;
-    CSeqPair *t2 = (CSeqPair *)p2;
+    const CSeqPair *t1 = (const CSeqPair *)p1;
+    const CSeqPair *t2 = (const CSeqPair *)p2;
 
     for (int i = 0; i < 3; i++) {
         if (t1->c[i] < t2->c[i])
@@ -889,29 +947,12 @@ int tripleConCompare(const void *p1, const void *p2) {
     return 0;
 }
 
-//------------------------------------------------
-int VCPairCompare(const void *p1, const void *p2) {
-    VCPair *t1 = (VCPair *)p1;
-    VCPair *t2 = (VCPair *)p2;
-
-    if (t1->v < t2->v)
-        return -1;
-    if (t1->v > t2->v)
-        return 1;
-
-    if (t1->c < t2->c)
-        return -1;
-    if (t1->c > t2->c)
-        return 1;
-    return 0;
-}
-
 //----------------------------------------------------------
-bool isValidCV(ConSeq c, VowelSeq v) {
+constexpr bool isValidCV(ConSeq c, VowelSeq v) {
     if (c == cs_nil || v == vs_nil)
         return true;
 
-    VowelSeqInfo &vInfo = VSeqList[v];
+    const VowelSeqInfo &vInfo = VSeqList[v];
 
     // gi doesn't go with i
     // qu doesn't go with u, uh
@@ -923,9 +964,9 @@ bool isValidCV(ConSeq c, VowelSeq v) {
 
     // k can only go with the following vowel sequences
     if (c == cs_k) {
-        static VowelSeq kVseq[] = {vs_e,   vs_i,    vs_y,  vs_er, vs_eo,
-                                   vs_eu,  vs_eru,  vs_ia, vs_ie, vs_ier,
-                                   vs_ieu, vs_ieru, vs_nil};
+        constexpr VowelSeq kVseq[] = {vs_e,   vs_i,    vs_y,  vs_er, vs_eo,
+                                      vs_eu,  vs_eru,  vs_ia, vs_ie, vs_ier,
+                                      vs_ieu, vs_ieru, vs_nil};
         int i;
         for (i = 0; kVseq[i] != vs_nil && kVseq[i] != v; i++)
             ;
@@ -937,29 +978,23 @@ bool isValidCV(ConSeq c, VowelSeq v) {
 }
 
 //----------------------------------------------------------
-bool isValidVC(VowelSeq v, ConSeq c) {
+constexpr bool isValidVC(VowelSeq v, ConSeq c) {
     if (v == vs_nil || c == cs_nil)
         return true;
 
-    VowelSeqInfo &vInfo = VSeqList[v];
+    const VowelSeqInfo &vInfo = VSeqList[v];
     if (!vInfo.conSuffix)
         return false;
 
-    ConSeqInfo &cInfo = CSeqList[c];
+    const ConSeqInfo &cInfo = CSeqList[c];
     if (!cInfo.suffix)
         return false;
 
-    VCPair p;
-    p.v = v;
-    p.c = c;
-    if (bsearch(&p, VCPairList, VCPairCount, sizeof(VCPair), VCPairCompare))
-        return true;
-
-    return false;
+    return VCPairTable[v][c];
 }
 
 //----------------------------------------------------------
-bool isValidCVC(ConSeq c1, VowelSeq v, ConSeq c2) {
+constexpr bool isValidCVC(ConSeq c1, VowelSeq v, ConSeq c2) {
     if (v == vs_nil)
         return (c1 == cs_nil || c2 != cs_nil);
 
@@ -990,39 +1025,307 @@ bool isValidCVC(ConSeq c1, VowelSeq v, ConSeq c2) {
     return false;
 }
 
-//------------------------------------------------
-void engineClassInit() {
-    int i, j;
+//----------------------------------------------------------
+// Test if a word of lower case letters, tones included, is a Vietnamese
+// syllable, by the rules the spell checker uses
+//----------------------------------------------------------
+bool isVnSyllable(const VnLexiName *word, int len) {
+    VnLexiName c1[3], v[3], c2[3];
+    int n1 = 0, nv = 0, n2 = 0;
+    int i, tone = 0;
+
+    for (i = 0; i < 3; i++)
+        c1[i] = v[i] = c2[i] = vnl_nonVnChar;
+
+    for (i = 0; i < len; i++) {
+        if (word[i] < 0 || word[i] >= vnl_lastChar)
+            return false;
+        VnLexiName sym = (VnLexiName)StdVnNoTone[word[i]];
+        if (sym != word[i]) {
+            if (tone)
+                return false;
+            tone = (word[i] - sym) / 2;
+        }
+        if (IsVnVowel[sym]) {
+            if (n2 > 0 || nv == 3)
+                return false;
+            v[nv++] = sym;
+        } else if (nv == 0) {
+            if (n1 == 3)
+                return false;
+            c1[n1++] = sym;
+        } else {
+            if (n2 == 3)
+                return false;
+            c2[n2++] = sym;
+        }
+    }
+    if (nv == 0)
+        return false;
 
-    for (i = 0; i < VSeqCount; i++) {
-        for (j = 0; j < 3; j++)
-            SortedVSeqList[i].v[j] = VSeqList[i].v[j];
-        SortedVSeqList[i].vs = (VowelSeq)i;
+    // gi and qu take the first vowel: gia, qua, but gi`
+    if (n1 == 1 && nv > 1 &&
+        ((c1[0] == vnl_g && v[0] == vnl_i) ||
+         (c1[0] == vnl_q && v[0] == vnl_u))) {
+        c1[n1++] = v[0];
+        v[0] = v[1];
+        v[1] = v[2];
+        v[2] = vnl_nonVnChar;
+    }
+
+    ConSeq cs1 = (n1 > 0) ? lookupCSeq(c1[0], c1[1], c1[2]) : cs_nil;
+    VowelSeq vs = lookupVSeq(v[0], v[1], v[2]);
+    ConSeq cs2 = (n2 > 0) ? lookupCSeq(c2[0], c2[1], c2[2]) : cs_nil;
+    if ((n1 > 0 && cs1 == cs_nil) || vs == vs_nil ||
+        (n2 > 0 && cs2 == cs_nil) || !VSeqList[vs].complete ||
+        !isValidCVC(cs1, vs, cs2))
+        return false;
+
+    return !((cs2 == cs_c || cs2 == cs_ch || cs2 == cs_p || cs2 == cs_t) &&
+             (tone == 2 || tone == 3 || tone == 4));
+}
+
+//----------------------------------------------------------
+// Syllables the strict spell check accepts, as the tones each onset can
+// take with each rhyme. A rhyme is a vowel sequence with one of the codas.
+// They come from spelling rules, not from a list of the syllables in use,
+// so rare or unused ones such as ngoa(?m still pass.
+//----------------------------------------------------------
+#define VN_STRICT_CODAS 9
+#define VN_STRICT_RHYMES 256
+
+static constexpr ConSeq StrictCodas[VN_STRICT_CODAS] = {
+    cs_nil, cs_c, cs_ch, cs_m, cs_n, cs_ng, cs_nh, cs_p, cs_t};
+
+// Index of each coda, by coda + 1, or -1
+static constexpr std::array<signed char, CSeqCount + 1> StrictCodaIndex = [] {
+    std::array<signed char, CSeqCount + 1> index{};
+    index.fill(-1);
+    for (int k = 0; k < VN_STRICT_CODAS; k++)
+        index[StrictCodas[k] + 1] = k;
+    return index;
+}();
+
+//----------------------------------------------------------
+// The vowel under a roof or a hook: a^ -> a, u+ -> u
+//----------------------------------------------------------
+static constexpr VnLexiName vowelRoot(VnLexiName v) {
+    switch (v) {
+    case vnl_ar:
+    case vnl_ab:
+        return vnl_a;
+    case vnl_er:
+        return vnl_e;
+    case vnl_or:
+    case vnl_oh:
+        return vnl_o;
+    case vnl_uh:
+        return vnl_u;
+    default:
+        return v;
     }
+}
+
+//----------------------------------------------------------
+// Spelling rules that isValidCVC() doesn't check
+//----------------------------------------------------------
+static constexpr bool isStrictCVC(ConSeq c1, VowelSeq v, ConSeq c2) {
+    VnLexiName first = VSeqList[v].v[0];
+    bool front = (first == vnl_i || first == vnl_e || first == vnl_er);
+
+    // ci, ce, ngi, ge are written ki, ke, nghi, ghe; but gi is an onset
+    if ((c1 == cs_c || c1 == cs_ng || (c1 == cs_g && first != vnl_i)) &&
+        (front || first == vnl_y))
+        return false;
+    if ((c1 == cs_gh || c1 == cs_ngh) && !front)
+        return false;
+
+    // ye^ begins a syllable or follows qu, ie^ never begins one
+    if ((v == vs_yer || v == vs_yeru) && c1 != cs_nil && c1 != cs_qu)
+        return false;
+    if ((v == vs_ier || v == vs_ieru) && c1 == cs_nil)
+        return false;
+
+    // a(, a^, ie^, uo^, u+o+ don't end a syllable
+    if (c2 == cs_nil &&
+        (v == vs_ab || v == vs_ar || v == vs_oab || v == vs_uar ||
+         v == vs_ier || v == vs_yer || v == vs_uor || v == vs_uhoh ||
+         v == vs_uyer))
+        return false;
+
+    // ia, ua, u+a end a syllable, with a coda they are spelt ie^, ua^, u+o+
+    if (c2 != cs_nil && (v == vs_ia || v == vs_ua || v == vs_uha))
+        return false;
+
+    // ch and nh follow a, e^, i, oa, ue^, uy only
+    if ((c2 == cs_ch || c2 == cs_nh) &&
+        !(v == vs_a || v == vs_er || v == vs_i || v == vs_oa ||
+          v == vs_uer || v == vs_uy || v == vs_y))
+        return false;
+    return true;
+}
+
+//----------------------------------------------------------
+// Bit mask of the tones a syllable takes, 0 if it is not one
+//----------------------------------------------------------
+static constexpr UKBYTE strictSyllableTones(int c1, int v, int k) {
+    ConSeq c2 = StrictCodas[k];
+    if (!VSeqList[v].complete || !isStrictCVC((ConSeq)c1, (VowelSeq)v, c2) ||
+        !isValidCVC((ConSeq)c1, (VowelSeq)v, c2))
+        return 0;
 
-    for (i = 0; i < CSeqCount; i++) {
-        for (j = 0; j < 3; j++)
-            SortedCSeqList[i].c[j] = CSeqList[i].c[j];
-        SortedCSeqList[i].cs = (ConSeq)i;
+    // stop codas take the rising and heavy tones only
+    bool stop = (c2 == cs_c || c2 == cs_ch || c2 == cs_p || c2 == cs_t);
+    return stop ? 0x22 : 0x3F;
+}
+
+// Index of each rhyme, or -1 for those no syllable has
+static constexpr auto StrictRhymes = [] {
+    std::array<std::array<short, VN_STRICT_CODAS>, VSeqCount> rhymes{};
+    int c1, v, k, count = 0;
+
+    // rhymes no onset takes are left out
+    for (v = 0; v < VSeqCount; v++) {
+        for (k = 0; k < VN_STRICT_CODAS; k++) {
+            rhymes[v][k] = -1;
+            if (!VSeqList[v].complete || count == VN_STRICT_RHYMES)
+                continue;
+            for (c1 = cs_nil; c1 < CSeqCount; c1++) {
+                if (strictSyllableTones(c1, v, k)) {
+                    rhymes[v][k] = count++;
+                    break;
+                }
+            }
+        }
+    }
+    return rhymes;
+}();
+
+// Bit mask of the tones, by onset + 1 and rhyme
+static constexpr auto StrictTones = [] {
+    std::array<std::array<UKBYTE, VN_STRICT_RHYMES>, CSeqCount + 1> tones{};
+    for (int v = 0; v < VSeqCount; v++) {
+        for (int k = 0; k < VN_STRICT_CODAS; k++) {
+            int rhyme = StrictRhymes[v][k];
+            if (rhyme < 0)
+                continue;
+            for (int c1 = cs_nil; c1 < CSeqCount; c1++)
+                tones[c1 + 1][rhyme] = strictSyllableTones(c1, v, k);
+        }
     }
+    return tones;
+}();
 
-    qsort(SortedVSeqList, VSeqCount, sizeof(VSeqPair), tripleVowelCompare);
-    qsort(SortedCSeqList, CSeqCount, sizeof(CSeqPair), tripleConCompare);
-    qsort(VCPairList, VCPairCount, sizeof(VCPair), VCPairCompare);
+//----------------------------------------------------------
+bool isStrictVnSyllable(ConSeq c1, VowelSeq v, ConSeq c2, int tone) {
+    if (v == vs_nil || c2 < cs_nil || c2 >= CSeqCount || tone < 0 ||
+        tone > 5)
+        return false;
+    int coda = StrictCodaIndex[c2 + 1];
+    if (coda < 0)
+        return false;
+    int rhyme = StrictRhymes[v][coda];
+    return rhyme >= 0 && (StrictTones[c1 + 1][rhyme] & (1 << tone));
+}
 
-    for (i = 0; i < vnl_lastChar; i++)
-        IsVnVowel[i] = true;
+//----------------------------------------------------------
+// Test if a word being typed can still become a syllable the strict spell
+// check accepts with the tone: by more vowels while it has no coda, by roofs
+// and hooks on its vowels, or by a longer coda (n -> ng, nh; c -> ch)
+//----------------------------------------------------------
+static bool canBeStrictVnSyllable(ConSeq c1, VowelSeq v, ConSeq c2, int tone) {
+    if (v == vs_nil)
+        return true;
+    const VowelSeqInfo &info = VSeqList[v];
+    int w, k, i;
+    for (w = 0; w < VSeqCount; w++) {
+        const VowelSeqInfo &next = VSeqList[w];
+        if (next.len < info.len || (c2 != cs_nil && next.len != info.len))
+            continue;
+        for (i = 0; i < info.len; i++) {
+            if (next.v[i] != info.v[i] && vowelRoot(next.v[i]) != info.v[i])
+                break;
+        }
+        if (i < info.len)
+            continue;
+        for (k = 0; k < VN_STRICT_CODAS; k++) {
+            ConSeq coda = StrictCodas[k];
+            if (c2 != cs_nil && coda != c2 &&
+                (coda == cs_nil || CSeqList[c2].len > 1 ||
+                 CSeqList[coda].c[0] != CSeqList[c2].c[0]))
+                continue;
+            if (isStrictVnSyllable(c1, (VowelSeq)w, coda, tone))
+                return true;
+        }
+    }
+    return false;
+}
 
-    unsigned char ch;
-    for (ch = 'a'; ch <= 'z'; ch++) {
-        if (ch != 'a' && ch != 'e' && ch != 'i' && ch != 'o' && ch != 'u' &&
-            ch != 'y') {
-            IsVnVowel[AZLexiLower[ch - 'a']] = false;
-            IsVnVowel[AZLexiUpper[ch - 'a']] = false;
+//----------------------------------------------------------
+// Test if w is v with some roofs or hooks added
+//----------------------------------------------------------
+static constexpr bool isVSeqMarkedFrom(VowelSeq v, VowelSeq w) {
+    for (int i = 0; i < 3; i++) {
+        VnLexiName a = VSeqList[v].v[i];
+        VnLexiName b = VSeqList[w].v[i];
+        if (a != b &&
+            (a == vnl_nonVnChar || b == vnl_nonVnChar || vowelRoot(b) != a))
+            return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// The syllable that an onset, a vowel sequence and a coda spell once the
+// roofs and hooks the vowels lack are added, if it is the only one; or vs_nil
+//----------------------------------------------------------
+#define VN_AMBIGUOUS -2
+
+using CompletionTable =
+    std::array<std::array<std::array<signed char, VN_STRICT_CODAS>, VSeqCount>,
+               CSeqCount + 1>;
+
+static constexpr CompletionTable Completions = [] {
+    CompletionTable completions{};
+    VowelSeq marked[VSeqCount][8]{};
+    int count[VSeqCount]{};
+    int c1, v, w, k, i;
+
+    for (v = 0; v < VSeqCount; v++) {
+        for (w = 0; w < VSeqCount && count[v] < 8; w++) {
+            if (VSeqList[w].complete &&
+                isVSeqMarkedFrom((VowelSeq)v, (VowelSeq)w))
+                marked[v][count[v]++] = (VowelSeq)w;
+        }
+    }
+
+    // two syllables with the same letters leave no completion
+    for (c1 = cs_nil; c1 < CSeqCount; c1++) {
+        for (v = 0; v < VSeqCount; v++) {
+            for (k = 0; k < VN_STRICT_CODAS; k++) {
+                int found = vs_nil;
+                for (i = 0; i < count[v]; i++) {
+                    int rhyme = StrictRhymes[marked[v][i]][k];
+                    if (rhyme < 0 || !StrictTones[c1 + 1][rhyme])
+                        continue;
+                    found = (found == vs_nil) ? marked[v][i] : VN_AMBIGUOUS;
+                }
+                completions[c1 + 1][v][k] =
+                    (found == VN_AMBIGUOUS) ? vs_nil : found;
+            }
         }
     }
-    IsVnVowel[vnl_dd] = false;
-    IsVnVowel[vnl_DD] = false;
+    return completions;
+}();
+
+//----------------------------------------------------------
+VowelSeq completeVnSyllable(ConSeq c1, VowelSeq v, ConSeq c2) {
+    if (v == vs_nil || c2 < cs_nil || c2 >= CSeqCount)
+        return vs_nil;
+    int coda = StrictCodaIndex[c2 + 1];
+    if (coda < 0)
+        return vs_nil;
+    return (VowelSeq)Completions[c1 + 1][v][coda];
 }
 
 //------------------------------------------------
@@ -1032,8 +1335,9 @@ VowelSeq lookupVSeq(VnLexiName v1, VnLexiName v2, VnLexiName v3) {
     key.v[1] = v2;
     key.v[2] = v3;
 
-    VSeqPair *pInfo = (VSeqPair *)bsearch(&key, SortedVSeqList, VSeqCount,
-                                          sizeof(VSeqPair), tripleVowelCompare);
+    const VSeqPair *pInfo =
+        (const VSeqPair *)bsearch(&key, SortedVSeqList.data(), VSeqCount,
+                                  sizeof(VSeqPair), tripleVowelCompare);
     if (pInfo == 0)
         return vs_nil;
     return pInfo->vs;
@@ -1046,8 +1350,9 @@ ConSeq lookupCSeq(VnLexiName c1, VnLexiName c2, VnLexiName c3) {
     key.c[1] = c2;
     key.c[2] = c3;
 
-    CSeqPair *pInfo = (CSeqPair *)bsearch(&key, SortedCSeqList, CSeqCount,
-                                          sizeof(CSeqPair), tripleConCompare);
+    const CSeqPair *pInfo =
+        (const CSeqPair *)bsearch(&key, SortedCSeqList.data(), CSeqCount,
+                                  sizeof(CSeqPair), tripleConCompare);
     if (pInfo == 0)
         return cs_nil;
     return pInfo->cs;
@@ -1094,7 +1399,7 @@ int UkEngine::processRoof(UkKeyEvent &ev) {
         newVs = VSeqList[vs].withRoof;
     }
 
-    VowelSeqInfo *pInfo;
+    const VowelSeqInfo *pInfo;
 
     if (newVs == vs_nil) {
         if (VSeqList[vs].roofPos == -1)
@@ -1143,7 +1448,7 @@ int UkEngine::processRoof(UkKeyEvent &ev) {
         if (m_buffer[m_current].c2Offset != -1)
             c2 = m_buffer[m_current - m_buffer[m_current].c2Offset].cseq;
 
-        valid = isValidCVC(c1, newVs, c2);
+        valid = isValidCVC(c1, newVs, c2) && canBeStrict(c1, newVs, c2, tone);
         if (!valid)
             return processAppend(ev);
 
@@ -1208,7 +1513,7 @@ int UkEngine::processHookWithUO(UkKeyEvent &ev) {
 
     (void)toneRemoved; // fix warning
 
-    VnLexiName *v;
+    const VnLexiName *v;
 
     if (!m_pCtrl->options.freeMarking && m_buffer[m_current].vOffset != 0)
         return processAppend(ev);
@@ -1313,7 +1618,7 @@ int UkEngine::processHookWithUO(UkKeyEvent &ev) {
         break;
     }
 
-    VowelSeqInfo *p = &VSeqList[newVs];
+    const VowelSeqInfo *p = &VSeqList[newVs];
     for (i = 0; i < p->len; i++) { // update sub-sequences
         m_buffer[vStart + i].vseq = p->sub[i];
     }
@@ -1357,8 +1662,8 @@ int UkEngine::processHook(UkKeyEvent &ev) {
     int curTonePos, newTonePos, tone;
     int changePos;
     bool hookRemoved = false;
-    VowelSeqInfo *pInfo;
-    VnLexiName *v;
+    const VowelSeqInfo *pInfo;
+    const VnLexiName *v;
 
     vEnd = m_current - m_buffer[m_current].vOffset;
     vs = m_buffer[vEnd].vseq;
@@ -1451,7 +1756,7 @@ int UkEngine::processHook(UkKeyEvent &ev) {
         if (m_buffer[m_current].c2Offset != -1)
             c2 = m_buffer[m_current - m_buffer[m_current].c2Offset].cseq;
 
-        valid = isValidCVC(c1, newVs, c2);
+        valid = isValidCVC(c1, newVs, c2) && canBeStrict(c1, newVs, c2, tone);
 
         if (!valid)
             return processAppend(ev);
@@ -1498,7 +1803,7 @@ int UkEngine::processHook(UkKeyEvent &ev) {
 
 //----------------------------------------------------------
 int UkEngine::getTonePosition(VowelSeq vs, bool terminated) const {
-    VowelSeqInfo &info = VSeqList[vs];
+    const VowelSeqInfo &info = VSeqList[vs];
     if (info.len == 1)
         return 0;
 
@@ -1552,7 +1857,7 @@ int UkEngine::processTone(UkKeyEvent &ev) {
 
     vEnd = m_current - m_buffer[m_current].vOffset;
     vs = m_buffer[vEnd].vseq;
-    VowelSeqInfo &info = VSeqList[vs];
+    const VowelSeqInfo &info = VSeqList[vs];
     if (m_pCtrl->options.spellCheckEnabled && !m_pCtrl->options.freeMarking &&
         !info.complete)
         return processAppend(ev);
@@ -1565,6 +1870,17 @@ int UkEngine::processTone(UkKeyEvent &ev) {
             return processAppend(ev); // c, ch, p, t suffixes don't allow ` ? ~
     }
 
+    if (ev.tone != 0) {
+        ConSeq c1 = cs_nil;
+        ConSeq c2 = cs_nil;
+        if (m_buffer[m_current].c1Offset != -1)
+            c1 = m_buffer[m_current - m_buffer[m_current].c1Offset].cseq;
+        if (m_buffer[m_current].c2Offset != -1)
+            c2 = m_buffer[m_current - m_buffer[m_current].c2Offset].cseq;
+        if (!canBeStrict(c1, vs, c2, ev.tone))
+            return processAppend(ev);
+    }
+
     int toneOffset = getTonePosition(vs, vEnd == m_current);
     int tonePos = vEnd - (info.len - 1) + toneOffset;
 
@@ -2285,6 +2601,7 @@ int UkEngine::processEscChar(UkKeyEvent &ev) {
 void UkEngine::pass(int keyCode) {
     UkKeyEvent ev;
     m_pCtrl->input.keyCodeToEvent(keyCode, ev);
+    clearCheckpoints();
     processAppend(ev);
 }
 
@@ -2328,6 +2645,8 @@ int UkEngine::process(unsigned int keyCode, int &backs, unsigned char *outBuf,
     m_keyRestored = false;
     m_keyRestoring = false;
     m_outType = UkCharOutput;
+    m_longOutput.clear();
+    saveCheckpoint();
 
     m_pCtrl->input.keyCodeToEvent(keyCode, ev);
 
@@ -2371,6 +2690,8 @@ int UkEngine::process(unsigned int keyCode, int &backs, unsigned char *outBuf,
         m_keyCurrent++;
         m_keyStrokes[m_keyCurrent].ev = ev;
         m_keyStrokes[m_keyCurrent].converted = (ret && !m_keyRestored);
+        shadowKeyStroke();
+        commitCheckpoint();
     }
 
     if (ret == 0) {
@@ -2401,6 +2722,7 @@ void UkEngine::rebuildChar(VnLexiName ch, int &backs, unsigned char *outBuf,
     }
 
     prepareBuffer();
+    clearCheckpoints();
     m_backs = 0;
     m_changePos = m_current + 1;
     m_pOutBuf = outBuf;
@@ -2421,6 +2743,7 @@ void UkEngine::rebuildChar(VnLexiName ch, int &backs, unsigned char *outBuf,
     m_keyCurrent++;
     m_keyStrokes[m_keyCurrent].ev = ev;
     m_keyStrokes[m_keyCurrent].converted = true;
+    shadowKeyStroke();
 
     // modify vowel
     auto it =
@@ -2452,9 +2775,9 @@ void UkEngine::rebuildChar(VnLexiName ch, int &backs, unsigned char *outBuf,
 //----------------------------------------------------------
 int UkEngine::writeOutput(unsigned char *outBuf, int &outSize) {
     StdVnChar stdChar;
-    int i, bytesWritten;
-    int ret = 1;
-    StringBOStream os(outBuf, outSize);
+    StdVnChar chars[MAX_UK_ENGINE];
+    int i, count = 0;
+    SpanBOStream os(outBuf, outSize);
     VnCharset *pCharset = VnCharsetLibObj.getVnCharset(m_pCtrl->charsetId);
     pCharset->startOutput();
 
@@ -2471,9 +2794,11 @@ int UkEngine::writeOutput(unsigned char *outBuf, int &outSize) {
         }
 
         if (stdChar != INVALID_STD_CHAR)
-            ret = pCharset->putChar(os, stdChar, bytesWritten);
+            chars[count++] = stdChar;
     }
 
+    VnSpanEncoder encoder = VnGetSpanEncoder(m_pCtrl->charsetId);
+    int ret = encoder(*pCharset, os, chars, count, 1);
     outSize = os.getOutBytes();
     return (ret ? 0 : VNCONV_OUT_OF_MEMORY);
 }
@@ -2533,6 +2858,8 @@ void UkEngine::markChange(int pos) {
 // character buffer (m_buffer) and key stroke buffer in synch
 //----------------------------------------------------------------
 void UkEngine::synchKeyStrokeBuffer() {
+    m_rawValid = false;
+    clearCheckpoints();
     // synchronize with key-stroke buffer
     if (m_keyCurrent >= 0)
         m_keyCurrent--;
@@ -2547,6 +2874,166 @@ void UkEngine::synchKeyStrokeBuffer() {
     }
 }
 
+//----------------------------------------------------------------
+// Called when a key stroke is added to the key stroke buffer, to append it
+// untransformed to the raw word, the way restoreKeyStrokes() would
+//----------------------------------------------------------------
+void UkEngine::shadowKeyStroke() {
+    const UkKeyEvent &key = m_keyStrokes[m_keyCurrent].ev;
+    if (key.chType == ukcWordBreak) {
+        m_rawValid = false;
+        return;
+    }
+
+    if (m_keyCurrent == 0 ||
+        m_keyStrokes[m_keyCurrent - 1].ev.chType == ukcWordBreak) {
+        // first key of the word, which starts after the last word break
+        m_rawBase = m_current;
+        while (m_rawBase >= 0 && m_buffer[m_rawBase].form != vnw_empty)
+            m_rawBase--;
+        if (m_rawBase >= 0)
+            memcpy(&m_rawBuffer[m_rawBase], &m_buffer[m_rawBase],
+                   sizeof(WordInfo));
+        m_rawCurrent = m_rawBase;
+        m_rawBase++;
+        m_rawKeyStart = m_keyCurrent;
+        m_rawVietKey = m_pCtrl->vietKey;
+        m_rawValid = true;
+    }
+
+    UkKeyEvent ev;
+    m_pCtrl->input.keyCodeToSymbol(key.keyCode, ev);
+    // what would reset the engine or write output can't be shadowed
+    if (!m_rawValid || ev.chType == ukcReset || ev.chType == ukcWordBreak ||
+        m_pCtrl->charsetId == CONV_CHARSET_VIQR ||
+        m_pCtrl->vietKey != m_rawVietKey || m_rawCurrent + 10 >= m_bufSize) {
+        m_rawValid = false;
+        return;
+    }
+
+    int changePos = m_changePos;
+    int backs = m_backs;
+    m_changePos = 0; // nothing to output
+    std::swap(m_buffer, m_rawBuffer);
+    std::swap(m_current, m_rawCurrent);
+    processAppend(ev);
+    std::swap(m_buffer, m_rawBuffer);
+    std::swap(m_current, m_rawCurrent);
+    m_changePos = changePos;
+    m_backs = backs;
+}
+
+//----------------------------------------------------------------
+// Test if the raw word is what restoring the key strokes from keyStart
+// would rebuild
+//----------------------------------------------------------------
+bool UkEngine::rawWordShadows(int keyStart) const {
+    if (!m_rawValid || m_rawKeyStart != keyStart ||
+        m_rawBase != m_current + 1 || m_pCtrl->vietKey != m_rawVietKey ||
+        m_pCtrl->charsetId == CONV_CHARSET_VIQR)
+        return false;
+    // the word break before it must not have changed
+    return m_current < 0 || memcmp(&m_rawBuffer[m_current],
+                                   &m_buffer[m_current], sizeof(WordInfo)) == 0;
+}
+
+//----------------------------------------------------------------
+// Called before a key stroke is processed, saves what it may change
+//----------------------------------------------------------------
+void UkEngine::saveCheckpoint() {
+    Checkpoint &cp = m_checkpoints[m_ckptTop];
+    cp.current = m_current;
+    cp.keyCurrent = m_keyCurrent;
+    cp.singleMode = m_singleMode;
+    cp.toEscape = m_toEscape;
+    cp.first = m_current - UK_CHECKPOINT_ENTRIES + 1;
+    if (cp.first < 0)
+        cp.first = 0;
+    if (m_current >= 0)
+        memcpy(cp.entries, &m_buffer[cp.first],
+               (m_current - cp.first + 1) * sizeof(WordInfo));
+    m_ckptPending = true;
+}
+
+//----------------------------------------------------------------
+// Called when the key stroke is added to the key stroke buffer
+//----------------------------------------------------------------
+void UkEngine::commitCheckpoint() {
+    if (!m_ckptPending)
+        return;
+    m_ckptPending = false;
+    Checkpoint &cp = m_checkpoints[m_ckptTop];
+    // every change is marked for output
+    if (m_changePos < cp.first)
+        cp.first = -1;
+    m_ckptTop = (m_ckptTop + 1) % UK_CHECKPOINTS;
+    if (m_ckptCount < UK_CHECKPOINTS)
+        m_ckptCount++;
+}
+
+//----------------------------------------------------------------
+void UkEngine::clearCheckpoints() {
+    m_ckptCount = 0;
+    m_ckptPending = false;
+}
+
+//----------------------------------------------------------------
+// If the state before the last key strokes shows the word without its last
+// character, go back to it: that is what the user typed
+//----------------------------------------------------------------
+bool UkEngine::undoLastChar() {
+    int target = m_current - 1;
+    int n = 0, lo = m_current;
+    int slot = m_ckptTop;
+    const Checkpoint *cp = nullptr;
+    while (n < m_ckptCount) {
+        slot = (slot + UK_CHECKPOINTS - 1) % UK_CHECKPOINTS;
+        cp = &m_checkpoints[slot];
+        n++;
+        if (cp->first < 0 || cp->current < target)
+            return false;
+        if (cp->first < lo)
+            lo = cp->first;
+        if (cp->current == target)
+            break;
+    }
+    if (!cp || cp->current != target)
+        return false;
+
+    // put back what the key strokes changed, the older ones last
+    WordInfo saved[UK_CHECKPOINT_ENTRIES];
+    int i, p, len = target - lo + 1;
+    memcpy(saved, &m_buffer[lo], len * sizeof(WordInfo));
+    for (i = 0, slot = m_ckptTop; i < n; i++) {
+        slot = (slot + UK_CHECKPOINTS - 1) % UK_CHECKPOINTS;
+        const Checkpoint &c = m_checkpoints[slot];
+        for (p = c.first; p <= target && p <= c.current; p++)
+            m_buffer[p] = c.entries[p - c.first];
+    }
+
+    auto charAt = [](const WordInfo &entry) {
+        if (entry.vnSym == vnl_nonVnChar)
+            return (StdVnChar)entry.keyCode;
+        return (StdVnChar)(entry.vnSym + VnStdCharOffset - entry.caps +
+                           entry.tone * 2);
+    };
+    for (p = lo; p <= target; p++) {
+        if (charAt(m_buffer[p]) != charAt(saved[p - lo])) {
+            memcpy(&m_buffer[lo], saved, len * sizeof(WordInfo));
+            return false;
+        }
+    }
+
+    m_current = target;
+    m_keyCurrent = cp->keyCurrent;
+    m_singleMode = cp->singleMode;
+    m_toEscape = cp->toEscape;
+    m_ckptTop = slot;
+    m_ckptCount -= n;
+    m_rawValid = false;
+    return true;
+}
+
 //---------------------------------------------
 int UkEngine::processBackspace(int &backs, unsigned char *outBuf, int &outSize,
                                UkOutputType &outType) {
@@ -2561,6 +3048,12 @@ int UkEngine::processBackspace(int &backs, unsigned char *outBuf, int &outSize,
     m_changePos = m_current + 1;
     markChange(m_current);
 
+    if (undoLastChar()) {
+        backs = m_backs;
+        outSize = 0;
+        return (backs > 1);
+    }
+
     if (m_current == 0 || m_buffer[m_current].form == vnw_empty ||
         m_buffer[m_current].form == vnw_nonVn ||
         m_buffer[m_current].form == vnw_c ||
@@ -2610,23 +3103,35 @@ int UkEngine::processBackspace(int &backs, unsigned char *outBuf, int &outSize,
 void UkEngine::reset() {
     m_current = -1;
     m_keyCurrent = -1;
+    m_rawValid = false;
+    clearCheckpoints();
     m_singleMode = false;
     m_toEscape = false;
 }
 
 //------------------------------------------------
-void UkEngine::resetKeyBuf() { m_keyCurrent = -1; }
+void UkEngine::resetKeyBuf() {
+    m_keyCurrent = -1;
+    m_rawValid = false;
+    clearCheckpoints();
+}
 
 //------------------------------------------------
 UkEngine::UkEngine() {
-    if (!m_classInit) {
-        engineClassInit();
-        m_classInit = true;
-    }
     m_pCtrl = 0;
     m_bufSize = MAX_UK_ENGINE;
     m_keyBufSize = MAX_UK_ENGINE;
+    m_buffer = m_wordStore[0];
+    m_rawBuffer = m_wordStore[1];
     m_current = -1;
+    m_rawCurrent = -1;
+    m_rawBase = 0;
+    m_rawKeyStart = 0;
+    m_rawVietKey = false;
+    m_rawValid = false;
+    m_ckptTop = 0;
+    m_ckptCount = 0;
+    m_ckptPending = false;
     m_keyCurrent = -1;
     m_singleMode = false;
     m_keyCheckFunc = 0;
@@ -2642,6 +3147,7 @@ void UkEngine::prepareBuffer() {
     int rid;
     // prepare symbol buffer
     if (m_current >= 0 && m_current + 10 >= m_bufSize) {
+        clearCheckpoints();
         // Get rid of at least half of the current entries
         // don't get rid from the middle of a word.
         for (rid = m_current / 2;
@@ -2649,29 +3155,46 @@ void UkEngine::prepareBuffer() {
             ;
         if (rid == m_current) {
             m_current = -1;
+            m_rawValid = false;
         } else {
             rid++;
             memmove(m_buffer, m_buffer + rid,
                     (m_current - rid + 1) * sizeof(WordInfo));
             m_current -= rid;
+            // the raw word moves along, with the word break before it
+            if (m_rawValid && m_rawBase > rid) {
+                memmove(m_rawBuffer + m_rawBase - 1 - rid,
+                        m_rawBuffer + m_rawBase - 1,
+                        (m_rawCurrent - m_rawBase + 2) * sizeof(WordInfo));
+                m_rawBase -= rid;
+                m_rawCurrent -= rid;
+            } else {
+                m_rawValid = false;
+            }
         }
     }
 
     // prepare key stroke buffer
     if (m_keyCurrent > 0 && m_keyCurrent + 1 >= m_keyBufSize) {
+        clearCheckpoints();
         // Get rid of at least half of the current entries
         rid = m_keyCurrent / 2;
         memmove(m_keyStrokes, m_keyStrokes + rid,
                 (m_keyCurrent - rid + 1) * sizeof(m_keyStrokes[0]));
         m_keyCurrent -= rid;
+        m_rawKeyStart -= rid;
+        if (m_rawKeyStart < 0)
+            m_rawValid = false;
     }
 }
 
 #define ENTER_CHAR 13
-enum VnCaseType { VnCaseNoChange, VnCaseAllCapital, VnCaseAllSmall };
 
 //----------------------------------------------------
 int UkEngine::macroMatch(UkKeyEvent &ev) {
+    if (!m_pCtrl->macStore)
+        return 0;
+
     int capsLockOn = 0;
     int shiftPressed = 0;
     if (m_keyCheckFunc)
@@ -2680,66 +3203,33 @@ int UkEngine::macroMatch(UkKeyEvent &ev) {
     if (shiftPressed && (ev.keyCode == ' ' || ev.keyCode == ENTER_CHAR))
         return 0;
 
-    const StdVnChar *pMacText = NULL;
     StdVnChar key[MAX_MACRO_KEY_LEN + 1];
-    StdVnChar *pKeyStart;
-
-    // Use static macro text so we can gain a bit of performance
-    // by avoiding memory allocation each time this function is called
-    static StdVnChar macroText[MAX_MACRO_TEXT_LEN + 1];
+    StdVnChar *pKeyStart = key;
 
-    int i, j;
-
-    i = m_current;
-    while (i >= 0 && (m_current - i + 1) < MAX_MACRO_KEY_LEN) {
-        while (i >= 0 && m_buffer[i].form != vnw_empty &&
-               (m_current - i + 1) < MAX_MACRO_KEY_LEN)
-            i--;
-        if (i >= 0 && m_buffer[i].form != vnw_empty)
-            return 0;
+    int i = 0, j, node = 0, item = -1, found;
 
-        if (i >= 0) {
-            if (m_buffer[i].vnSym != vnl_nonVnChar) {
-                key[0] = m_buffer[i].vnSym + VnStdCharOffset;
-                if (m_buffer[i].caps)
-                    key[0]--;
-                key[0] += m_buffer[i].tone * 2;
-            } else
-                key[0] = m_buffer[i].keyCode;
-        }
-
-        for (j = i + 1; j <= m_current; j++) {
-            if (m_buffer[j].vnSym != vnl_nonVnChar) {
-                key[j - i] = m_buffer[j].vnSym + VnStdCharOffset;
-                if (m_buffer[j].caps)
-                    key[j - i]--;
-                key[j - i] += m_buffer[j].tone * 2;
-            } else
-                key[j - i] = m_buffer[j].keyCode;
-        }
-        key[m_current - i + 1] = 0;
-        // search macro table
-        pMacText = m_pCtrl->macStore.lookup(key + 1);
-        if (pMacText) {
-            i++; // mark the position where change is needed
-            pKeyStart = key + 1;
+    // Follow the entries backwards in the trie of the keys, all the keys
+    // that end here are met on the way. A key starts a word or a separator,
+    // the longest wins so a phrase beats the word it ends with
+    for (j = m_current; j >= 0 && (m_current - j + 1) < MAX_MACRO_KEY_LEN;
+         j--) {
+        node = m_pCtrl->macStore->suffixNext(node, stdCharAt(j));
+        if (node < 0)
             break;
+        found = m_pCtrl->macStore->suffixItem(node);
+        if (found >= 0 && (j == 0 || m_buffer[j - 1].form == vnw_empty ||
+                           m_buffer[j].form == vnw_empty)) {
+            item = found;
+            i = j; // mark the position where change is needed
         }
-        if (i >= 0) {
-            pMacText = m_pCtrl->macStore.lookup(key);
-            if (pMacText) {
-                pKeyStart = key;
-                break;
-            }
-        }
-        i--;
     }
 
-    if (!pMacText) {
+    if (item < 0) {
         return 0;
     }
-
-    markChange(i);
+    for (j = i; j <= m_current; j++)
+        key[j - i] = stdCharAt(j);
+    key[m_current - i + 1] = 0;
 
     // determine the form of macro replacements: ALL CAPITALS, First Character
     // Capital, or no change
@@ -2748,49 +3238,56 @@ int UkEngine::macroMatch(UkKeyEvent &ev) {
         macroCase = VnCaseAllSmall;
     } else if (IS_STD_VN_UPPER(*pKeyStart)) {
         macroCase = VnCaseAllCapital;
-        for (i = 1; pKeyStart[i]; i++) {
-            if (IS_STD_VN_LOWER(pKeyStart[i])) {
+        for (j = 1; pKeyStart[j]; j++) {
+            if (IS_STD_VN_LOWER(pKeyStart[j])) {
                 macroCase = VnCaseNoChange;
             }
         }
     } else
         macroCase = VnCaseNoChange;
 
-    // Convert case of macro text according to macroCase
-    int charCount = 0;
-    while (pMacText[charCount] != 0)
-        charCount++;
+    // The case forms of the text are encoded for the output charset with the
+    // table, none only if the charset can't write it
+    int textLen = 0;
+    const UKBYTE *text = m_pCtrl->macStore->encodedText(
+        item, macroCase, m_pCtrl->charsetId, textLen);
+    if (!text)
+        return 0;
 
-    for (i = 0; i < charCount; i++) {
-        if (macroCase == VnCaseAllCapital)
-            macroText[i] = StdVnToUpper(pMacText[i]);
-        else if (macroCase == VnCaseAllSmall)
-            macroText[i] = StdVnToLower(pMacText[i]);
-        else
-            macroText[i] = pMacText[i];
-    }
+    markChange(i);
 
-    // Convert to target output charset
-    int outSize;
-    int maxOutSize = *m_pOutSize;
-    int inLen = charCount * sizeof(StdVnChar);
-    VnConvert(CONV_CHARSET_VNSTANDARD, m_pCtrl->charsetId, (UKBYTE *)macroText,
-              (UKBYTE *)m_pOutBuf, &inLen, &maxOutSize);
-    outSize = maxOutSize;
-
-    // write the last input character
-    StdVnChar vnChar;
-    if (outSize < *m_pOutSize && ev.keyCode) {
-        maxOutSize = *m_pOutSize - outSize;
+    // the last input character, a word break that is ASCII but for Enter
+    UKBYTE tail[16];
+    const UKBYTE *pTail = tail;
+    int tailLen = 0;
+    if (ev.keyCode) {
+        StdVnChar vnChar;
         if (ev.vnSym != vnl_nonVnChar)
             vnChar = ev.vnSym + VnStdCharOffset;
         else
             vnChar = ev.keyCode;
-        inLen = sizeof(StdVnChar);
-        VnConvert(CONV_CHARSET_VNSTANDARD, m_pCtrl->charsetId,
-                  (UKBYTE *)&vnChar, ((UKBYTE *)m_pOutBuf) + outSize, &inLen,
-                  &maxOutSize);
-        outSize += maxOutSize;
+        pTail = m_pCtrl->macStore->encodedAscii(vnChar, m_pCtrl->charsetId,
+                                               tailLen);
+        if (!pTail) {
+            int inLen = sizeof(StdVnChar);
+            tailLen = sizeof(tail);
+            VnConvert(CONV_CHARSET_VNSTANDARD, m_pCtrl->charsetId,
+                      (UKBYTE *)&vnChar, tail, &inLen, &tailLen);
+            pTail = tail;
+        }
+    }
+
+    // output that does not fit the buffer is left in m_longOutput
+    int outSize;
+    if (textLen + tailLen <= *m_pOutSize) {
+        memcpy(m_pOutBuf, text, textLen);
+        memcpy(m_pOutBuf + textLen, pTail, tailLen);
+        outSize = textLen + tailLen;
+        m_longOutput.clear();
+    } else {
+        m_longOutput.assign((const char *)text, textLen);
+        m_longOutput.append((const char *)pTail, tailLen);
+        outSize = 0;
     }
     int backs = m_backs; // store m_backs before calling reset
     reset();
@@ -2800,6 +3297,15 @@ int UkEngine::macroMatch(UkKeyEvent &ev) {
     return 1;
 }
 
+//----------------------------------------------------
+StdVnChar UkEngine::stdCharAt(int pos) const {
+    const WordInfo &entry = m_buffer[pos];
+    if (entry.vnSym == vnl_nonVnChar)
+        return entry.keyCode;
+    return entry.vnSym + VnStdCharOffset - (entry.caps ? 1 : 0) +
+           entry.tone * 2;
+}
+
 //----------------------------------------------------
 int UkEngine::restoreKeyStrokes(int &backs, unsigned char *outBuf, int &outSize,
                                 UkOutputType &outType) {
@@ -2832,26 +3338,41 @@ int UkEngine::restoreKeyStrokes(int &backs, unsigned char *outBuf, int &outSize,
         return 0;
     }
 
-    // int i = m_current;
-    while (m_current >= 0 && m_buffer[m_current].form != vnw_empty)
-        m_current--;
-    markChange(m_current + 1);
+    int i = m_current;
+    while (i >= 0 && m_buffer[i].form != vnw_empty)
+        i--;
+    // the characters that show their key strokes already stay
+    int same = typedPrefixLength(i + 1, keyStart);
+    m_current = i;
+    markChange(m_current + 1 + same);
     backs = m_backs;
 
+    // the raw word is usually at hand, otherwise the key strokes are
+    // processed again
+    bool shadowed = rawWordShadows(keyStart);
     int count;
-    int i;
     UkKeyEvent ev;
     m_keyRestoring = true;
     for (i = keyStart, count = 0; i <= m_keyCurrent; i++) {
-        if (count < outSize) {
+        if (i >= keyStart + same && count < outSize) {
             outBuf[count++] = (unsigned char)m_keyStrokes[i].ev.keyCode;
         }
-        m_pCtrl->input.keyCodeToSymbol(m_keyStrokes[i].ev.keyCode, ev);
         m_keyStrokes[i].converted = false;
-        processAppend(ev);
+        if (!shadowed) {
+            m_pCtrl->input.keyCodeToSymbol(m_keyStrokes[i].ev.keyCode, ev);
+            processAppend(ev);
+        }
+    }
+    if (shadowed) {
+        memcpy(m_buffer + m_rawBase, m_rawBuffer + m_rawBase,
+               (m_rawCurrent - m_rawBase + 1) * sizeof(WordInfo));
+        m_current = m_rawCurrent;
+    } else {
+        m_rawValid = false;
     }
     outSize = count;
     m_keyRestoring = false;
+    clearCheckpoints();
 
     return 1;
 }
@@ -2860,31 +3381,10 @@ int UkEngine::restoreKeyStrokes(int &backs, unsigned char *outBuf, int &outSize,
 void UkEngine::setSingleMode() { m_singleMode = true; }
 
 //--------------------------------------------------
-static void SetupUnikeyEngineOnce() {
-    SetupInputClassifierTable();
-    int i;
-    VnLexiName lexi;
-
-    // Calculate IsoStdVnCharMap
-    for (i = 0; i < 256; i++) {
-        IsoStdVnCharMap[i] = i;
-    }
-
-    for (i = 0; SpecialWesternChars[i]; i++) {
-        IsoStdVnCharMap[SpecialWesternChars[i]] =
-            (vnl_lastChar + i) + VnStdCharOffset;
-    }
-
-    for (i = 0; i < 256; i++) {
-        if ((lexi = IsoToVnLexi(i)) != vnl_nonVnChar) {
-            IsoStdVnCharMap[i] = lexi + VnStdCharOffset;
-        }
-    }
-}
-
-std::once_flag setupFlag;
-
-void SetupUnikeyEngine() { std::call_once(setupFlag, SetupUnikeyEngineOnce); }
+// The engine tables are all built when compiling, there is nothing left to
+// set up
+//--------------------------------------------------
+void SetupUnikeyEngine() {}
 
 //--------------------------------------------------
 bool UkEngine::atWordBeginning() const {
@@ -2916,6 +3416,11 @@ int UkEngine::processWordEnd(UkKeyEvent &ev) {
         return 0;
     }
 
+    if (m_pCtrl->options.autoComplete && completeLastWord()) {
+        putKeyInBuffer(ev);
+        return 1;
+    }
+
     int outSize = 0;
     if (m_pCtrl->options.autoNonVnRestore && lastWordIsNonVn()) {
         outSize = *m_pOutSize;
@@ -2955,7 +3460,9 @@ bool UkEngine::lastWordIsNonVn() const {
         return false;
     case vnw_v:
     case vnw_cv:
-        return !VSeqList[m_buffer[m_current].vseq].complete;
+        if (!VSeqList[m_buffer[m_current].vseq].complete)
+            return true;
+        break;
     case vnw_vc:
     case vnw_cvc: {
         int vIndex = m_current - m_buffer[m_current].vOffset;
@@ -2980,7 +3487,108 @@ bool UkEngine::lastWordIsNonVn() const {
         }
     }
     }
-    return false;
+    return m_pCtrl->options.strictSpellCheck && !lastWordIsStrictSyllable();
+}
+
+//---------------------------------------------------------------------------
+// With the strict spell check, test if a mark may go on the last word: the
+// word it makes must still be able to become a syllable the check accepts
+//---------------------------------------------------------------------------
+bool UkEngine::canBeStrict(ConSeq c1, VowelSeq vs, ConSeq c2, int tone) const {
+    if (!m_pCtrl->options.spellCheckEnabled ||
+        !m_pCtrl->options.strictSpellCheck || m_singleMode)
+        return true;
+    return canBeStrictVnSyllable(c1, vs, c2, tone);
+}
+
+//---------------------------------------------------------------------------
+// Test if last word, a syllable by the rules above, is one of the syllables
+// the strict spell check accepts
+//---------------------------------------------------------------------------
+bool UkEngine::lastWordIsStrictSyllable() const {
+    const WordInfo &last = m_buffer[m_current];
+    int vIndex = m_current - last.vOffset;
+    VowelSeq vs = m_buffer[vIndex].vseq;
+    ConSeq c1 = cs_nil;
+    if (last.c1Offset != -1)
+        c1 = m_buffer[m_current - last.c1Offset].cseq;
+    ConSeq c2 = cs_nil;
+    if (last.form == vnw_vc || last.form == vnw_cvc)
+        c2 = last.cseq;
+
+    // with free marking the tone may sit on any of the vowels
+    int i, tone = 0;
+    for (i = vIndex - VSeqList[vs].len + 1; i <= vIndex; i++) {
+        if (m_buffer[i].tone)
+            tone = m_buffer[i].tone;
+    }
+    return isStrictVnSyllable(c1, vs, c2, tone);
+}
+
+//---------------------------------------------------------------------------
+// Add the roofs and hooks the last word lacks to be a syllable, when it can
+// be only one: luan -> lua^n, tien -> tie^n
+//---------------------------------------------------------------------------
+bool UkEngine::completeLastWord() {
+    if (m_current < 0)
+        return false;
+    VnWordForm form = m_buffer[m_current].form;
+    if (form != vnw_v && form != vnw_cv && form != vnw_vc && form != vnw_cvc)
+        return false;
+    if (!lastWordIsNonVn() && lastWordIsStrictSyllable())
+        return false;
+
+    const WordInfo &last = m_buffer[m_current];
+    int vEnd = m_current - last.vOffset;
+    VowelSeq vs = m_buffer[vEnd].vseq;
+    int vStart = vEnd - VSeqList[vs].len + 1;
+    ConSeq c1 = cs_nil;
+    if (last.c1Offset != -1)
+        c1 = m_buffer[m_current - last.c1Offset].cseq;
+    ConSeq c2 = cs_nil;
+    if (form == vnw_vc || form == vnw_cvc)
+        c2 = last.cseq;
+
+    VowelSeq newVs = completeVnSyllable(c1, vs, c2);
+    if (newVs == vs_nil || newVs == vs)
+        return false;
+
+    int i, tone = 0, tonePos = vStart;
+    for (i = vStart; i <= vEnd; i++) {
+        if (m_buffer[i].tone) {
+            tone = m_buffer[i].tone;
+            tonePos = i;
+        }
+    }
+    if (!isStrictVnSyllable(c1, newVs, c2, tone))
+        return false;
+
+    const VowelSeqInfo &info = VSeqList[newVs];
+    int newTonePos = vStart + getTonePosition(newVs, vEnd == m_current);
+    int changePos = vEnd + 1;
+    for (i = 0; i < info.len; i++) {
+        if (m_buffer[vStart + i].vnSym != info.v[i]) {
+            changePos = vStart + i;
+            break;
+        }
+    }
+    if (tone != 0 && tonePos != newTonePos) {
+        if (tonePos < changePos)
+            changePos = tonePos;
+        if (newTonePos < changePos)
+            changePos = newTonePos;
+    }
+
+    markChange(changePos);
+    for (i = 0; i < info.len; i++) {
+        m_buffer[vStart + i].vnSym = info.v[i];
+        m_buffer[vStart + i].vseq = info.sub[i];
+    }
+    if (tone != 0 && tonePos != newTonePos) {
+        m_buffer[tonePos].tone = 0;
+        m_buffer[newTonePos].tone = tone;
+    }
+    return true;
 }
 
 //---------------------------------------------------------------------------
@@ -3000,3 +3608,83 @@ bool UkEngine::lastWordHasVnMark() const {
     }
     return false;
 }
+
+//---------------------------------------------------------------------------
+// Test if the entry shows the character of the key, as restoring the key
+// strokes would write it
+//---------------------------------------------------------------------------
+bool UkEngine::entryShowsKey(int pos, int keyCode) const {
+    const WordInfo &entry = m_buffer[pos];
+    if (entry.vnSym == vnl_nonVnChar)
+        return entry.keyCode == keyCode;
+    int lexi = entry.vnSym + entry.tone * 2 - (entry.caps ? 1 : 0);
+    return IsoToVnLexi(keyCode) == lexi;
+}
+
+//---------------------------------------------------------------------------
+// Number of entries from pos on that show the key strokes from keyStart on,
+// one key each
+//---------------------------------------------------------------------------
+int UkEngine::typedPrefixLength(int pos, int keyStart) const {
+    int n = 0;
+    while (pos + n <= m_current && m_buffer[pos + n].form != vnw_empty &&
+           keyStart + n <= m_keyCurrent &&
+           entryShowsKey(pos + n, m_keyStrokes[keyStart + n].ev.keyCode))
+        n++;
+    return n;
+}
+
+//---------------------------------------------------------------------------
+// Number of characters at the start of the last word that no key stroke but
+// backspace can change any more: the consonants before the vowel, as they
+// were typed, which restoring the key strokes writes again. d may still
+// become dd, and a macro may replace the whole word as long as some macro
+// key starts with these consonants
+//---------------------------------------------------------------------------
+int UkEngine::lastWordFixedLength() const {
+    int start = m_current;
+    while (start >= 0 && m_buffer[start].form != vnw_empty)
+        start--;
+    start++;
+    int keyStart = m_keyCurrent;
+    while (keyStart >= 0 && m_keyStrokes[keyStart].ev.chType != ukcWordBreak)
+        keyStart--;
+    keyStart++;
+
+    int typed = typedPrefixLength(start, keyStart);
+    if (typed > MAX_MACRO_KEY_LEN - 1)
+        typed = MAX_MACRO_KEY_LEN - 1;
+    StdVnChar key[MAX_MACRO_KEY_LEN];
+    int len;
+    for (len = 0; len < typed; len++) {
+        const WordInfo &entry = m_buffer[start + len];
+        if (entry.vnSym == vnl_nonVnChar || IsVnVowel[entry.vnSym] ||
+            entry.vnSym == vnl_d || entry.vnSym == vnl_dd)
+            break;
+        key[len] = entry.vnSym + VnStdCharOffset - (entry.caps ? 1 : 0);
+    }
+    key[len] = 0;
+
+    if (len > 0 && m_pCtrl->options.macroEnabled && m_pCtrl->macStore &&
+        m_pCtrl->macStore->hasKeyPrefix(key))
+        return 0;
+    // the words before may start a phrase macro with this one
+    if (start > 0 && m_pCtrl->options.macroEnabled &&
+        m_pCtrl->options.phraseMacro)
+        return 0;
+    return len;
+}
+
+//----------------------------------------------------
+bool UkEngine::wordsStartPhraseMacro() const {
+    if (!m_pCtrl->options.macroEnabled || !m_pCtrl->options.phraseMacro ||
+        !m_pCtrl->macStore || m_current < 0 ||
+        m_current + 1 >= MAX_MACRO_KEY_LEN)
+        return false;
+
+    StdVnChar key[MAX_MACRO_KEY_LEN];
+    for (int i = 0; i <= m_current; i++)
+        key[i] = stdCharAt(i);
+    key[m_current + 1] = 0;
+    return m_pCtrl->macStore->hasKeyPrefix(key);
+}
@@ -12,8 +12,11 @@
 #include "mactab.h"
 #include "vnlexi.h"
 #include <functional>
+#include <string>
+#include <string_view>
 
-// This is a shared object among processes, do not put any pointer in it
+// The state of an input method, that its engines share. The macro table is
+// read only, sealed in a segment
 struct UkSharedMem {
     // states
     bool vietKey;
@@ -24,10 +27,12 @@ struct UkSharedMem {
     int usrKeyMap[256];
     int charsetId;
 
-    CMacroTable macStore;
+    const CMacroTable *macStore; // null if there is none
 };
 
 #define MAX_UK_ENGINE 128
+#define UK_CHECKPOINTS 32       // key strokes backspace can take back exactly
+#define UK_CHECKPOINT_ENTRIES 6 // entries of the word saved before each
 
 enum VnWordForm { vnw_nonVn, vnw_empty, vnw_c, vnw_v, vnw_cv, vnw_vc, vnw_cvc };
 
@@ -42,6 +47,9 @@ struct KeyBufEntry {
 class UkEngine {
 public:
     UkEngine();
+    // the buffers point into the engine itself
+    UkEngine(const UkEngine &) = delete;
+    UkEngine &operator=(const UkEngine &) = delete;
     void setCtrlInfo(UkSharedMem *p) { m_pCtrl = p; }
 
     void setCheckKbCaseFunc(CheckKeyboardCaseCb pFunc) {
@@ -52,6 +60,9 @@ public:
 
     int process(unsigned int keyCode, int &backs, unsigned char *outBuf,
                 int &outSize, UkOutputType &outType);
+    // output of the last process() that did not fit its buffer, in place of
+    // what it wrote there
+    std::string_view longOutput() const { return m_longOutput; }
     // just pass through without filtering
     void pass(int keyCode);
     // rebuild preedit from surrounding char
@@ -65,6 +76,9 @@ public:
     void reset();
     int restoreKeyStrokes(int &backs, unsigned char *outBuf, int &outSize,
                           UkOutputType &outType);
+    int lastWordFixedLength() const;
+    // the words since the reset start the key of a phrase macro
+    bool wordsStartPhraseMacro() const;
 
     // following methods must be public just to enable the use of pointers to
     // them they should not be called from outside.
@@ -80,7 +94,6 @@ public:
     int processEscChar(UkKeyEvent &ev);
 
 protected:
-    static bool m_classInit;
     CheckKeyboardCaseCb m_keyCheckFunc;
     UkSharedMem *m_pCtrl;
 
@@ -123,10 +136,37 @@ protected:
         int keyCode;
     };
 
-    WordInfo m_buffer[MAX_UK_ENGINE];
+    // state before a key stroke, with the last entries of the word
+    struct Checkpoint {
+        int current, keyCurrent;
+        int singleMode;
+        bool toEscape;
+        int first; // position of entries[0], -1 if the key changed more
+        WordInfo entries[UK_CHECKPOINT_ENTRIES];
+    };
+
+    // ring of the last key strokes
+    Checkpoint m_checkpoints[UK_CHECKPOINTS];
+    int m_ckptTop; // slot of the next one
+    int m_ckptCount;
+    bool m_ckptPending;
+
+    std::string m_longOutput;
+
+    WordInfo m_wordStore[2][MAX_UK_ENGINE];
+    WordInfo *m_buffer;
+    // the current word as restoreKeyStrokes() would rebuild it from its key
+    // strokes, kept up to date with each of them
+    WordInfo *m_rawBuffer;
+    int m_rawCurrent;
+    int m_rawBase;     // where the word starts in both buffers
+    int m_rawKeyStart; // first key stroke of the word
+    bool m_rawVietKey;
+    bool m_rawValid;
 
     int processHookWithUO(UkKeyEvent &ev);
     int macroMatch(UkKeyEvent &ev);
+    StdVnChar stdCharAt(int pos) const;
     void markChange(int pos);
     void prepareBuffer(); // make sure we have a least 10 entries available
     int writeOutput(unsigned char *outBuf, int &outSize);
@@ -138,10 +178,24 @@ protected:
     int processNoSpellCheck(UkKeyEvent &ev);
     int processWordEnd(UkKeyEvent &ev);
     void synchKeyStrokeBuffer();
+    void shadowKeyStroke();
+    void saveCheckpoint();
+    void commitCheckpoint();
+    void clearCheckpoints();
+    bool undoLastChar();
+    bool rawWordShadows(int keyStart) const;
     bool lastWordHasVnMark() const;
+    bool entryShowsKey(int pos, int keyCode) const;
+    int typedPrefixLength(int pos, int keyStart) const;
     bool lastWordIsNonVn() const;
+    bool lastWordIsStrictSyllable() const;
+    bool canBeStrict(ConSeq c1, VowelSeq vs, ConSeq c2, int tone) const;
+    bool completeLastWord();
 };
 
 void SetupUnikeyEngine();
+bool isVnSyllable(const VnLexiName *word, int len);
+bool isStrictVnSyllable(ConSeq c1, VowelSeq v, ConSeq c2, int tone);
+VowelSeq completeVnSyllable(ConSeq c1, VowelSeq v, ConSeq c2);
 
 #endif
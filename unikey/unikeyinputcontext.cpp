@@ -22,14 +22,17 @@ void CreateDefaultUnikeyOptions(UnikeyOptions *pOpt) {
     pOpt->useUnicodeClipboard = 0;
     pOpt->alwaysMacro = 0;
     pOpt->spellCheckEnabled = 1;
+    pOpt->strictSpellCheck = 0;
     pOpt->autoNonVnRestore = 0;
+    pOpt->autoComplete = 0;
+    pOpt->phraseMacro = 0;
 }
 
 UnikeyInputMethod::UnikeyInputMethod()
     : sharedMem_(std::make_unique<UkSharedMem>()) {
     SetupUnikeyEngine();
     sharedMem_->input.init();
-    sharedMem_->macStore.init();
+    sharedMem_->macStore = nullptr;
     sharedMem_->vietKey = true;
     sharedMem_->usrKeyMapLoaded = false;
     setInputMethod(UkTelex);
@@ -52,9 +55,54 @@ void UnikeyInputMethod::setInputMethod(UkInputMethod im) {
 
 void UnikeyInputMethod::setOutputCharset(int charset) {
     sharedMem_->charsetId = charset;
+    // the texts are encoded for the charset
+    const CMacroTable *table = sharedMem_->macStore;
+    if (!table || table->encodedCharset() != charset) {
+        buildMacroTable([table](CMacroTable &copy) {
+            if (table)
+                copy = *table;
+            return true;
+        });
+    }
     emit<Reset>();
 }
 
+//--------------------------------------------
+// Fill a new table, then compile it to a segment of the size it takes,
+// which replaces the old one once it is sealed
+//--------------------------------------------
+int UnikeyInputMethod::buildMacroTable(
+    const std::function<bool(CMacroTable &)> &fill) {
+    auto table = std::make_unique<CMacroTable>();
+    table->init();
+    if (!fill(*table))
+        return 0;
+    UkSharedSegment segment;
+    const CMacroTable *compiled = table->compile(
+        sharedMem_->charsetId,
+        [&segment](size_t size) { return segment.create(size); });
+    if (!compiled || !segment.seal())
+        return 0;
+    macroSegment_ = std::move(segment);
+    sharedMem_->macStore = compiled;
+    return 1;
+}
+
+//--------------------------------------------
+int UnikeyInputMethod::loadMacroTable(const char *fileName) {
+    return buildMacroTable([fileName](CMacroTable &table) {
+        return table.loadFromFile(fileName) != 0;
+    });
+}
+
+//--------------------------------------------
+void UnikeyInputMethod::setMacroTable(const CMacroTable &table) {
+    buildMacroTable([&table](CMacroTable &copy) {
+        copy = table;
+        return true;
+    });
+}
+
 //--------------------------------------------
 void UnikeyInputMethod::setOptions(UnikeyOptions *pOpt) {
     sharedMem_->options.freeMarking = pOpt->freeMarking;
@@ -63,7 +111,10 @@ void UnikeyInputMethod::setOptions(UnikeyOptions *pOpt) {
     sharedMem_->options.useUnicodeClipboard = pOpt->useUnicodeClipboard;
     sharedMem_->options.alwaysMacro = pOpt->alwaysMacro;
     sharedMem_->options.spellCheckEnabled = pOpt->spellCheckEnabled;
+    sharedMem_->options.strictSpellCheck = pOpt->strictSpellCheck;
     sharedMem_->options.autoNonVnRestore = pOpt->autoNonVnRestore;
+    sharedMem_->options.autoComplete = pOpt->autoComplete;
+    sharedMem_->options.phraseMacro = pOpt->phraseMacro;
 }
 
 //--------------------------------------------
@@ -78,7 +129,8 @@ void UnikeyInputContext::setCapsState(int shiftPressed, int CapsLockOn) {
 UnikeyInputContext::UnikeyInputContext(UnikeyInputMethod *im) {
     conn_ =
         im->connect<UnikeyInputMethod::Reset>([this]() { engine_.reset(); });
-    engine_.setCtrlInfo(im->sharedMem());
+    sharedMem_ = im->sharedMem();
+    engine_.setCtrlInfo(sharedMem_);
     engine_.setCheckKbCaseFunc([this](int *pShiftPressed, int *pCapsLockOn) {
         *pShiftPressed = shiftPressed_;
         *pCapsLockOn = capsLockOn_;
@@ -90,12 +142,54 @@ UnikeyInputContext::~UnikeyInputContext() {}
 
 //--------------------------------------------
 void UnikeyInputContext::filter(unsigned int ch) {
+    out_ = buf_;
     bufChars_ = sizeof(buf_);
     engine_.process(ch, backspaces_, buf_, bufChars_, output_);
+    if (!engine_.longOutput().empty()) {
+        batch_ = engine_.longOutput();
+        out_ = (const unsigned char *)batch_.data();
+        bufChars_ = batch_.size();
+    }
+}
+
+//--------------------------------------------
+// The backspaces of each key take back what the keys before it wrote
+// first, the rest are left for the text before the keys
+//--------------------------------------------
+void UnikeyInputContext::filter(std::span<const unsigned int> keyCodes) {
+    // the engine counts characters of UTF-8 and bytes of other charsets
+    bool utf8 = sharedMem_->charsetId == CONV_CHARSET_XUTF8;
+    int backs, outSize;
+
+    batch_.clear();
+    backspaces_ = 0;
+    for (unsigned int ch : keyCodes) {
+        outSize = sizeof(buf_);
+        engine_.process(ch, backs, buf_, outSize, output_);
+        std::string_view out((const char *)buf_, outSize);
+        if (!engine_.longOutput().empty()) {
+            out = engine_.longOutput();
+        } else if (outSize == 0) {
+            // the key is written as it is
+            buf_[0] = ch;
+            out = std::string_view((const char *)buf_, 1);
+        }
+        for (; backs > 0 && !batch_.empty(); backs--) {
+            while (utf8 && batch_.size() > 1 &&
+                   (batch_.back() & 0xC0) == 0x80)
+                batch_.pop_back();
+            batch_.pop_back();
+        }
+        backspaces_ += backs;
+        batch_.append(out);
+    }
+    out_ = (const unsigned char *)batch_.data();
+    bufChars_ = batch_.size();
 }
 
 //--------------------------------------------
 void UnikeyInputContext::putChar(unsigned int ch) {
+    out_ = buf_;
     engine_.pass(ch);
     bufChars_ = 0;
     backspaces_ = 0;
@@ -103,6 +197,7 @@ void UnikeyInputContext::putChar(unsigned int ch) {
 
 //--------------------------------------------
 void UnikeyInputContext::rebuildChar(VnLexiName ch) {
+    out_ = buf_;
     bufChars_ = sizeof(buf_);
     engine_.rebuildChar(ch, backspaces_, buf_, bufChars_);
 }
@@ -112,6 +207,7 @@ void UnikeyInputContext::resetBuf() { engine_.reset(); }
 
 //--------------------------------------------
 void UnikeyInputContext::backspacePress() {
+    out_ = buf_;
     bufChars_ = sizeof(buf_);
     engine_.processBackspace(backspaces_, buf_, bufChars_, output_);
     //  printf("Backspaces: %d\n",UnikeyBackspaces);
@@ -119,6 +215,7 @@ void UnikeyInputContext::backspacePress() {
 
 //--------------------------------------------
 void UnikeyInputContext::restoreKeyStrokes() {
+    out_ = buf_;
     bufChars_ = sizeof(buf_);
     engine_.restoreKeyStrokes(backspaces_, buf_, bufChars_, output_);
 }
@@ -8,9 +8,13 @@
 #define _UNIKEY_UNIKEYINPUTCONTEXT_H_
 
 #include "keycons.h"
+#include "sharedseg.h"
 #include "ukengine.h"
 #include <fcitx-utils/connectableobject.h>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string>
 
 class UnikeyInputMethod : public fcitx::ConnectableObject {
 public:
@@ -26,9 +30,9 @@ public:
     void setOptions(UnikeyOptions *pOpt);
 
     //--------------------------------------------
-    int loadMacroTable(const char *fileName) {
-        return sharedMem_->macStore.loadFromFile(fileName);
-    }
+    int loadMacroTable(const char *fileName);
+    // use a copy of the table
+    void setMacroTable(const CMacroTable &table);
 
     UkSharedMem *sharedMem() { return sharedMem_.get(); }
 
@@ -36,7 +40,10 @@ public:
 
 private:
     FCITX_DEFINE_SIGNAL(UnikeyInputMethod, Reset);
+    int buildMacroTable(const std::function<bool(CMacroTable &)> &fill);
+
     std::unique_ptr<UkSharedMem> sharedMem_;
+    UkSharedSegment macroSegment_;
 };
 
 class UnikeyInputContext {
@@ -50,6 +57,9 @@ public:
 
     // main handler, call every time a character input is received
     void filter(unsigned int ch);
+    // feed keys received together, leaves what they write as one output and
+    // one count of backspaces
+    void filter(std::span<const unsigned int> keyCodes);
     void putChar(unsigned int ch); // put new char without filtering
 
     // call to rebuild preedit from surrounding char
@@ -66,19 +76,26 @@ public:
     void restoreKeyStrokes();
 
     bool isAtWordBeginning() const;
+    // characters at the start of the word that will not change any more
+    int fixedChars() const { return engine_.lastWordFixedLength(); }
+    // the words typed since the reset may still become a phrase macro
+    bool startsPhraseMacro() const { return engine_.wordsStartPhraseMacro(); }
 
     int backspaces() const { return backspaces_; }
     int bufChars() const { return bufChars_; }
-    const unsigned char *buf() const { return buf_; }
+    const unsigned char *buf() const { return out_; }
 
 private:
     fcitx::ScopedConnection conn_;
 
     unsigned char buf_[1024];
+    std::string batch_; // output of the keys fed together
+    const unsigned char *out_ = buf_;
     int backspaces_ = 0;
     int bufChars_;
     UkOutputType output_;
     UkEngine engine_;
+    UkSharedMem *sharedMem_;
 
     int capsLockOn_ = 0;
     int shiftPressed_ = 0;
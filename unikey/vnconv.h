@@ -67,6 +67,12 @@ DllInterface int VnConvert(int inCharset, int outCharset, UKBYTE *input,
 DllInterface int VnFileConvert(int inCharset, int outCharset,
                                const char *inFile, const char *outFile);
 
+// Same as VnFileConvert, converting pieces of the file on up to threads
+// threads. 0 means one thread per CPU
+DllInterface int VnFileConvertParallel(int inCharset, int outCharset,
+                                       const char *inFile, const char *outFile,
+                                       int threads);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -106,4 +112,34 @@ DllInterface void VnConvSetOptions(VnConvOptions *pOptions);
 DllInterface void VnConvGetOptions(VnConvOptions *pOptions);
 DllInterface void VnConvResetOptions(VnConvOptions *pOptions);
 
+// Adds a pattern such as "https:" to those after which VIQR input is left
+// alone up to the next white space (with the viqrEsc option), and VIQR output
+// is not escaped.
+// Returns 0 if successful, -1 if the pattern is empty, longer than 40 bytes
+// or contains a line feed
+DllInterface int VnConvAddViqrEscape(const char *pattern);
+
+#define VN_NORM_NFC 0 // precomposed letters
+#define VN_NORM_NFD 1 // letters followed by their combining marks
+
+// Writes the Vietnamese letters of UTF-8 text precomposed or decomposed.
+// The marks after a letter, precomposed or not, may come in any order.
+// Other characters are copied. Lengths are as with VnConvert.
+// Returns 0 if successful
+DllInterface int VnNormalizeUtf8(int form, const UKBYTE *input, int inLen,
+                                 UKBYTE *output, int *pMaxOutLen);
+
+typedef struct _VnCharsetGuess VnCharsetGuess;
+
+struct _VnCharsetGuess {
+    int charset;    // CONV_CHARSET_XXX
+    int confidence; // 0 to 100, 0 if nothing tells the candidates apart
+};
+
+// Guesses the charset of Vietnamese text from its first 64 KiB, with inLen
+// -1 for a null-terminated string. Writes up to maxGuesses guesses, the most
+// likely first, and returns how many were written
+DllInterface int VnDetectCharset(const UKBYTE *input, int inLen,
+                                 VnCharsetGuess *guesses, int maxGuesses);
+
 #endif